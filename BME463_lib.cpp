@@ -64,84 +64,193 @@ float filter_FIR(const float a, const float *in, const float *c, const int n){
     return a*sumNum;
 }
 
+/* Pan-Tompkins filter coefficients. These are shared by every channel; only
+ * the delay lines in pan_T_Filter_State are per channel. They are const so
+ * they stay in flash instead of being copied to RAM at startup.
+ */
+// LP Filter
+static const float a1[13] = {1, 0, 0, 0, 0, 0, -2, 0, 0, 0, 0, 0, 1};
+static const float b1[3] = {1, -2, 1};
+static const float g1 = 1;
+static int const nx1 = sizeof(a1) / sizeof(a1[0]);
+static int const ny1 = sizeof(b1) / sizeof(b1[0]);
+
+// HP Filter
+static const float a2[34] = {-1, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 32.0, -32.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 1};
+static const float b2[2] = {1, -1};
+static const float g2 = 1.0/32.0;
+static int const nx2 = sizeof(a2) / sizeof(a2[0]);
+static int const ny2 = sizeof(b2) / sizeof(b2[0]);
+
+// Deriv 2 coefficients
+static const float a3[5] = {2, 1, 0, -1, -2};
+static const float g3 = 1.0/8.0;
+static int const nx3 = sizeof(a3) / sizeof(a3[0]);
+
+// MWI coefficients
+static const float a4[32] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+static const float g4 = 0.03125;
+static int const nx4 = sizeof(a4) / sizeof(a4[0]);
+static int const ny4 = 3;
+
+/* PAN_T_NSR_LIMIT_Q16 must be k = T / sqrt(1 - T^2) in Q16, rounded, for
+ * T = SNR_THRESHOLD (four decimals at most). With T4 = 10000 T that is
+ * (2k - 1)^2 (10^8 - T4^2) <= (2 T4 2^16)^2 < (2k + 1)^2 (10^8 - T4^2),
+ * all integers, so it is checked at compile time.
+ */
+#define PAN_T_NSR_T4 ((int64_t) (SNR_THRESHOLD * 10000.0 + 0.5))
+#define PAN_T_NSR_K2(k) ((int64_t) (k) * (k) * (100000000 - PAN_T_NSR_T4 * PAN_T_NSR_T4))
+typedef char pan_T_nsr_limit_matches_threshold[(PAN_T_NSR_K2(2 * PAN_T_NSR_LIMIT_Q16 - 1) <=
+                                                    4 * PAN_T_NSR_T4 * PAN_T_NSR_T4 * ((int64_t) 1 << 32) &&
+                                                4 * PAN_T_NSR_T4 * PAN_T_NSR_T4 * ((int64_t) 1 << 32) <
+                                                    PAN_T_NSR_K2(2 * PAN_T_NSR_LIMIT_Q16 + 1)) ? 1 : -1];
+
 /**
- * @brief Implements the filtering stage of the Pan-Tompkins QRS Detection algorithm.
- * 
- * This function takes an analog input signal Ain and modifies the output yOut according to the signal processing algorithm.
- * 
+ * @brief Clears all delay lines of a filter state.
+ *
+ * @param state Filter state to reset.
+ */
+void pan_T_Filter_Init(pan_T_Filter_State *state){
+    pan_T_Filter_Init<pan_T_float>(state);
+}
+
+/**
+ * @brief Filtering stage of the Pan-Tompkins algorithm on an explicit channel state.
+ *
+ * @param state Filter state of the channel.
  * @param Ain ADC input signal.
- * @param yOut Output QRS levels.
  * @return float The filtered value of the input signal.
  */
-float pan_T_Filter(float Ain, float *yOut){
+float pan_T_Filter(pan_T_Filter_State *state, float Ain){
+    return pan_T_Filter<pan_T_float>(state, Ain);
+}
+
+/**
+ * @brief Runs the filtering stage over a block of samples.
+ *
+ * The state is copied into a local for the duration of the block, so the
+ * compiler can keep it away from the output arrays and run all stages of
+ * one sample back to back without reloading the state after every store.
+ *
+ * @param state Filter state of the channel.
+ * @param Ain Block of ADC input samples.
+ * @param n Number of samples in the block.
+ * @param value Filtered value of every sample, may be NULL.
+ * @param yOut Integrated output of every sample.
+ */
+void pan_T_Filter_Block(pan_T_Filter_State *state, const float *Ain, int n, float *value, float *yOut){
+    pan_T_Filter_State local = *state;
+    if (value != NULL) {
+        for (int i = 0; i < n; i++) {
+            value[i] = pan_T_Filter<pan_T_float>(&local, Ain[i]);
+            yOut[i] = local.mwi[0];
+        }
+    } else {
+        for (int i = 0; i < n; i++) {
+            pan_T_Filter<pan_T_float>(&local, Ain[i]);
+            yOut[i] = local.mwi[0];
+        }
+    }
+    *state = local;
+}
+
+/**
+ * @brief Filtering stage of the Pan-Tompkins algorithm using the generic filter_IIR()/filter_FIR().
+ *
+ * @param state Filter state of the channel.
+ * @param Ain ADC input signal.
+ * @return float The filtered value of the input signal.
+ */
+float pan_T_Filter_Generic(pan_T_Filter_State *state, float Ain){
     float value = 0.0;
-    // Initializing LP Filter
-    static float a1[13] = {1, 0, 0, 0, 0, 0, -2, 0, 0, 0, 0, 0, 1};
-    static float x1[13] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-    static float b1[3] = {1, -2, 1};
-    static float y1[3] = {0, 0, 0};
-    static float g1 = 1;
-    static int nx1 = sizeof(a1) / sizeof(a1[0]);
-    static int ny1 = sizeof(b1) / sizeof(b1[0]);
-
-    // Initializing HP Filter
-    static float a2[34] = {-1, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 32.0, -32.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 1};
-    static float x2[34] = {0, 0, 0, 0, 0, 0, 0, 0 ,0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-    static float b2[2] = {1, -1};
-    static float y2[2] = {0, 0,};
-    static float g2 = 1.0/32.0;
-    static int nx2 = sizeof(a2) / sizeof(a2[0]);
-    static int ny2 = sizeof(b2) / sizeof(b2[0]);
-
-    // Initializing deriv 2 Numerators and configs
-    static float a3[5] = {2, 1, 0, -1, -2}; // deriv2 coefficients
-    static float x3[5] = {0, 0, 0, 0, 0}; // x[0] = x[nT], x[1] = x(nT - T), x[3] = x(nT - 3T), x[4] = x(nT - 4T)
-    static float y3[1] = {0}; // y[0] = y(nT) is the output produced for each input, x[0] = x(nT)
-    static float g3 = 1.0/8.0;
-    static int const nx3 = sizeof(a3) / sizeof(a3[0]);
-
-    // Initializing MWI Numerators and configs
-    static float a4[32] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
-    static float x4[32] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
-    static float z4[1] = {0};
-    static float g4 = 0.03125;
-    static int const nx4 = sizeof(a4) / sizeof(a4[0]);
-    static int const ny4 = 3;
-
-    shift_right(x1, nx1); // Shifting lp filter
-    shift_right(y1, ny1);
-    shift_right(y2, ny2); // Shifting hp filter
-    shift_right(x2, nx2);
-    shift_right(x3, nx3); // Shifting Derivative filter
-    shift_right(x4, nx4); // Shifting MWI Filter
-    shift_right(yOut, ny4); // Shift MWI output for edge detection
+    float y3 = 0.0;     // y3 = y(nT) of the derivative, then of the squaring filter
 
     /* LP filter */
-    x1[0] = Ain;
-    y1[0] = filter_IIR(g1, x1, a1, nx1, y1, b1, ny1);
+    state->x1.push(Ain);
+    state->y1.push(0);
+    state->y1.set_newest(filter_IIR(g1, state->x1.taps(), a1, nx1, state->y1.taps(), b1, ny1));
 
     /* HP Filter */
-    x2[0] = y1[0];
-    y2[0] = filter_IIR(g2, x2, a2, nx2, y2, b2, ny2);
-    value = y2[0];
+    state->x2.push(state->y1[0]);
+    state->y2.push(0);
+    state->y2.set_newest(filter_IIR(g2, state->x2.taps(), a2, nx2, state->y2.taps(), b2, ny2));
+    value = state->y2[0];
 
     /* Deriv 2 Filter */
-    x3[0] = y2[0];
-    y3[0] = filter_FIR(g3, x3, a3, nx3);
+    state->x3.push(value);
+    y3 = filter_FIR(g3, state->x3.taps(), a3, nx3);
 
     /* Squaring Filter */
-    y3[0] = y3[0]*y3[0];
+    y3 = y3*y3;
 
     /* Moving Integral Filter */
-    x4[0] = y3[0];
-    yOut[0] = filter_FIR(g4, x4, a4, nx4);
+    state->x4.push(y3);
+    state->mwi.push(filter_FIR(g4, state->x4.taps(), a4, nx4));
     return value;
 }
 
+/**
+ * @brief Implements the filtering stage of the Pan-Tompkins QRS Detection algorithm.
+ * 
+ * This function takes an analog input signal Ain and modifies the output yOut according to the signal processing algorithm.
+ * The delay lines are kept in a single function-static state, so only one
+ * channel can be filtered this way; use the pan_T_Filter_State overload for more.
+ * 
+ * @param Ain ADC input signal.
+ * @param yOut Output QRS levels.
+ * @return float The filtered value of the input signal.
+ */
+float pan_T_Filter(float Ain, float *yOut){
+    static pan_T_Filter_State state; // Zero initialized
+    float value = pan_T_Filter(&state, Ain);
+    shift_right(yOut, ny4); // Shift MWI output for edge detection
+    yOut[0] = state.mwi[0];
+    return value;
+}
+
+/**
+ * @brief Clears the peak tracking state of the threshold stage.
+ *
+ * @param state Threshold state to reset.
+ */
+void pan_T_Threshold_Init(pan_T_Threshold_State *state){
+    pan_T_Threshold_Init<pan_T_float>(state);
+}
+
+/**
+ * @brief Moving threshold stage of the Pan-Tompkins algorithm on an explicit channel state.
+ *
+ * @param state Threshold state of the channel.
+ * @param yOut The last three integrated outputs, newest first.
+ * @param thresholdi1 Pointer to the threshold detection value.
+ * @param spki Pointer to the peak value of the signal (QRS complex).
+ * @param npki Pointer to the peak value of the noise.
+ * @param spki_window Recent peak values of the signal.
+ * @param npki_window Recent peak values of the noise.
+ * @return bool True if a QRS complex is detected, false otherwise.
+ */
+bool pan_T_Threshold(pan_T_Threshold_State *state, const float *yOut, float *thresholdi1, float *spki, float *npki, delay_line<8> *spki_window, delay_line<8> *npki_window) {
+    return pan_T_Threshold<pan_T_float>(state, yOut, thresholdi1, spki, npki, spki_window, npki_window);
+}
+
+/* spki/npki window of the array-based pan_T_Threshold(): 8 values, newest
+ * first, shifted by array_running_avg().
+ */
+typedef struct _array_window {
+    float *values;
+} array_window;
+
+template <typename Ops>
+static inline float pan_T_Window_Avg(array_window *window, float input) {
+    return array_running_avg(window->values, 8, input);
+}
+
 /**
  * @brief Implements the moving threshold stage of the Pan-Tompkins QRS detection algorithm.
  * 
  * This function updates the threshold detection values based on the output QRS levels from the last three values.
+ * The peak trackers are kept in a single function-static state, see the
+ * pan_T_Threshold_State overload for multiple channels.
  * 
  * @param yOut Pointer to the array containing the output of the QRS algorithm for the last three values.
  * @param thresholdi1 Pointer to the threshold detection value.
@@ -152,30 +261,73 @@ float pan_T_Filter(float Ain, float *yOut){
  * @return bool True if a QRS complex is detected, false otherwise.
  */
 bool pan_T_Threshold(float *yOut, float *thresholdi1, float *spki, float *npki, float *spki_array, float *npki_array) {
-    static float peakt = 0.0;
-    static float peaki = 0.0;
-    static bool QRS_detected = false;
-    
-    if (yOut[0] > yOut[2] && yOut[0] > peakt) {
-        peakt = yOut[0];
-    }
-    if (peakt > *thresholdi1) { // Compare with the value pointed to by thresholdi1
-        QRS_detected = true;
-    }
-    if (yOut[0] <= yOut[2] && yOut[0] < 0.5f * peakt) {
-        peaki = peakt; // Peakt is a local max
-        QRS_detected = false;
-        if (peaki > *thresholdi1) { // Compare with the value pointed to by thresholdi1
-            //*spki = 0.125f * peaki + 0.875f * (*spki); // Update the value pointed to by spki
-            *spki = array_running_avg(spki_array, 8, peaki);
-        } else {    // Local max is a noise peak.
-            //*npki = 0.125f * peaki + 0.875f * (*npki); // Update the value pointed to by npki
-            *npki = array_running_avg(npki_array, 8, peaki);
-        }
-        *thresholdi1 = *npki + 0.25f * (*spki - *npki); // Update the value pointed to by thresholdi1
-        peakt = 0; // Reset peakt for polling local max
-    }    
-    return QRS_detected;
+    static pan_T_Threshold_State state = {0.0, 0.0, false, 0};
+    array_window spki_window = {spki_array};
+    array_window npki_window = {npki_array};
+    return pan_T_Threshold<pan_T_float>(&state, yOut, thresholdi1, spki, npki, &spki_window, &npki_window);
+}
+
+/**
+ * @brief Resets a detector to the power-on state.
+ *
+ * @param det Detector to reset.
+ */
+void pan_T_Detector_Init(pan_T_Detector *det){
+    pan_T_Detector_Init<pan_T_float>(det);
+}
+
+/**
+ * @brief Runs one sample through the filter and threshold stages of a detector.
+ *
+ * @param det Detector of the channel.
+ * @param Ain ADC input signal.
+ * @param filtered Optional output for the filtered (band-passed) value, may be NULL.
+ * @return bool True if a QRS complex is detected, false otherwise.
+ */
+bool pan_T_Detector_Process(pan_T_Detector *det, float Ain, float *filtered){
+    return pan_T_Detector_Process<pan_T_float>(det, Ain, filtered);
+}
+
+/**
+ * @brief Resets the noise classification of a channel to clean.
+ *
+ * @param state Noise state to reset.
+ */
+void pan_T_Noise_Init(pan_T_Noise_State *state){
+    pan_T_Noise_Init<pan_T_float>(state);
+}
+
+/**
+ * @brief Classifies the current sample of a channel as clean or noisy.
+ *
+ * @param state Noise state of the channel.
+ * @param det Detector of the channel.
+ * @return bool True if the signal is noisy (cur_noise_state), false otherwise.
+ */
+bool pan_T_Noise_Update(pan_T_Noise_State *state, pan_T_Detector *det){
+    return pan_T_Noise_Update<pan_T_float>(state, det);
+}
+
+/**
+ * @brief Resets the beat timing of a channel.
+ *
+ * @param state Beat timing state to reset.
+ */
+void pan_T_Beat_Init(pan_T_Beat_State *state){
+    pan_T_Beat_Init<pan_T_float>(state);
+}
+
+/**
+ * @brief Times the R peak of every QRS detection.
+ *
+ * @param state Beat timing state of the channel.
+ * @param value Filtered value returned by pan_T_Detector_Process().
+ * @param qrs QRS flag returned by pan_T_Detector_Process().
+ * @param beat Receives the R peak and detection sample of a located beat.
+ * @return bool True if a beat was located on this sample, false otherwise.
+ */
+bool pan_T_Beat_Update(pan_T_Beat_State *state, float value, bool qrs, pan_T_beat *beat){
+    return pan_T_Beat_Update<pan_T_float>(state, value, qrs, beat);
 }
 
 /**
@@ -194,11 +346,25 @@ float array_running_avg(float *input_array, int length, float input){
     input_array[0] = input;
     float average = 0.0;
     for(int i = 0; i < length; i++){
-        average += input_array[i]*0.125;
+        average += input_array[i]*(1.0/length);
     }
     return average;
 }
 
+/**
+ * Adds a new input value to a window and returns the average of the window.
+ *
+ * Same result as array_running_avg() on an 8 element array, but the window is
+ * a delay_line so no elements are moved.
+ *
+ * @param window Window of the last 8 values.
+ * @param input  The new input value to add to the window.
+ * @return       The running average of the updated window.
+ */
+float window_running_avg(delay_line<8> *window, float input){
+    return pan_T_Window_Avg<pan_T_float>(window, input);
+}
+
 /**
  * Calculates the standard deviation of an array of floats.
  * 
@@ -242,7 +408,7 @@ float std_dev(float *input_array, int length) {
  * @param size Size of the array.
  * @return float The average of floats in the array.
  */
-float array_average(float arr[], int size){
+float array_average(const float arr[], int size){
     float sum = 0.0;
     
     // Calculate the sum of all elements in the array
@@ -12,6 +12,10 @@
 #ifndef _BME463_lib
 #define _BME463_lib
 
+#include <stddef.h>
+#include "delay_line.h"
+#include "pan_T_pipeline.h"
+
 /* DEFINE THIS IN LAB 4:
  * Moves all elements in an array of floats to the next position by one. Copies
  * the first element to the second position, the second element to the third 
@@ -47,6 +51,64 @@ float filter_IIR(float const a, float const* inx, float const* cx, int const nx,
  */
 float filter_FIR(float const a, float const* in, float const* c, int const n);
 
+/* Float instantiations of the pipeline in pan_T_pipeline.h, used by the
+ * functions below. See there for the fields of each state.
+ */
+typedef pan_T_Filter_T<pan_T_float> pan_T_Filter_State;
+typedef pan_T_Threshold_T<pan_T_float> pan_T_Threshold_State;
+typedef pan_T_Detector_T<pan_T_float> pan_T_Detector;
+typedef pan_T_Noise_T<pan_T_float> pan_T_Noise_State;
+typedef pan_T_Beat_T<pan_T_float> pan_T_Beat_State;
+
+/**
+ * @brief Clears all delay lines of a filter state.
+ *
+ * @param state Filter state to reset.
+ */
+void pan_T_Filter_Init(pan_T_Filter_State *state);
+
+/**
+ * @brief Filtering stage of the Pan-Tompkins algorithm on an explicit channel state.
+ *
+ * The integrated output is pushed into state->mwi; state->mwi.taps() can be
+ * passed as yOut to the threshold stage.
+ *
+ * @param state Filter state of the channel.
+ * @param Ain ADC input signal.
+ * @return float The filtered value of the input signal.
+ */
+float pan_T_Filter(pan_T_Filter_State *state, float Ain);
+
+/**
+ * @brief Runs the filtering stage over a block of samples.
+ *
+ * Gives exactly the same outputs and final state as calling
+ * pan_T_Filter(state, Ain[i]) for every sample, but runs the whole
+ * LP -> HP -> derivative -> square -> MWI chain in one pass over the block.
+ * Meant for offline processing of long recordings.
+ *
+ * @param state Filter state of the channel.
+ * @param Ain Block of ADC input samples.
+ * @param n Number of samples in the block.
+ * @param value Filtered value of every sample, may be NULL.
+ * @param yOut Integrated output (yOut[0] of pan_T_Filter()) of every sample.
+ */
+void pan_T_Filter_Block(pan_T_Filter_State *state, const float *Ain, int n, float *value, float *yOut);
+
+/**
+ * @brief Filtering stage of the Pan-Tompkins algorithm using the generic filter_IIR()/filter_FIR().
+ *
+ * Reference implementation of pan_T_Filter() that runs the coefficient arrays
+ * through the generic filters, zeros and all. It produces the same outputs
+ * within float rounding of the moving window sum. A state must be driven by
+ * only one of the two functions.
+ *
+ * @param state Filter state of the channel.
+ * @param Ain ADC input signal.
+ * @return float The filtered value of the input signal.
+ */
+float pan_T_Filter_Generic(pan_T_Filter_State *state, float Ain);
+
 /**
  * @brief Implements the filtering stage of the Pan-Tompkins QRS Detection algorithm.
  * 
@@ -73,6 +135,91 @@ float pan_T_Filter(float Ain, float *yOut);
  */
 bool pan_T_Threshold(float *yOut, float *thresholdi1, float *spki, float *npki, float *spki_array, float *npki_array) ;
 
+/**
+ * @brief Clears the peak tracking state of the threshold stage.
+ *
+ * @param state Threshold state to reset.
+ */
+void pan_T_Threshold_Init(pan_T_Threshold_State *state);
+
+/**
+ * @brief Moving threshold stage of the Pan-Tompkins algorithm on an explicit channel state.
+ *
+ * Same as pan_T_Threshold() but the peak trackers are taken from state instead
+ * of function statics, and the recent spki/npki peaks are kept in delay_lines.
+ *
+ * @param state Threshold state of the channel.
+ * @param yOut The last three integrated outputs, newest first.
+ * @param thresholdi1 Pointer to the threshold detection value.
+ * @param spki Pointer to the peak value of the signal (QRS complex).
+ * @param npki Pointer to the peak value of the noise.
+ * @param spki_window Recent peak values of the signal.
+ * @param npki_window Recent peak values of the noise.
+ * @return bool True if a QRS complex is detected, false otherwise.
+ */
+bool pan_T_Threshold(pan_T_Threshold_State *state, const float *yOut, float *thresholdi1, float *spki, float *npki, delay_line<8> *spki_window, delay_line<8> *npki_window);
+
+/**
+ * @brief Resets a detector to the power-on state.
+ *
+ * @param det Detector to reset.
+ */
+void pan_T_Detector_Init(pan_T_Detector *det);
+
+/**
+ * @brief Runs one sample through the filter and threshold stages of a detector.
+ *
+ * @param det Detector of the channel.
+ * @param Ain ADC input signal.
+ * @param filtered Optional output for the filtered (band-passed) value, may be NULL.
+ * @return bool True if a QRS complex is detected, false otherwise.
+ */
+bool pan_T_Detector_Process(pan_T_Detector *det, float Ain, float *filtered);
+
+/**
+ * @brief Resets the noise classification of a channel to clean.
+ *
+ * @param state Noise state to reset.
+ */
+void pan_T_Noise_Init(pan_T_Noise_State *state);
+
+/**
+ * @brief Classifies the current sample of a channel as clean or noisy.
+ *
+ * Call once per sample after pan_T_Detector_Process(). Computes the NSR from
+ * the detector's spki/npki, saves the spki/npki windows while the signal is
+ * clean and restores them into the detector on a noisy to clean transition.
+ * All of that only happens on samples that complete a peak; on every other
+ * sample the previous classification is returned.
+ *
+ * @param state Noise state of the channel.
+ * @param det Detector of the channel.
+ * @return bool True if the signal is noisy (cur_noise_state), false otherwise.
+ */
+bool pan_T_Noise_Update(pan_T_Noise_State *state, pan_T_Detector *det);
+
+/**
+ * @brief Resets the beat timing of a channel.
+ *
+ * @param state Beat timing state to reset.
+ */
+void pan_T_Beat_Init(pan_T_Beat_State *state);
+
+/**
+ * @brief Times the R peak of every QRS detection.
+ *
+ * Call once per sample after pan_T_Detector_Process(). A beat is reported
+ * 40 ms after QRS_detected rises, with the R peak estimated from the
+ * band-passed value and corrected for the filter delay.
+ *
+ * @param state Beat timing state of the channel.
+ * @param value Filtered value returned by pan_T_Detector_Process().
+ * @param qrs QRS flag returned by pan_T_Detector_Process().
+ * @param beat Receives the R peak and detection sample of a located beat.
+ * @return bool True if a beat was located on this sample, false otherwise.
+ */
+bool pan_T_Beat_Update(pan_T_Beat_State *state, float value, bool qrs, pan_T_beat *beat);
+
 /**
  * Calculates the running average of an array with a new input value.
  * 
@@ -87,12 +234,27 @@ bool pan_T_Threshold(float *yOut, float *thresholdi1, float *spki, float *npki,
  */
 float array_running_avg(float *input_array, int length, float input);
 
+/**
+ * Adds a new input value to a window and returns the average of the window.
+ *
+ * Same result as array_running_avg() on an 8 element array, but the window is
+ * a delay_line so no elements are moved.
+ *
+ * @param window Window of the last 8 values.
+ * @param input  The new input value to add to the window.
+ * @return       The running average of the updated window.
+ */
+float window_running_avg(delay_line<8> *window, float input);
+
 /**
  * Calculates the standard deviation of an array of floats.
  * 
  * This function takes an array of floats and its length as input,
  * and returns the standard deviation of the values in the array.
  * 
+ * For a sliding window, running_window (running_window.h) keeps the standard
+ * deviation up to date in constant time per value instead.
+ * 
  * @param input_array Pointer to the array of floats.
  * @param length      The number of elements in the array.
  * @return            The standard deviation of the values in the array.
@@ -109,7 +271,7 @@ float std_dev(float *input_array, int length);
  * @param size Size of the array.
  * @return float The average of floats in the array.
  */
-float array_average(float arr[], int size);
+float array_average(const float arr[], int size);
 
 /**
  * @brief Copies the elements of one array to another.
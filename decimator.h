@@ -0,0 +1,80 @@
+/* Polyphase FIR decimator for a higher-rate front end.
+ *
+ * Lets the ADC (or the sender) run at M times the rate the detector runs at:
+ * the input is low-pass filtered and only every M-th output is kept. The
+ * M * K tap prototype filter h is split into M phases of K taps,
+ *
+ *      h_p[k] = h[k*M + p],    y(m) = sum_p sum_k h_p[k] x(m*M - k*M - p)
+ *
+ * and every input goes to the delay line of its phase, which adds its K tap
+ * dot product to the output being built. So each input costs K
+ * multiply-adds, evenly spread over the ticks, instead of the M * K of a full
+ * rate filter or a burst of M * K every M-th tick.
+ *
+ * init() designs h at start-up: a Hamming windowed sinc with its cutoff at
+ * 80 % of the output Nyquist frequency and unity gain at DC. The delay it
+ * adds is (M * K - 1) / 2 input samples.
+ */
+
+#ifndef _decimator
+#define _decimator
+
+#include <math.h>
+#include "delay_line.h"
+
+template <int M, int K = 8>
+struct decimator {
+    float h[M][K];              // Phase p sub-filter, h[p][k] = prototype[k*M + p]
+    delay_line<K> x[M];         // Inputs of each phase, newest first
+    float acc;                  // Output being built
+    int phase;                  // Phase of the next input, M-1 down to 0
+
+    /* Designs the filter and clears the state. */
+    void init() {
+        const int n = M * K;
+        const double pi = 3.14159265358979323846;
+        const double fc = 0.8 * 0.5 / M;   // Cutoff, cycles per input sample
+        double proto[M * K];
+        double sum = 0.0;
+        for (int j = 0; j < n; j++) {
+            double t = j - (n - 1) / 2.0;
+            double sinc = t == 0.0 ? 2.0 * fc : sin(2.0 * pi * fc * t) / (pi * t);
+            proto[j] = sinc * (0.54 - 0.46 * cos(2.0 * pi * j / (n - 1)));
+            sum += proto[j];
+        }
+        for (int p = 0; p < M; p++) {
+            for (int k = 0; k < K; k++) {
+                h[p][k] = (float) (proto[k * M + p] / sum);
+            }
+            x[p].clear();
+        }
+        acc = 0.0f;
+        phase = M - 1;
+    }
+
+    /* Adds an input sample. Returns true, with the output in *out, on every
+     * M-th input.
+     */
+    bool push(float in, float *out) {
+        x[phase].push(in);
+        const float *taps = x[phase].taps();
+        for (int k = 0; k < K; k++) {
+            acc += h[phase][k] * taps[k];
+        }
+        if (phase > 0) {
+            phase--;
+            return false;
+        }
+        *out = acc;
+        acc = 0.0f;
+        phase = M - 1;
+        return true;
+    }
+
+    /* Decimation factor. */
+    static int factor() {
+        return M;
+    }
+};
+
+#endif
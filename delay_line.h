@@ -0,0 +1,69 @@
+/* Fixed length delay line (ring buffer) for the BME463 filters.
+ *
+ * shift_right() moves every element of an array each time a sample is added,
+ * which costs O(n) per sample for every filter stage. A delay_line keeps the
+ * samples in a ring instead, so adding a sample only moves the head index.
+ *
+ * The ring is stored twice back to back ("mirrored"). Every sample is written
+ * to both halves, so the last N samples are always available as one
+ * contiguous array starting at taps(), newest first:
+ *
+ *      taps()[0] = x(nT), taps()[1] = x(nT - T), ... taps()[N-1] = x(nT - (N-1)T)
+ *
+ * That is the same layout shift_right() produces, so the taps can be handed
+ * straight to filter_FIR() and filter_IIR().
+ *
+ * The element type defaults to float; the fixed-point build of the pipeline
+ * (pan_T_pipeline.h) uses delay_line<N, int32_t>.
+ *
+ * A zero filled delay_line (memset or = {}) is a valid, empty delay line.
+ */
+
+#ifndef _delay_line
+#define _delay_line
+
+template <int N, typename T = float>
+struct delay_line {
+    T buf[2 * N];       // Mirrored ring, buf[i] == buf[i + N]
+    int head;           // Index of the newest sample
+
+    /* Empties the delay line. */
+    void clear() {
+        for (int i = 0; i < 2 * N; i++) {
+            buf[i] = 0;
+        }
+        head = 0;
+    }
+
+    /* Adds a new sample, dropping the oldest one. Constant time. */
+    void push(T x) {
+        head = (head == 0) ? N - 1 : head - 1;
+        buf[head] = x;
+        buf[head + N] = x;
+    }
+
+    /* Overwrites the newest sample, e.g. with the output of an IIR filter
+     * that was computed with a zero in the newest position.
+     */
+    void set_newest(T x) {
+        buf[head] = x;
+        buf[head + N] = x;
+    }
+
+    /* Contiguous view of the last N samples, newest first. */
+    const T *taps() const {
+        return buf + head;
+    }
+
+    /* The sample k steps in the past, 0 <= k < N. */
+    T operator[](int k) const {
+        return buf[head + k];
+    }
+
+    /* Number of samples held. */
+    static int length() {
+        return N;
+    }
+};
+
+#endif
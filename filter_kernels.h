@@ -0,0 +1,39 @@
+/* Compile-time sparse filter kernels for the BME463 filters.
+ *
+ * filter_FIR() and filter_IIR() multiply every tap of a coefficient array,
+ * including the zeros. The Pan-Tompkins filters only have a handful of
+ * non-zero, small integer taps, so here the taps are listed as a type:
+ *
+ *      typedef tap<0, 1, tap<6, -2, tap<12, 1> > > lp_taps;
+ *      float sum = lp_taps::dot(x1.taps());    // x[0] - 2*x[6] + x[12]
+ *
+ * and the compiler unrolls the dot product to one multiply-add per non-zero
+ * tap. Taps are summed in the order they are listed, starting from zero,
+ * which is the order filter_FIR()/filter_IIR() use, so a tap list written in
+ * ascending delay order gives bit-identical results to the generic functions.
+ */
+
+#ifndef _filter_kernels
+#define _filter_kernels
+
+/* Terminates a tap list. */
+struct tap_end {
+    template <typename T>
+    static T dot(const T *, T acc) {
+        return acc;
+    }
+};
+
+/* One non-zero tap: Coef * x(nT - Delay*T), followed by the rest of the list.
+ * The sample type T is deduced from x, so the same list serves the float and
+ * the fixed-point (int32_t) pipeline.
+ */
+template <int Delay, int Coef, typename Next = tap_end>
+struct tap {
+    template <typename T>
+    static T dot(const T *x, T acc = T()) {
+        return Next::dot(x, (T) (acc + Coef * x[Delay]));
+    }
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "flight_rec.h"
+#include <string.h>
+
+/**
+ * @brief Clears the recorder and arms it.
+ *
+ * @param r Recorder.
+ * @param format FLIGHT_FLOAT or FLIGHT_Q16, see flight_format().
+ * @param fs Detector sample rate, Hz.
+ * @param trigger_mask Transitions that freeze the ring, 0 to record continuously.
+ * @param post Records from the trigger sample on, 1..FLIGHT_REC_LEN.
+ */
+void flight_rec_init(flight_rec *r, uint32_t format, float fs, uint32_t trigger_mask, uint32_t post){
+    memset(r, 0, sizeof(*r));
+    r->magic = FLIGHT_REC_MAGIC;
+    r->version = FLIGHT_REC_VERSION;
+    r->record_size = sizeof(flight_record);
+    r->len = FLIGHT_REC_LEN;
+    r->format = format;
+    r->fs = fs;
+    r->trigger_mask = trigger_mask;
+    if (post < 1) {
+        post = 1;
+    } else if (post > FLIGHT_REC_LEN) {
+        post = FLIGHT_REC_LEN;
+    }
+    r->post = post;
+    flight_rec_arm(r);
+}
+
+/**
+ * @brief Starts a new recording; the ring is considered empty.
+ *
+ * The sample index keeps counting, so records of successive recordings
+ * stay on the same time axis.
+ */
+void flight_rec_arm(flight_rec *r){
+    r->base = r->count;
+    r->remaining = 0;
+    r->state = FLIGHT_ARMED;
+}
+
+/**
+ * @brief Number of valid records, min(count - base, len).
+ */
+uint32_t flight_rec_size(const flight_rec *r){
+    uint32_t n = r->count - r->base;
+    return n < FLIGHT_REC_LEN ? n : FLIGHT_REC_LEN;
+}
+
+/**
+ * @brief The i-th valid record, oldest first.
+ */
+const flight_record *flight_rec_at(const flight_rec *r, uint32_t i){
+    return &r->ring[(r->count - flight_rec_size(r) + i) % FLIGHT_REC_LEN];
+}
@@ -0,0 +1,192 @@
+/* Flight recorder of the detector state.
+ *
+ * The DAC pins (ADC4 = spki, ADC5) show one internal variable at a time on
+ * the scope, without sample numbers. A flight_rec keeps the last
+ * FLIGHT_REC_LEN samples of the whole detector state in a RAM ring, one
+ * fixed size record per sample:
+ *
+ *      sample  filtered  mwi  threshold  spki  npki  NSR  flags (QRS, noisy)
+ *
+ * Values are stored as the pipeline holds them (float, or the Q16 integers
+ * of pan_T_fixed; format says which), so recording is a handful of stores
+ * and no conversion: cheap enough to stay enabled in production.
+ *
+ * The recorder can freeze around a noise state transition. When the
+ * classification changes in a direction selected by trigger_mask, it
+ * records post samples from the transition on and then freezes the ring, so
+ * it holds FLIGHT_REC_LEN - post samples before the transition sample and
+ * post - 1 after it. Frozen, recording only counts samples until
+ * flight_rec_arm().
+ *
+ * The structure is its own file format: header fields of 32 bit words
+ * followed by the ring, with the same layout on the board and on a little
+ * endian host. Dump it from the debugger (gdb: dump binary value flight.bin
+ * flight) or fwrite() it on the host, and decode with host/flight_decode.
+ *
+ * The FLIGHT_REC macro compiles to nothing unless PAN_T_FLIGHT_REC is
+ * defined:
+ *
+ *      QRS_detected = pan_T_Detector_Process(&det, x, &filtered);
+ *      cur_noise_state = pan_T_Noise_Update(&noise, &det);
+ *      FLIGHT_REC(&flight, &det, &noise, filtered, QRS_detected);
+ */
+
+#ifndef _flight_rec
+#define _flight_rec
+
+#include <stdint.h>
+#include "pan_T_pipeline.h"
+
+// Records in the ring; a power of two. 64 records (2 KiB) on the board,
+// pass -DFLIGHT_REC_LEN=n where RAM allows a longer window.
+#ifndef FLIGHT_REC_LEN
+#define FLIGHT_REC_LEN 64
+#endif
+
+#define FLIGHT_REC_MAGIC 0x43455246u    // "FREC" in a little endian dump
+#define FLIGHT_REC_VERSION 1
+
+// flight_rec.format
+#define FLIGHT_FLOAT 0                  // pan_T_float: values are floats
+#define FLIGHT_Q16 1                    // pan_T_fixed: values are Q16 integers
+
+// flight_record.flags
+#define FLIGHT_QRS 1u
+#define FLIGHT_NOISY 2u
+
+// flight_rec.trigger_mask
+#define FLIGHT_TRIG_NOISY 1u            // Clean to noisy
+#define FLIGHT_TRIG_CLEAN 2u            // Noisy to clean
+
+// flight_rec.state
+#define FLIGHT_ARMED 0                  // Recording, waiting for a trigger
+#define FLIGHT_TRIGGERED 1              // Recording the post-trigger samples
+#define FLIGHT_FROZEN 2                 // Ring holds the samples around the trigger
+
+/* A level of the pipeline in its own number format. */
+typedef union _flight_value {
+    float f;
+    int32_t q;
+} flight_value;
+
+/**
+ * @brief Detector state after one sample.
+ */
+typedef struct _flight_record {
+    uint32_t sample;            // Detector sample index
+    flight_value filtered;      // Band-passed value
+    flight_value mwi;           // Integrated output
+    flight_value threshold;     // thresholdi1
+    flight_value spki;
+    flight_value npki;
+    float nsr;                  // NSR of the last classification (0 in fixed point)
+    uint32_t flags;             // FLIGHT_QRS, FLIGHT_NOISY
+} flight_record;
+
+/**
+ * @brief Ring of the last FLIGHT_REC_LEN flight_records and its trigger.
+ */
+typedef struct _flight_rec {
+    uint32_t magic;             // FLIGHT_REC_MAGIC
+    uint32_t version;           // FLIGHT_REC_VERSION
+    uint32_t record_size;       // sizeof(flight_record)
+    uint32_t len;               // FLIGHT_REC_LEN
+    uint32_t format;            // FLIGHT_FLOAT or FLIGHT_Q16
+    float fs;                   // Detector sample rate, Hz
+    uint32_t trigger_mask;      // FLIGHT_TRIG_NOISY | FLIGHT_TRIG_CLEAN, 0 = never freeze
+    uint32_t post;              // Records from the trigger sample on, 1..len
+    uint32_t state;             // FLIGHT_ARMED, FLIGHT_TRIGGERED or FLIGHT_FROZEN
+    uint32_t sample;            // Index of the next sample
+    uint32_t count;             // Records written; the next goes to ring[count % len]
+    uint32_t base;              // count at the last flight_rec_arm()
+    uint32_t remaining;         // Records until the freeze while triggered
+    uint32_t trigger_sample;    // Sample of the last trigger
+    uint32_t prev_flags;        // flags of the previous record
+    flight_record ring[FLIGHT_REC_LEN];
+} flight_rec;
+
+static inline void flight_put(flight_value *v, float x) { v->f = x; }
+static inline void flight_put(flight_value *v, int32_t x) { v->q = x; }
+
+/* flight_rec.format of a pipeline number format: flight_format(Ops::sample()). */
+static inline uint32_t flight_format(float) { return FLIGHT_FLOAT; }
+static inline uint32_t flight_format(int32_t) { return FLIGHT_Q16; }
+
+/**
+ * @brief Clears the recorder and arms it.
+ *
+ * @param r Recorder.
+ * @param format FLIGHT_FLOAT or FLIGHT_Q16, see flight_format().
+ * @param fs Detector sample rate, Hz.
+ * @param trigger_mask Transitions that freeze the ring, 0 to record continuously.
+ * @param post Records from the trigger sample on, 1..FLIGHT_REC_LEN.
+ */
+void flight_rec_init(flight_rec *r, uint32_t format, float fs, uint32_t trigger_mask, uint32_t post);
+
+/**
+ * @brief Starts a new recording; the ring is considered empty.
+ */
+void flight_rec_arm(flight_rec *r);
+
+/**
+ * @brief Number of valid records, min(count - base, len).
+ */
+uint32_t flight_rec_size(const flight_rec *r);
+
+/**
+ * @brief The i-th valid record, oldest first.
+ */
+const flight_record *flight_rec_at(const flight_rec *r, uint32_t i);
+
+/**
+ * @brief Records the state of a detector after one sample.
+ *
+ * Call once per sample after pan_T_Noise_Update().
+ *
+ * @param r Recorder.
+ * @param det Detector of the channel.
+ * @param noise Noise state of the channel.
+ * @param filtered Filtered value returned by pan_T_Detector_Process().
+ * @param qrs QRS flag returned by pan_T_Detector_Process().
+ */
+template <typename Ops, typename Rate>
+inline void flight_rec_record(flight_rec *r, const pan_T_Detector_T<Ops, Rate> *det,
+                              const pan_T_Noise_T<Ops> *noise, typename Ops::sample filtered, bool qrs) {
+    uint32_t sample = r->sample++;
+    uint32_t flags = (qrs ? FLIGHT_QRS : 0u) | (noise->cur_noise_state ? FLIGHT_NOISY : 0u);
+    uint32_t changed = flags ^ r->prev_flags;
+    r->prev_flags = flags;
+    if (r->state == FLIGHT_FROZEN) {
+        return;
+    }
+    flight_record *e = &r->ring[r->count++ % FLIGHT_REC_LEN];
+    e->sample = sample;
+    flight_put(&e->filtered, filtered);
+    flight_put(&e->mwi, det->filter.mwi[0]);
+    flight_put(&e->threshold, det->thresholdi1);
+    flight_put(&e->spki, det->spki);
+    flight_put(&e->npki, det->npki);
+    e->nsr = noise->NSR;
+    e->flags = flags;
+
+    if (r->state == FLIGHT_TRIGGERED) {
+        if (--r->remaining == 0) {
+            r->state = FLIGHT_FROZEN;
+        }
+    } else if (changed & FLIGHT_NOISY) {
+        uint32_t edge = (flags & FLIGHT_NOISY) ? FLIGHT_TRIG_NOISY : FLIGHT_TRIG_CLEAN;
+        if (r->trigger_mask & edge) {
+            r->trigger_sample = sample;
+            r->remaining = r->post - 1;
+            r->state = r->remaining == 0 ? FLIGHT_FROZEN : FLIGHT_TRIGGERED;
+        }
+    }
+}
+
+#ifdef PAN_T_FLIGHT_REC
+#define FLIGHT_REC(r, det, noise, filtered, qrs)    flight_rec_record((r), (det), (noise), (filtered), (qrs))
+#else
+#define FLIGHT_REC(r, det, noise, filtered, qrs)    ((void) 0)
+#endif
+
+#endif
@@ -0,0 +1,245 @@
+/* Batch evaluation over a record corpus - host only
+ *
+ * Runs the full receiver pipeline of main.cpp (pan_T_Detector_Process() and
+ * pan_T_Noise_Update() on every sample) over every record of a corpus on a
+ * work-stealing thread pool, one task per record and signal, and reports per
+ * record and aggregate noise classification rates (TPR/FNR/FPR/TNR, see the
+ * README's Testing Metrics) and QRS sensitivity / positive predictivity
+ * against the .atr beat annotations.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -pthread -I. host/batch_eval.cpp host/wfdb.cpp BME463_lib.cpp -o batch_eval
+ *
+ * Usage:
+ *   ./batch_eval [options] <record directory or record path>...
+ *
+ *   -j <threads>   Worker threads, default: all cores
+ *   -s <signal>    Signal to evaluate, or "all" (default 0)
+ *   -l <seconds>   Clean lead-in of the noise schedule, default 300
+ *   -g <seconds>   Noisy/clean segment length of the schedule, default 120
+ *   -a <ext>       Beat annotation file extension, default atr ("" to skip)
+ *   -w <pre,post>  Beat matching window in ms around the annotation, default 100,350
+ *   -o <file.csv>  Also write the per record results as CSV
+ */
+
+#include "BME463_lib.h"
+#include "nst_metrics.h"
+#include "wfdb.h"
+#include "work_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct eval_task {
+    std::string record;
+    int signal;
+    // Results
+    bool ok;
+    std::string name;
+    long samples;
+    float fs;
+    nst_confusion noise;
+    bool have_beats;
+    nst_beats beats;
+};
+
+struct eval_options {
+    double clean_lead_s;
+    double segment_s;
+    std::string annotator;
+    double pre_ms;
+    double post_ms;
+};
+
+static void evaluate(eval_task *task, const eval_options *opt) {
+    wfdb_record rec;
+    wfdb_stream stream;
+    task->ok = false;
+    if (!wfdb_open(&rec, task->record.c_str()) || !wfdb_stream_open(&stream, &rec, task->signal)) {
+        return;
+    }
+    task->name = rec.name;
+    task->fs = rec.fs;
+    nst_schedule schedule = {opt->clean_lead_s, opt->segment_s, rec.fs};
+    memset(&task->noise, 0, sizeof(task->noise));
+
+    pan_T_Detector det;
+    pan_T_Noise_State noise;
+    pan_T_Detector_Init(&det);
+    pan_T_Noise_Init(&noise);
+
+    std::vector<long> onsets;
+    int raw[4096];
+    long n = 0;
+    long got;
+    bool prev_qrs = false;
+    while ((got = wfdb_stream_read(&stream, raw, 4096)) > 0) {
+        for (long i = 0; i < got; i++, n++) {
+            bool qrs = pan_T_Detector_Process(&det, wfdb_to_input(raw[i]), NULL);
+            bool noisy = pan_T_Noise_Update(&noise, &det);
+            nst_confusion_add(&task->noise, nst_noisy(&schedule, n), noisy);
+            if (qrs && !prev_qrs) {
+                onsets.push_back(n);
+            }
+            prev_qrs = qrs;
+        }
+    }
+    wfdb_stream_close(&stream);
+    task->samples = n;
+
+    task->have_beats = false;
+    if (!opt->annotator.empty()) {
+        wfdb_annotation *ann;
+        long count = wfdb_read_annotations(task->record.c_str(), opt->annotator.c_str(), &ann);
+        if (count >= 0) {
+            std::vector<long> beats;
+            for (long i = 0; i < count; i++) {
+                if (wfdb_is_beat(ann[i].code) && ann[i].sample < n) {
+                    beats.push_back(ann[i].sample);
+                }
+            }
+            free(ann);
+            long pre = (long) (opt->pre_ms * rec.fs / 1000.0);
+            long post = (long) (opt->post_ms * rec.fs / 1000.0);
+            task->beats = nst_match_beats(beats.data(), (long) beats.size(), onsets.data(), (long) onsets.size(), pre, post, NULL);
+            task->have_beats = true;
+        }
+    }
+    task->ok = true;
+}
+
+static void print_row(FILE *f, const char *fmt_name, const char *name, int signal, double seconds,
+                      const nst_confusion *c, bool have_beats, const nst_beats *b) {
+    fprintf(f, fmt_name, name);
+    if (signal >= 0) {
+        fprintf(f, " %3d", signal);
+    } else {
+        fprintf(f, "   -");
+    }
+    fprintf(f, " %8.1f  %6.3f %6.3f %6.3f %6.3f", seconds / 60.0, nst_tpr(c), nst_fnr(c), nst_fpr(c), nst_tnr(c));
+    if (have_beats) {
+        fprintf(f, "  %7ld %6.4f %6.4f\n", b->tp + b->fn, nst_sensitivity(b), nst_ppv(b));
+    } else {
+        fprintf(f, "        -      -      -\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    eval_options opt = {300.0, 120.0, "atr", 100.0, 350.0};
+    unsigned threads = 0;
+    int signal = 0;
+    bool all_signals = false;
+    const char *csv_path = NULL;
+    std::vector<std::string> records;
+
+    for (int a = 1; a < argc; a++) {
+        if (argv[a][0] == '-' && argv[a][1] != '\0' && argv[a][2] == '\0' && a + 1 < argc) {
+            const char *v = argv[++a];
+            switch (argv[a - 1][1]) {
+            case 'j': threads = (unsigned) atoi(v); break;
+            case 's': all_signals = strcmp(v, "all") == 0; signal = atoi(v); break;
+            case 'l': opt.clean_lead_s = atof(v); break;
+            case 'g': opt.segment_s = atof(v); break;
+            case 'a': opt.annotator = v; break;
+            case 'w': nst_parse_window(v, &opt.pre_ms, &opt.post_ms); break;
+            case 'o': csv_path = v; break;
+            default:
+                fprintf(stderr, "unknown option %s\n", argv[a - 1]);
+                return 1;
+            }
+        } else {
+            nst_collect_records(argv[a], &records);
+        }
+    }
+    if (records.empty()) {
+        fprintf(stderr, "usage: %s [-j threads] [-s signal|all] [-l lead_s] [-g segment_s] [-a ext] [-w pre,post] [-o out.csv] <records>...\n", argv[0]);
+        return 1;
+    }
+
+    // One task per record and signal.
+    std::vector<eval_task> tasks;
+    for (size_t r = 0; r < records.size(); r++) {
+        int first = signal, last = signal;
+        if (all_signals) {
+            wfdb_record rec;
+            if (!wfdb_open(&rec, records[r].c_str())) {
+                continue;
+            }
+            first = 0;
+            last = rec.nsig - 1;
+        }
+        for (int s = first; s <= last; s++) {
+            eval_task t;
+            t.record = records[r];
+            t.signal = s;
+            t.ok = false;
+            tasks.push_back(t);
+        }
+    }
+
+    work_pool pool(threads);
+    for (size_t i = 0; i < tasks.size(); i++) {
+        eval_task *t = &tasks[i];
+        pool.add([t, &opt] { evaluate(t, &opt); });
+    }
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    pool.run();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    FILE *csv = NULL;
+    if (csv_path != NULL) {
+        csv = fopen(csv_path, "w");
+        if (csv == NULL) {
+            fprintf(stderr, "cannot write %s\n", csv_path);
+            return 1;
+        }
+        fprintf(csv, "record,signal,samples,tp,fn,fp,tn,tpr,fnr,fpr,tnr,beats,beat_tp,beat_fn,beat_fp,sensitivity,ppv\n");
+    }
+
+    printf("%-16s sig  minutes     TPR    FNR    FPR    TNR    beats     Se     +P\n", "record");
+    nst_confusion total = {0, 0, 0, 0};
+    nst_beats total_beats = {0, 0, 0};
+    bool any_beats = false;
+    long total_samples = 0;
+    double total_seconds = 0.0;
+    int failed = 0;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        const eval_task *t = &tasks[i];
+        if (!t->ok) {
+            failed++;
+            continue;
+        }
+        print_row(stdout, "%-16s", t->name.c_str(), t->signal, t->samples / (double) t->fs, &t->noise, t->have_beats, &t->beats);
+        nst_confusion_merge(&total, &t->noise);
+        total_samples += t->samples;
+        total_seconds += t->samples / (double) t->fs;
+        if (t->have_beats) {
+            total_beats.tp += t->beats.tp;
+            total_beats.fn += t->beats.fn;
+            total_beats.fp += t->beats.fp;
+            any_beats = true;
+        }
+        if (csv != NULL) {
+            fprintf(csv, "%s,%d,%ld,%ld,%ld,%ld,%ld,%.6f,%.6f,%.6f,%.6f", t->name.c_str(), t->signal, t->samples,
+                    t->noise.tp, t->noise.fn, t->noise.fp, t->noise.tn,
+                    nst_tpr(&t->noise), nst_fnr(&t->noise), nst_fpr(&t->noise), nst_tnr(&t->noise));
+            if (t->have_beats) {
+                fprintf(csv, ",%ld,%ld,%ld,%ld,%.6f,%.6f\n", t->beats.tp + t->beats.fn, t->beats.tp, t->beats.fn,
+                        t->beats.fp, nst_sensitivity(&t->beats), nst_ppv(&t->beats));
+            } else {
+                fprintf(csv, ",,,,,,\n");
+            }
+        }
+    }
+    if (csv != NULL) {
+        fclose(csv);
+    }
+    print_row(stdout, "%-16s", "TOTAL", -1, total_seconds, &total, any_beats, &total_beats);
+    printf("%zu tasks on %u threads in %.2f s (%.1f Msamples/s)%s\n", tasks.size(), pool.threads(), elapsed,
+           elapsed > 0 ? total_samples / elapsed / 1e6 : 0.0, failed ? ", some records failed" : "");
+    return failed ? 2 : 0;
+}
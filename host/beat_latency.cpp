@@ -0,0 +1,254 @@
+/* QRS detection latency and beat timing benchmark - host only
+ *
+ * Runs the main.cpp pipeline (pan_T_Detector_Process(), pan_T_Noise_Update()
+ * and pan_T_Beat_Update()) over records and compares every detection with
+ * the annotated beat it matches (same window as batch_eval, -w):
+ *
+ *   detect   rising edge of QRS_detected - annotation: how late the flag is
+ *   report   sample pan_T_Beat_Update() reports the beat on - annotation:
+ *            the end-to-end latency a consumer of beat events sees
+ *   raw      the same edge used as the beat time: its error around its mean
+ *            (sd) is the jitter a flag-based timestamp carries
+ *   R        pan_T_beat.r_sample - annotation: error of the compensated R
+ *            peak estimate
+ *
+ * Times are in ms. The totals are given for all beats and for the beats in
+ * the clean segments of the noise stress test schedule (-l, -g).
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -I. host/beat_latency.cpp host/wfdb.cpp BME463_lib.cpp -o beat_latency
+ *
+ * Usage:
+ *   ./beat_latency [-s signal] [-l lead_s] [-g segment_s] [-a ext] [-w pre,post] [-o beats.csv] <records>...
+ *
+ *   records   := record paths without extension, or directories of records
+ *   beats.csv := optional per-beat dump: record,annotation,detect,report,r_estimate,noisy (samples)
+ */
+
+#include "BME463_lib.h"
+#include "nst_metrics.h"
+#include "wfdb.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct latency_options {
+    int signal;
+    double clean_lead_s;
+    double segment_s;
+    std::string annotator;
+    double pre_ms;
+    double post_ms;
+};
+
+/* Errors of the matched beats, in ms. */
+struct latency_set {
+    std::vector<double> detect;
+    std::vector<double> report;
+    std::vector<double> r;
+    nst_beats beats;
+
+    latency_set() {
+        memset(&beats, 0, sizeof(beats));
+    }
+
+    void add(const latency_set &o) {
+        detect.insert(detect.end(), o.detect.begin(), o.detect.end());
+        report.insert(report.end(), o.report.begin(), o.report.end());
+        r.insert(r.end(), o.r.begin(), o.r.end());
+        beats.tp += o.beats.tp;
+        beats.fn += o.beats.fn;
+        beats.fp += o.beats.fp;
+    }
+};
+
+static double mean(const std::vector<double> &v) {
+    double sum = 0;
+    for (size_t i = 0; i < v.size(); i++) {
+        sum += v[i];
+    }
+    return v.empty() ? 0.0 : sum / v.size();
+}
+
+static double stddev(const std::vector<double> &v) {
+    double m = mean(v), sum = 0;
+    for (size_t i = 0; i < v.size(); i++) {
+        sum += (v[i] - m) * (v[i] - m);
+    }
+    return v.size() > 1 ? sqrt(sum / (v.size() - 1)) : 0.0;
+}
+
+/* p-th percentile of v, or of |v| with magnitude. */
+static double percentile(std::vector<double> v, double p, bool magnitude) {
+    if (v.empty()) {
+        return 0.0;
+    }
+    for (size_t i = 0; magnitude && i < v.size(); i++) {
+        v[i] = fabs(v[i]);
+    }
+    std::sort(v.begin(), v.end());
+    size_t k = (size_t) (p / 100.0 * (v.size() - 1) + 0.5);
+    return v[k];
+}
+
+static void print_row(const char *name, const latency_set &s) {
+    printf("%-12s %6ld %6.4f %6.4f  %5.0f %5.0f  %5.0f %5.0f  %5.1f  %5.1f %5.1f %5.1f %5.1f\n", name,
+           s.beats.tp + s.beats.fn, nst_sensitivity(&s.beats), nst_ppv(&s.beats), mean(s.detect),
+           percentile(s.detect, 95, false), mean(s.report), percentile(s.report, 95, false), stddev(s.detect),
+           mean(s.r), stddev(s.r), percentile(s.r, 50, true), percentile(s.r, 95, true));
+}
+
+/* Runs one record; returns false if it cannot be read or has no annotations. */
+static bool measure(const std::string &path, const latency_options *opt, latency_set *all, latency_set *clean,
+                    FILE *csv) {
+    wfdb_record rec;
+    wfdb_stream stream;
+    if (!wfdb_open(&rec, path.c_str()) || !wfdb_stream_open(&stream, &rec, opt->signal)) {
+        return false;
+    }
+    pan_T_Detector det;
+    pan_T_Noise_State noise;
+    pan_T_Beat_State timer;
+    pan_T_Detector_Init(&det);
+    pan_T_Noise_Init(&noise);
+    pan_T_Beat_Init(&timer);
+
+    std::vector<long> detect, report, r_estimate;
+    int raw[4096];
+    long n = 0;
+    long got;
+    while ((got = wfdb_stream_read(&stream, raw, 4096)) > 0) {
+        for (long i = 0; i < got; i++, n++) {
+            float filtered;
+            bool qrs = pan_T_Detector_Process(&det, wfdb_to_input(raw[i]), &filtered);
+            pan_T_Noise_Update(&noise, &det);
+            pan_T_beat beat;
+            if (pan_T_Beat_Update(&timer, filtered, qrs, &beat)) {
+                detect.push_back(beat.detect_sample);
+                report.push_back(n);
+                r_estimate.push_back(beat.r_sample);
+            }
+        }
+    }
+    wfdb_stream_close(&stream);
+
+    wfdb_annotation *ann;
+    long count = wfdb_read_annotations(path.c_str(), opt->annotator.c_str(), &ann);
+    if (count < 0) {
+        return false;
+    }
+    std::vector<long> beats;
+    for (long i = 0; i < count; i++) {
+        if (wfdb_is_beat(ann[i].code) && ann[i].sample < n) {
+            beats.push_back(ann[i].sample);
+        }
+    }
+    free(ann);
+
+    long pre = (long) (opt->pre_ms * rec.fs / 1000.0);
+    long post = (long) (opt->post_ms * rec.fs / 1000.0);
+    std::vector<long> matched(beats.size());
+    nst_beats scores = nst_match_beats(beats.data(), (long) beats.size(), detect.data(), (long) detect.size(), pre,
+                                       post, matched.data());
+    nst_schedule schedule = {opt->clean_lead_s, opt->segment_s, rec.fs};
+    double ms = 1000.0 / rec.fs;
+    latency_set set, clean_set;
+    set.beats = scores;
+    for (size_t b = 0; b < beats.size(); b++) {
+        bool noisy = nst_noisy(&schedule, beats[b]);
+        latency_set *targets[2] = {&set, noisy ? NULL : &clean_set};
+        long d = matched[b];
+        if (!noisy) {
+            if (d >= 0) clean_set.beats.tp++; else clean_set.beats.fn++;
+        }
+        if (d < 0) {
+            continue;
+        }
+        for (int k = 0; k < 2; k++) {
+            if (targets[k] != NULL) {
+                targets[k]->detect.push_back((detect[d] - beats[b]) * ms);
+                targets[k]->report.push_back((report[d] - beats[b]) * ms);
+                targets[k]->r.push_back((r_estimate[d] - beats[b]) * ms);
+            }
+        }
+        if (csv != NULL) {
+            fprintf(csv, "%s,%ld,%ld,%ld,%ld,%d\n", rec.name, beats[b], detect[d], report[d], r_estimate[d], noisy);
+        }
+    }
+    // Unmatched detections in the clean segments
+    std::vector<bool> used(detect.size(), false);
+    for (size_t b = 0; b < beats.size(); b++) {
+        if (matched[b] >= 0) {
+            used[matched[b]] = true;
+        }
+    }
+    for (size_t d = 0; d < detect.size(); d++) {
+        if (!used[d] && !nst_noisy(&schedule, detect[d])) {
+            clean_set.beats.fp++;
+        }
+    }
+
+    print_row(rec.name, set);
+    all->add(set);
+    clean->add(clean_set);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    latency_options opt = {0, 300.0, 120.0, "atr", 100.0, 350.0};
+    const char *csv_path = NULL;
+    std::vector<std::string> records;
+    bool usage = false;
+    for (int a = 1; a < argc && !usage; a++) {
+        if (argv[a][0] == '-' && argv[a][1] != '\0' && argv[a][2] == '\0' && a + 1 < argc) {
+            const char *v = argv[++a];
+            switch (argv[a - 1][1]) {
+            case 's': opt.signal = atoi(v); break;
+            case 'l': opt.clean_lead_s = atof(v); break;
+            case 'g': opt.segment_s = atof(v); break;
+            case 'a': opt.annotator = v; break;
+            case 'w': nst_parse_window(v, &opt.pre_ms, &opt.post_ms); break;
+            case 'o': csv_path = v; break;
+            default: usage = true; break;
+            }
+        } else {
+            nst_collect_records(argv[a], &records);
+        }
+    }
+    if (usage || records.empty()) {
+        fprintf(stderr, "usage: %s [-s signal] [-l lead_s] [-g segment_s] [-a ext] [-w pre,post] [-o beats.csv] "
+                        "<records>...\n", argv[0]);
+        return 1;
+    }
+    FILE *csv = NULL;
+    if (csv_path != NULL) {
+        csv = fopen(csv_path, "w");
+        if (csv == NULL) {
+            fprintf(stderr, "cannot write %s\n", csv_path);
+            return 1;
+        }
+        fprintf(csv, "record,annotation,detect,report,r_estimate,noisy\n");
+    }
+
+    printf("%-12s %6s %6s %6s  %11s  %11s  %5s  %23s\n", "", "", "", "", "detect ms", "report ms", "raw", "R error ms");
+    printf("%-12s %6s %6s %6s  %5s %5s  %5s %5s  %5s  %5s %5s %5s %5s\n", "record", "beats", "Se", "+P", "mean",
+           "p95", "mean", "p95", "sd", "mean", "sd", "|p50|", "|p95|");
+    latency_set all, clean;
+    for (size_t r = 0; r < records.size(); r++) {
+        if (!measure(records[r], &opt, &all, &clean, csv)) {
+            fprintf(stderr, "%s: skipped\n", records[r].c_str());
+        }
+    }
+    if (csv != NULL) {
+        fclose(csv);
+    }
+    print_row("TOTAL", all);
+    print_row("TOTAL clean", clean);
+    printf("worst R error %.1f ms, worst report latency %.1f ms\n", percentile(all.r, 100, true),
+           percentile(all.report, 100, false));
+    return 0;
+}
@@ -0,0 +1,330 @@
+/* Microbenchmarks of the BME463_lib hot path - host only
+ *
+ * Times every per-sample function of the library and the end-to-end loop of
+ * main.cpp (filter + threshold + noise classification) on fixed inputs: a
+ * synthetic ECG with the noise stress test schedule and, optionally, one
+ * signal of a WFDB record. Each benchmark is repeated and the fastest run is
+ * reported in ns/sample and, on x86, TSC cycles/sample (reference cycles at
+ * the TSC rate, not core cycles).
+ *
+ * Results are also written as CSV so runs from two commits can be compared,
+ * either with any diff tool or with -b, which prints the change against an
+ * earlier results file.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -I. host/bench_lib.cpp host/wfdb.cpp BME463_lib.cpp pan_T_multi.cpp -o bench_lib
+ *
+ * Usage:
+ *   ./bench_lib [-r record] [-s signal] [-n samples] [-k repeats] [-o results.csv] [-b baseline.csv]
+ */
+
+#include "BME463_lib.h"
+#include "pan_T_multi.h"
+#include "synth_ecg.h"
+#include "wfdb.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+static volatile float sink;
+
+struct bench_result {
+    std::string name;
+    std::string input;
+    long samples;
+    double ns;
+    double cycles;      // < 0 if not available
+};
+
+/* Runs fn(in, n) repeats times and keeps the fastest run. */
+template <typename Fn>
+static bench_result run(const char *name, const char *input, const std::vector<float> &in, int repeats, Fn fn) {
+    bench_result r;
+    r.name = name;
+    r.input = input;
+    r.samples = (long) in.size();
+    r.ns = 1e30;
+    r.cycles = -1.0;
+    fn(in.data(), (long) in.size());    // Warm up caches and branch predictors
+    for (int k = 0; k < repeats; k++) {
+#ifdef HAVE_TSC
+        unsigned long long c0 = __rdtsc();
+#endif
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        fn(in.data(), (long) in.size());
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+#ifdef HAVE_TSC
+        double cycles = (double) (__rdtsc() - c0);
+#endif
+        if (ns < r.ns * r.samples) {
+            r.ns = ns / r.samples;
+#ifdef HAVE_TSC
+            r.cycles = cycles / r.samples;
+#endif
+        }
+    }
+    return r;
+}
+
+/* Coefficients of the Pan-Tompkins stages, as in BME463_lib.cpp. */
+static const float lp_a[13] = {1, 0, 0, 0, 0, 0, -2, 0, 0, 0, 0, 0, 1};
+static const float lp_b[3] = {1, -2, 1};
+static float mwi_a[32];
+
+static void bench_input(const char *input, const std::vector<float> &in, int repeats, std::vector<bench_result> *out) {
+    // Primitive functions, fed sliding windows of the input.
+    std::vector<float> scratch(64, 0.0f);
+    out->push_back(run("shift_right(34)", input, in, repeats, [&](const float *x, long n) {
+        for (long i = 0; i < n; i++) {
+            shift_right(scratch.data(), 34);
+            scratch[0] = x[i];
+        }
+        sink = scratch[33];
+    }));
+    out->push_back(run("filter_IIR(13,3)", input, in, repeats, [&](const float *x, long n) {
+        float y[3] = {0, 0, 0};
+        for (long i = 13; i < n; i++) {
+            y[0] = filter_IIR(1.0f, x + i - 13, lp_a, 13, y, lp_b, 3);
+        }
+        sink = y[0];
+    }));
+    out->push_back(run("filter_FIR(32)", input, in, repeats, [&](const float *x, long n) {
+        float acc = 0.0f;
+        for (long i = 32; i < n; i++) {
+            acc += filter_FIR(0.03125f, x + i - 32, mwi_a, 32);
+        }
+        sink = acc;
+    }));
+    out->push_back(run("array_running_avg(8)", input, in, repeats, [&](const float *x, long n) {
+        float window[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        float acc = 0.0f;
+        for (long i = 0; i < n; i++) {
+            acc += array_running_avg(window, 8, x[i]);
+        }
+        sink = acc;
+    }));
+    out->push_back(run("window_running_avg(8)", input, in, repeats, [&](const float *x, long n) {
+        delay_line<8> window;
+        window.clear();
+        float acc = 0.0f;
+        for (long i = 0; i < n; i++) {
+            acc += window_running_avg(&window, x[i]);
+        }
+        sink = acc;
+    }));
+    out->push_back(run("running_window(8).mean", input, in, repeats, [&](const float *x, long n) {
+        running_window<8> window;
+        window.clear();
+        float acc = 0.0f;
+        for (long i = 0; i < n; i++) {
+            window.push(x[i]);
+            acc += window.mean();
+        }
+        sink = acc;
+    }));
+    out->push_back(run("std_dev(8)", input, in, repeats, [&](const float *x, long n) {
+        float acc = 0.0f;
+        for (long i = 8; i < n; i++) {
+            acc += std_dev((float *) x + i - 8, 8);
+        }
+        sink = acc;
+    }));
+    out->push_back(run("running_window(8).stddev", input, in, repeats, [&](const float *x, long n) {
+        running_window<8> window;
+        window.clear();
+        float acc = 0.0f;
+        for (long i = 0; i < n; i++) {
+            window.push(x[i]);
+            acc += window.stddev();
+        }
+        sink = acc;
+    }));
+
+    // Filter stage variants.
+    out->push_back(run("pan_T_Filter(legacy)", input, in, repeats, [&](const float *x, long n) {
+        float yOut[3] = {0, 0, 0};
+        float acc = 0.0f;
+        for (long i = 0; i < n; i++) {
+            acc += pan_T_Filter(x[i], yOut);
+        }
+        sink = acc + yOut[0];
+    }));
+    out->push_back(run("pan_T_Filter_Generic", input, in, repeats, [&](const float *x, long n) {
+        pan_T_Filter_State state;
+        pan_T_Filter_Init(&state);
+        float acc = 0.0f;
+        for (long i = 0; i < n; i++) {
+            acc += pan_T_Filter_Generic(&state, x[i]);
+        }
+        sink = acc;
+    }));
+    out->push_back(run("pan_T_Filter", input, in, repeats, [&](const float *x, long n) {
+        pan_T_Filter_State state;
+        pan_T_Filter_Init(&state);
+        float acc = 0.0f;
+        for (long i = 0; i < n; i++) {
+            acc += pan_T_Filter(&state, x[i]);
+        }
+        sink = acc;
+    }));
+    std::vector<float> value(in.size()), mwi(in.size());
+    out->push_back(run("pan_T_Filter_Block", input, in, repeats, [&](const float *x, long n) {
+        pan_T_Filter_State state;
+        pan_T_Filter_Init(&state);
+        pan_T_Filter_Block(&state, x, (int) n, value.data(), mwi.data());
+        sink = mwi[n - 1];
+    }));
+
+    // Threshold and end-to-end loops.
+    out->push_back(run("pan_T_Detector_Process", input, in, repeats, [&](const float *x, long n) {
+        pan_T_Detector det;
+        pan_T_Detector_Init(&det);
+        long beats = 0;
+        for (long i = 0; i < n; i++) {
+            beats += pan_T_Detector_Process(&det, x[i], NULL);
+        }
+        sink = (float) beats;
+    }));
+    out->push_back(run("main loop (detector+noise)", input, in, repeats, [&](const float *x, long n) {
+        pan_T_Detector det;
+        pan_T_Noise_State noise;
+        pan_T_Detector_Init(&det);
+        pan_T_Noise_Init(&noise);
+        long flags = 0;
+        for (long i = 0; i < n; i++) {
+            flags += pan_T_Detector_Process(&det, x[i], NULL);
+            flags += pan_T_Noise_Update(&noise, &det);
+        }
+        sink = (float) flags;
+    }));
+    out->push_back(run("pan_T_Multi (per channel)", input, in, repeats, [&](const float *x, long n) {
+        // Every lane gets the same input shifted by a few samples.
+        pan_T_Multi group;
+        pan_T_Multi_Init(&group);
+        float lanes[PAN_T_MULTI_LANES];
+        long beats = 0;
+        long i;
+        for (i = 0; i + PAN_T_MULTI_LANES <= n; i++) {
+            for (int l = 0; l < PAN_T_MULTI_LANES; l++) {
+                lanes[l] = x[i + l];
+            }
+            beats += pan_T_Multi_Process(&group, lanes, NULL);
+        }
+        sink = (float) beats;
+    }));
+    // The multi-channel run processed 8 channel-samples per step.
+    out->back().ns /= PAN_T_MULTI_LANES;
+    if (out->back().cycles > 0) {
+        out->back().cycles /= PAN_T_MULTI_LANES;
+    }
+}
+
+static std::map<std::string, double> read_baseline(const char *path) {
+    std::map<std::string, double> base;
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return base;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        // name,input,samples,ns_per_sample,cycles_per_sample
+        char *name = strtok(line, ",");
+        char *input = strtok(NULL, ",");
+        strtok(NULL, ",");
+        char *ns = strtok(NULL, ",");
+        if (name && input && ns && strcmp(name, "name") != 0) {
+            base[std::string(name) + "|" + input] = atof(ns);
+        }
+    }
+    fclose(f);
+    return base;
+}
+
+int main(int argc, char **argv) {
+    const char *record = NULL;
+    const char *csv_path = "bench_results.csv";
+    const char *baseline = NULL;
+    int signal = 0;
+    long samples = 360L * 600;
+    int repeats = 5;
+    for (int a = 1; a + 1 < argc; a += 2) {
+        switch (argv[a][1]) {
+        case 'r': record = argv[a + 1]; break;
+        case 's': signal = atoi(argv[a + 1]); break;
+        case 'n': samples = atol(argv[a + 1]); break;
+        case 'k': repeats = atoi(argv[a + 1]); break;
+        case 'o': csv_path = argv[a + 1]; break;
+        case 'b': baseline = argv[a + 1]; break;
+        default:
+            fprintf(stderr, "usage: %s [-r record] [-s signal] [-n samples] [-k repeats] [-o results.csv] [-b baseline.csv]\n", argv[0]);
+            return 1;
+        }
+    }
+    for (int i = 0; i < 32; i++) {
+        mwi_a[i] = i < 30 ? 1.0f : 0.0f;
+    }
+
+    std::vector<bench_result> results;
+    std::vector<float> in(samples);
+    synth_ecg gen;
+    synth_ecg_init(&gen, 0, 1500.0f);
+    gen.clean_lead_s = 60.0f;   // Get noisy segments into a short input
+    gen.segment_s = 60.0f;
+    for (long i = 0; i < samples; i++) {
+        in[i] = synth_ecg_next(&gen) / 2048.0f;
+    }
+    bench_input("synthetic", in, repeats, &results);
+
+    if (record != NULL) {
+        wfdb_record rec;
+        wfdb_stream stream;
+        if (!wfdb_open(&rec, record) || !wfdb_stream_open(&stream, &rec, signal)) {
+            return 1;
+        }
+        std::vector<int> raw(samples);
+        long got = wfdb_stream_read(&stream, raw.data(), samples);
+        wfdb_stream_close(&stream);
+        in.resize(got);
+        for (long i = 0; i < got; i++) {
+            in[i] = wfdb_to_input(raw[i]);
+        }
+        bench_input(rec.name, in, repeats, &results);
+    }
+
+    std::map<std::string, double> base;
+    if (baseline != NULL) {
+        base = read_baseline(baseline);
+    }
+    FILE *csv = fopen(csv_path, "w");
+    if (csv == NULL) {
+        fprintf(stderr, "cannot write %s\n", csv_path);
+        return 1;
+    }
+    fprintf(csv, "name,input,samples,ns_per_sample,cycles_per_sample\n");
+    printf("%-28s %-12s %10s %12s %10s\n", "benchmark", "input", "ns/sample", "cycles/sample", baseline ? "change" : "");
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result &r = results[i];
+        fprintf(csv, "%s,%s,%ld,%.3f,%.2f\n", r.name.c_str(), r.input.c_str(), r.samples, r.ns, r.cycles);
+        printf("%-28s %-12s %10.2f %12.1f", r.name.c_str(), r.input.c_str(), r.ns, r.cycles);
+        std::map<std::string, double>::const_iterator b = base.find(r.name + "|" + r.input);
+        if (b != base.end() && b->second > 0) {
+            printf(" %+9.1f%%", (r.ns / b->second - 1.0) * 100.0);
+        }
+        printf("\n");
+    }
+    fclose(csv);
+    printf("state size: running_window<8> %d bytes, pan_T_Detector %d bytes, pan_T_Noise_State %d bytes\n",
+           running_window<8>::footprint(), (int) sizeof(pan_T_Detector), (int) sizeof(pan_T_Noise_State));
+    printf("results written to %s\n", csv_path);
+    return 0;
+}
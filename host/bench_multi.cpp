@@ -0,0 +1,89 @@
+/* Multi-channel throughput comparison - host only
+ *
+ * Feeds the same synthetic ECG channels through one scalar pan_T_Detector per
+ * channel and through pan_T_Multi lane groups, reports the throughput of both
+ * in channel-samples per second and checks that every lane reports the same
+ * QRS detections as its scalar detector.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -march=native -I. host/bench_multi.cpp BME463_lib.cpp pan_T_multi.cpp -o bench_multi
+ *
+ * Usage:
+ *   ./bench_multi [channels] [seconds]     (defaults: 256 channels, 60 s at 360 Hz)
+ */
+
+#include "BME463_lib.h"
+#include "pan_T_multi.h"
+#include "synth_ecg.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+int main(int argc, char **argv) {
+    int channels = argc > 1 ? atoi(argv[1]) : 256;
+    double seconds = argc > 2 ? atof(argv[2]) : 60.0;
+    long samples = (long) (seconds * 360.0);
+    if (channels <= 0 || samples <= 0) {
+        fprintf(stderr, "usage: %s [channels] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    // Frame-major input: all channels of sample 0, then sample 1, ...
+    std::vector<float> in((size_t) channels * samples);
+    for (int c = 0; c < channels; c++) {
+        synth_ecg gen;
+        synth_ecg_init(&gen, c, 1500.0f);
+        for (long n = 0; n < samples; n++) {
+            in[(size_t) n * channels + c] = synth_ecg_next(&gen) / 2048.0f;
+        }
+    }
+
+    typedef std::chrono::steady_clock clock;
+    std::vector<pan_T_Detector> det(channels);
+    std::vector<unsigned char> scalar_qrs((size_t) channels * samples);
+    for (int c = 0; c < channels; c++) {
+        pan_T_Detector_Init(&det[c]);
+    }
+    clock::time_point t0 = clock::now();
+    for (long n = 0; n < samples; n++) {
+        const float *frame = &in[(size_t) n * channels];
+        for (int c = 0; c < channels; c++) {
+            scalar_qrs[(size_t) n * channels + c] = pan_T_Detector_Process(&det[c], frame[c], NULL);
+        }
+    }
+    double scalar_s = std::chrono::duration<double>(clock::now() - t0).count();
+
+    int groups = (channels + PAN_T_MULTI_LANES - 1) / PAN_T_MULTI_LANES;
+    std::vector<pan_T_Multi> multi(groups);
+    bool *qrs = new bool[channels];
+    long mismatches = 0;
+    for (int g = 0; g < groups; g++) {
+        pan_T_Multi_Init(&multi[g]);
+    }
+    t0 = clock::now();
+    for (long n = 0; n < samples; n++) {
+        pan_T_Multi_Process_Channels(&multi[0], channels, &in[(size_t) n * channels], qrs);
+        for (int c = 0; c < channels; c++) {
+            mismatches += qrs[c] != (bool) scalar_qrs[(size_t) n * channels + c];
+        }
+    }
+    double multi_s = std::chrono::duration<double>(clock::now() - t0).count();
+    delete[] qrs;
+
+    double total = (double) channels * samples;
+#if defined(__AVX__)
+    const char *backend = "AVX";
+#elif defined(__SSE2__)
+    const char *backend = "SSE2";
+#else
+    const char *backend = "scalar";
+#endif
+    printf("channels: %d, samples/channel: %ld, lanes: %d (%s)\n", channels, samples, PAN_T_MULTI_LANES, backend);
+    printf("scalar detectors: %10.3f Mch*samples/s (%.1f ns per channel-sample)\n", total / scalar_s / 1e6, scalar_s / total * 1e9);
+    printf("pan_T_Multi:      %10.3f Mch*samples/s (%.1f ns per channel-sample)\n", total / multi_s / 1e6, multi_s / total * 1e9);
+    printf("speedup: %.2fx, real-time channels at 360 Hz: %.0f scalar, %.0f multi\n",
+           scalar_s / multi_s, total / scalar_s / 360.0, total / multi_s / 360.0);
+    printf("QRS flag mismatches: %ld\n", mismatches);
+    return mismatches == 0 ? 0 : 2;
+}
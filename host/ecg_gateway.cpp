@@ -0,0 +1,465 @@
+/* Multi-stream ECG gateway daemon - host only
+ *
+ * Accepts any number of concurrent ECG streams on a Unix socket (-u) and/or
+ * a TCP port (-p). Each connection is one stream of raw samples in the
+ * sender board's format (gateway_proto.h; 3-byte protocol, or link frames
+ * with -F). Every stream gets its own pan_T_Detector and pan_T_Noise_State
+ * and runs exactly the main.cpp loop, pan_T_Detector_Process() followed by
+ * pan_T_Noise_Update(), on each sample. Instead of per-sample values the
+ * gateway writes 8 byte event records back on the connection: one per QRS
+ * onset and one per change of the noise classification.
+ *
+ * I/O is non-blocking and event driven. The main thread accepts connections
+ * and hands each to the worker with the fewest streams. Every worker (-w,
+ * default one per core) has its own epoll set and is pinned to a core, so a
+ * stream's detector state stays in one core's cache. A worker drains each
+ * readable socket, runs the detector over everything that arrived and
+ * queues the events, waiting for EPOLLOUT only when the socket's send buffer
+ * is full. A client that does not read its events is not read from either
+ * once OUT_LIMIT bytes of them are queued, so no event is ever dropped and
+ * the client's sends block instead. A stream ends when its client shuts down its side and the pending
+ * events have been sent.
+ *
+ * Every -i seconds, and on exit (SIGINT/SIGTERM), it prints for every worker
+ * the open streams, the samples and events per second and the worker's CPU
+ * time, plus the samples per CPU second, which divided by the stream sample
+ * rate gives the streams one core keeps up with. Use gateway_load to drive it.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -pthread -I. host/ecg_gateway.cpp BME463_lib.cpp link_frame.cpp -o ecg_gateway
+ *
+ * Usage:
+ *   ./ecg_gateway [-u path] [-p port] [-w workers] [-F] [-i seconds]
+ */
+
+#include "BME463_lib.h"
+#include "gateway_proto.h"
+#include "wfdb.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+#define READ_CHUNK 4096
+#define READS_PER_WAKEUP 16     // Then the worker moves on to other ready streams
+#define OUT_LIMIT (64 * 1024)   // Queued event bytes at which a stream stops being read
+
+/* One connection. Only its worker touches it after it is handed over. */
+struct gw_stream {
+    int fd;
+    gw_decoder dec;
+    pan_T_Detector det;
+    pan_T_Noise_State noise;
+    uint32_t n;                 // Samples processed
+    bool qrs;                   // Detection flag of the previous sample
+    bool noisy;                 // Classification of the previous sample
+    bool eof;                   // Client has shut down its side
+    uint32_t interest;          // Current epoll interest set
+    std::vector<uint8_t> out;   // Event records not yet sent
+    size_t out_pos;
+};
+
+struct gw_worker {
+    int epfd;
+    int cpu;                    // Core it is pinned to, -1 for none
+    std::thread thread;
+    std::atomic<long> streams;
+    std::atomic<long> samples;
+    std::atomic<long> events;
+    std::atomic<long> throttled;    // Times a stream stopped being read for its queued events
+    std::atomic<long> closed;   // Streams that have ended
+};
+
+static std::atomic<bool> running(true);
+
+static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static size_t queued(const gw_stream *s) {
+    return s->out.size() - s->out_pos;
+}
+
+static void queue_event(gw_stream *s, uint8_t type) {
+    if (s->out_pos == s->out.size()) {
+        s->out.clear();
+        s->out_pos = 0;
+    }
+    gw_event ev;
+    ev.sample = s->n;
+    ev.type = type;
+    size_t at = s->out.size();
+    s->out.resize(at + GW_EVENT_LEN);
+    gw_event_encode(&ev, &s->out[at]);
+}
+
+/* Runs the main.cpp detector loop over decoded samples. */
+static void process(gw_worker *w, gw_stream *s, const int16_t *in, int count) {
+    long events = 0;
+    for (int k = 0; k < count; k++, s->n++) {
+        bool qrs = pan_T_Detector_Process(&s->det, wfdb_to_input(in[k]), NULL);
+        bool noisy = pan_T_Noise_Update(&s->noise, &s->det);
+        if (qrs && !s->qrs) {
+            queue_event(s, GW_QRS);
+            events++;
+        }
+        if (noisy != s->noisy) {
+            queue_event(s, noisy ? GW_NOISY : GW_CLEAN);
+            events++;
+        }
+        s->qrs = qrs;
+        s->noisy = noisy;
+    }
+    w->samples.fetch_add(count, std::memory_order_relaxed);
+    w->events.fetch_add(events, std::memory_order_relaxed);
+}
+
+/* Writes queued events. Returns false if the connection failed. */
+static bool flush(gw_worker *w, gw_stream *s) {
+    while (queued(s) > 0) {
+        ssize_t put = send(s->fd, &s->out[s->out_pos], s->out.size() - s->out_pos, MSG_NOSIGNAL);
+        if (put < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        s->out_pos += (size_t) put;
+    }
+    // Wait for input until the client's EOF unless too many events are
+    // queued, and for output while any are
+    uint32_t interest = (s->eof || queued(s) >= OUT_LIMIT ? 0u : (uint32_t) EPOLLIN) |
+                        (queued(s) > 0 ? (uint32_t) EPOLLOUT : 0u);
+    if ((s->interest & EPOLLIN) && !(interest & EPOLLIN) && !s->eof) {
+        w->throttled.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (interest != s->interest) {
+        struct epoll_event ev;
+        ev.events = interest;
+        ev.data.ptr = s;
+        epoll_ctl(w->epfd, EPOLL_CTL_MOD, s->fd, &ev);
+        s->interest = interest;
+    }
+    return true;
+}
+
+static void close_stream(gw_worker *w, gw_stream *s) {
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    delete s;
+    w->streams.fetch_sub(1, std::memory_order_relaxed);
+    w->closed.fetch_add(1, std::memory_order_relaxed);
+}
+
+/* Reads until the socket is drained, READS_PER_WAKEUP chunks are read or
+ * OUT_LIMIT bytes of events are queued. Returns false if the connection failed.
+ */
+static bool receive(gw_worker *w, gw_stream *s) {
+    uint8_t buf[READ_CHUNK];
+    int16_t samples[READ_CHUNK + LINK_MAX_SAMPLES];
+    for (int reads = 0; reads < READS_PER_WAKEUP && queued(s) < OUT_LIMIT;) {
+        ssize_t got = recv(s->fd, buf, sizeof(buf), 0);
+        if (got > 0) {
+            process(w, s, samples, gw_decode(&s->dec, buf, (int) got, samples));
+            reads++;
+            continue;
+        }
+        if (got == 0) {
+            s->eof = true;
+            return true;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void work(gw_worker *w) {
+    if (w->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    struct epoll_event ready[64];
+    while (running.load(std::memory_order_relaxed)) {
+        int n = epoll_wait(w->epfd, ready, 64, 100);
+        for (int e = 0; e < n; e++) {
+            gw_stream *s = (gw_stream *) ready[e].data.ptr;
+            bool ok = true;
+            if ((ready[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !s->eof) {
+                ok = receive(w, s);
+            }
+            ok = ok && flush(w, s);
+            if (!ok || s->interest == 0) {
+                close_stream(w, s);
+            }
+        }
+    }
+}
+
+static int listen_unix(const char *path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror(path);
+        return -1;
+    }
+    set_nonblocking(fd);
+    return fd;
+}
+
+static int listen_tcp(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t) port);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror("tcp");
+        return -1;
+    }
+    set_nonblocking(fd);
+    return fd;
+}
+
+/* Accepts every pending connection of a listening socket. */
+static void accept_all(int lfd, bool tcp, bool framed, std::vector<gw_worker *> &workers) {
+    for (;;) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("accept");
+            }
+            if (errno != EINTR) {
+                return;
+            }
+            continue;
+        }
+        set_nonblocking(fd);
+        if (tcp) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));  // Events are small and latency matters
+        }
+        gw_stream *s = new gw_stream();
+        s->fd = fd;
+        gw_decoder_init(&s->dec, framed);
+        pan_T_Detector_Init(&s->det);
+        pan_T_Noise_Init(&s->noise);
+        s->n = 0;
+        s->qrs = s->noisy = s->eof = false;
+        s->interest = EPOLLIN;
+        s->out_pos = 0;
+
+        gw_worker *w = workers[0];
+        for (size_t k = 1; k < workers.size(); k++) {
+            if (workers[k]->streams.load() < w->streams.load()) {
+                w = workers[k];
+            }
+        }
+        w->streams.fetch_add(1);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = s;
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            perror("epoll_ctl");
+            close(fd);
+            delete s;
+            w->streams.fetch_sub(1);
+        }
+    }
+}
+
+static double thread_cpu_s(std::thread &t) {
+    clockid_t id;
+    struct timespec ts;
+    if (pthread_getcpuclockid(t.native_handle(), &id) != 0 || clock_gettime(id, &ts) != 0) {
+        return 0.0;
+    }
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct gw_totals {
+    long samples;
+    long events;
+    double cpu;
+};
+
+/* Prints the activity since the previous report. */
+static void report(std::vector<gw_worker *> &workers, std::vector<gw_totals> &last, double dt) {
+    long samples = 0;
+    double cpu = 0.0;
+    for (size_t k = 0; k < workers.size(); k++) {
+        gw_worker *w = workers[k];
+        gw_totals now;
+        now.samples = w->samples.load();
+        now.events = w->events.load();
+        now.cpu = thread_cpu_s(w->thread);
+        printf("worker %zu (cpu %d): %ld streams, %.0f samples/s, %.0f events/s, %.1f%% cpu, %ld closed, %ld throttled\n",
+               k, w->cpu, w->streams.load(), (now.samples - last[k].samples) / dt, (now.events - last[k].events) / dt,
+               100.0 * (now.cpu - last[k].cpu) / dt, w->closed.load(), w->throttled.load());
+        samples += now.samples - last[k].samples;
+        cpu += now.cpu - last[k].cpu;
+        last[k] = now;
+    }
+    if (cpu > 0) {
+        printf("total: %.0f samples/s, %.0f samples per cpu second = %.0f streams/core at 360 sps\n",
+               samples / dt, samples / cpu, samples / cpu / 360.0);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    int port = 0;
+    unsigned nworkers = std::thread::hardware_concurrency();
+    bool framed = false;
+    double interval = 5.0;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-F") == 0) {
+            framed = true;
+        } else if (argv[a][0] == '-' && argv[a][1] != '\0' && argv[a][2] == '\0' && a + 1 < argc) {
+            const char *v = argv[++a];
+            switch (argv[a - 1][1]) {
+            case 'u': path = v; break;
+            case 'p': port = atoi(v); break;
+            case 'w': nworkers = (unsigned) atoi(v); break;
+            case 'i': interval = atof(v); break;
+            default: path = NULL; port = 0; a = argc; break;
+            }
+        } else {
+            path = NULL;
+            port = 0;
+            break;
+        }
+    }
+    if (path == NULL && port == 0) {
+        fprintf(stderr, "usage: %s [-u path] [-p port] [-w workers] [-F] [-i seconds]\n", argv[0]);
+        return 1;
+    }
+    if (nworkers == 0) {
+        nworkers = 1;
+    }
+
+    // SIGINT/SIGTERM and the report timer are read through the main epoll set
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);    // Before the workers start, so they inherit it
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK);
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    struct itimerspec its;
+    its.it_interval.tv_sec = its.it_value.tv_sec = (time_t) interval;
+    its.it_interval.tv_nsec = its.it_value.tv_nsec = (long) ((interval - (time_t) interval) * 1e9);
+    timerfd_settime(tfd, 0, &its, NULL);
+
+    int ufd = path != NULL ? listen_unix(path) : -1;
+    int pfd = port != 0 ? listen_tcp(port) : -1;
+    if ((path != NULL && ufd < 0) || (port != 0 && pfd < 0)) {
+        return 1;
+    }
+
+    unsigned ncpu = std::thread::hardware_concurrency();
+    std::vector<gw_worker *> workers;
+    for (unsigned k = 0; k < nworkers; k++) {
+        gw_worker *w = new gw_worker();
+        w->epfd = epoll_create1(0);
+        w->cpu = ncpu > 0 ? (int) (k % ncpu) : -1;
+        w->streams = w->samples = w->events = w->throttled = w->closed = 0;
+        w->thread = std::thread(work, w);
+        workers.push_back(w);
+    }
+    std::vector<gw_totals> last(nworkers);
+    for (unsigned k = 0; k < nworkers; k++) {
+        last[k].samples = last[k].events = 0;
+        last[k].cpu = 0.0;
+    }
+
+    int epfd = epoll_create1(0);
+    int fds[4] = {ufd, pfd, sfd, tfd};
+    for (int k = 0; k < 4; k++) {
+        if (fds[k] >= 0) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.fd = fds[k];
+            epoll_ctl(epfd, EPOLL_CTL_ADD, fds[k], &ev);
+        }
+    }
+    printf("listening on%s%s%s, %u workers, %s\n", path ? " " : "", path ? path : "", port ? " tcp" : "", nworkers,
+           framed ? "framed link" : "3-byte link");
+    fflush(stdout);
+
+    struct timespec start, t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    t0 = start;
+    while (running) {
+        struct epoll_event ready[4];
+        int n = epoll_wait(epfd, ready, 4, -1);
+        for (int e = 0; e < n; e++) {
+            int fd = ready[e].data.fd;
+            if (fd == ufd || fd == pfd) {
+                accept_all(fd, fd == pfd, framed, workers);
+            } else if (fd == tfd) {
+                uint64_t expirations;
+                if (read(tfd, &expirations, sizeof(expirations)) > 0) {
+                    clock_gettime(CLOCK_MONOTONIC, &t1);
+                    report(workers, last, (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9);
+                    t0 = t1;
+                }
+            } else if (fd == sfd) {
+                running = false;
+            }
+        }
+    }
+
+    // Report while the workers still exist, their CPU clocks go with them
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    report(workers, last, (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9);
+    std::vector<gw_totals> zero(nworkers, last[0]);
+    for (unsigned k = 0; k < nworkers; k++) {
+        zero[k].samples = zero[k].events = 0;
+        zero[k].cpu = 0.0;
+    }
+    printf("whole run:\n");
+    report(workers, zero, (t1.tv_sec - start.tv_sec) + (t1.tv_nsec - start.tv_nsec) * 1e-9);
+    for (size_t k = 0; k < workers.size(); k++) {
+        workers[k]->thread.join();
+    }
+    if (path != NULL) {
+        unlink(path);
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+/* Flight recorder decoder - host only
+ *
+ * Reads flight_rec images (flight_rec.h) and writes their records as CSV,
+ * oldest first. An input file may hold several images one after the other
+ * (replay -f writes one per freeze) or one image somewhere inside a larger
+ * memory dump: the file is scanned for the FLIGHT_REC_MAGIC header at every
+ * 4 byte offset. The ring length is taken from each image's header, so
+ * images recorded with any FLIGHT_REC_LEN can be decoded.
+ *
+ * Columns: image,sample,time_s,filtered,mwi,threshold,spki,npki,nsr,qrs,noisy,trigger
+ * Q16 values of the fixed-point pipeline are converted to float; trigger is
+ * 1 on the sample that froze the image.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -I. host/flight_decode.cpp -o flight_decode
+ *
+ * Usage:
+ *   ./flight_decode [-o out.csv] <flight.bin>...
+ */
+
+#include "flight_rec.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static const size_t FLIGHT_HEADER_LEN = offsetof(flight_rec, ring);
+
+static const char *flight_state_name(uint32_t state) {
+    switch (state) {
+    case FLIGHT_ARMED: return "armed";
+    case FLIGHT_TRIGGERED: return "triggered";
+    case FLIGHT_FROZEN: return "frozen";
+    default: return "?";
+    }
+}
+
+static float flight_level(const flight_value &v, uint32_t format) {
+    return format == FLIGHT_Q16 ? v.q * (1.0f / 65536.0f) : v.f;
+}
+
+/* True if a valid image header is at data[pos], with its ring in the file. */
+static bool flight_header_at(const std::vector<unsigned char> &data, size_t pos, flight_rec *hdr) {
+    if (pos + FLIGHT_HEADER_LEN > data.size()) {
+        return false;
+    }
+    memcpy(hdr, &data[pos], FLIGHT_HEADER_LEN);
+    return hdr->magic == FLIGHT_REC_MAGIC && hdr->version == FLIGHT_REC_VERSION &&
+           hdr->record_size == sizeof(flight_record) && hdr->len > 0 && hdr->format <= FLIGHT_Q16 &&
+           pos + FLIGHT_HEADER_LEN + (size_t) hdr->len * sizeof(flight_record) <= data.size();
+}
+
+static bool read_file(const char *path, std::vector<unsigned char> *out) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    unsigned char buf[65536];
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), f)) > 0) {
+        out->insert(out->end(), buf, buf + got);
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *csv_path = NULL;
+    std::vector<const char *> inputs;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) {
+            csv_path = argv[++a];
+        } else {
+            inputs.push_back(argv[a]);
+        }
+    }
+    if (inputs.empty()) {
+        fprintf(stderr, "usage: %s [-o out.csv] <flight.bin>...\n", argv[0]);
+        return 1;
+    }
+    FILE *csv = stdout;
+    if (csv_path != NULL && (csv = fopen(csv_path, "w")) == NULL) {
+        fprintf(stderr, "cannot write %s\n", csv_path);
+        return 1;
+    }
+    fprintf(csv, "image,sample,time_s,filtered,mwi,threshold,spki,npki,nsr,qrs,noisy,trigger\n");
+
+    int images = 0;
+    long records = 0;
+    for (size_t in = 0; in < inputs.size(); in++) {
+        std::vector<unsigned char> data;
+        if (!read_file(inputs[in], &data)) {
+            return 1;
+        }
+        size_t pos = 0;
+        while (pos + FLIGHT_HEADER_LEN <= data.size()) {
+            flight_rec hdr;
+            if (!flight_header_at(data, pos, &hdr)) {
+                pos += 4;
+                continue;
+            }
+            const unsigned char *ring = &data[pos + FLIGHT_HEADER_LEN];
+            uint32_t n = hdr.count - hdr.base;
+            if (n > hdr.len) {
+                n = hdr.len;
+            }
+            bool triggered = hdr.state != FLIGHT_ARMED;
+            fprintf(stderr, "%s @%zu: image %d, %s %s, %u of %u records", inputs[in], pos, images,
+                    hdr.format == FLIGHT_Q16 ? "Q16" : "float", flight_state_name(hdr.state), n, hdr.len);
+            if (triggered) {
+                fprintf(stderr, ", trigger at sample %u (%.3f s)", hdr.trigger_sample,
+                        hdr.fs > 0 ? hdr.trigger_sample / hdr.fs : 0.0);
+            }
+            fprintf(stderr, "\n");
+            for (uint32_t i = 0; i < n; i++) {
+                flight_record e;
+                memcpy(&e, ring + (size_t) ((hdr.count - n + i) % hdr.len) * sizeof(flight_record), sizeof(e));
+                fprintf(csv, "%d,%u,%.6f,%g,%g,%g,%g,%g,%g,%d,%d,%d\n", images, e.sample,
+                        hdr.fs > 0 ? e.sample / hdr.fs : 0.0, flight_level(e.filtered, hdr.format),
+                        flight_level(e.mwi, hdr.format), flight_level(e.threshold, hdr.format),
+                        flight_level(e.spki, hdr.format), flight_level(e.npki, hdr.format), e.nsr,
+                        (e.flags & FLIGHT_QRS) != 0, (e.flags & FLIGHT_NOISY) != 0,
+                        triggered && e.sample == hdr.trigger_sample);
+            }
+            records += n;
+            images++;
+            pos += FLIGHT_HEADER_LEN + (size_t) hdr.len * sizeof(flight_record);
+        }
+    }
+    if (csv != stdout) {
+        fclose(csv);
+    }
+    fprintf(stderr, "%d images, %ld records\n", images, records);
+    return images > 0 ? 0 : 1;
+}
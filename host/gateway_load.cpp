@@ -0,0 +1,486 @@
+/* Load generator for ecg_gateway - host only
+ *
+ * Opens -n connections to an ecg_gateway (Unix socket -u, or TCP -p on
+ * 127.0.0.1 or -H) and sends a synthetic ECG on each, encoded the way the
+ * sender board does (3-byte protocol, or link frames of -F samples, which
+ * needs ecg_gateway -F). Every stream sends -r samples per second in chunks
+ * every -c ms, or with -r 0 as fast as the gateway accepts them, for -t
+ * seconds; then it shuts down its side and reads the remaining events until
+ * the gateway closes the connection.
+ *
+ * The streams use the 16 channels of synth_ecg in turn. -N adds noise
+ * bursts of that amplitude (ADC counts) to the synthetic ECG, 20 s noisy,
+ * 20 s clean after a 20 s clean lead-in, so noise transitions show up in
+ * short runs.
+ *
+ * The event latency is the time from the moment the event's sample was
+ * written to the socket to the moment the event record was read back, so it
+ * covers both socket hops, queueing and the gateway's processing, but not the
+ * detector's own filter delay. Reports the samples per second sent, the
+ * events received, the latency percentiles and, when paced, how often a
+ * stream could not send what was due (the gateway fell behind).
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -pthread -I. host/gateway_load.cpp link_frame.cpp -o gateway_load
+ *
+ * Usage:
+ *   ./gateway_load (-u path | -p port [-H host]) [-n streams] [-r rate] [-t seconds] [-c ms] [-F frame] [-N noise] [-w threads]
+ */
+
+#include "gateway_proto.h"
+#include "synth_ecg.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#define SIGNAL_LEN 65536            // Samples per synthetic channel, played in a loop
+#define SIGNAL_CHANNELS 16
+#define OUT_BACKLOG (64 * 1024)     // Unsent bytes at which a paced stream stops generating
+#define FLAT_OUT_BLOCK 1024         // Samples generated at a time with -r 0
+#define DRAIN_TIMEOUT_S 5.0
+
+typedef std::chrono::steady_clock load_clock;
+
+struct load_options {
+    const char *path;
+    const char *host;
+    int port;
+    int streams;
+    double rate;        // Samples per second per stream, 0 for as fast as possible
+    double seconds;
+    double chunk_ms;
+    int frame;          // Samples per link frame, 0 for the 3-byte protocol
+    int threads;
+};
+
+/* Bytes of a stream up to byte_end carry its samples up to sample_end. */
+struct load_chunk {
+    long byte_end;
+    long sample_end;
+    load_clock::time_point written;
+};
+
+struct load_stream {
+    int fd;
+    const int16_t *signal;
+    long offset;                // Of the stream into its channel
+    long sent;                  // Samples encoded so far
+    uint8_t seq;
+    std::vector<uint8_t> out;
+    size_t out_pos;
+    long bytes_queued;          // Bytes ever appended to out
+    long bytes_written;
+    std::deque<load_chunk> chunks;
+    uint8_t in[GW_EVENT_LEN];
+    int in_len;
+    uint32_t interest;
+    bool shut;                  // Our side is shut down
+    bool closed;
+};
+
+struct load_result {
+    long samples;
+    long qrs;
+    long noisy;
+    long clean;
+    long backlogged;            // Ticks at which a stream had to skip generating
+    long failed;                // Connections lost before the end
+    std::vector<float> latency_us;
+};
+
+static int connect_stream(const load_options &opt) {
+    int fd;
+    if (opt.path != NULL) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, opt.path, sizeof(addr.sun_path) - 1);
+        if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+            perror(opt.path);
+            return -1;
+        }
+    } else {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t) opt.port);
+        inet_pton(AF_INET, opt.host, &addr.sin_addr);
+        if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+            perror(opt.host);
+            return -1;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+/* Appends the stream's samples up to sample index end to its output. */
+static void generate(load_stream *s, long end, int frame) {
+    if (s->sent >= end) {
+        return;
+    }
+    if (s->out_pos == s->out.size()) {
+        s->out.clear();
+        s->out_pos = 0;
+    }
+    size_t before = s->out.size();
+    while (s->sent < end) {
+        int count = frame > 0 ? (int) std::min<long>(frame, end - s->sent) : 1;
+        uint8_t buf[LINK_FRAME_MAX];
+        int len;
+        if (frame > 0) {
+            link_frame f;
+            f.seq = s->seq++;
+            f.count = (uint8_t) count;
+            for (int k = 0; k < count; k++) {
+                f.samples[k] = s->signal[(s->offset + s->sent + k) % SIGNAL_LEN];
+            }
+            len = link_encode(&f, buf);
+        } else {
+            len = gw_encode_3byte(s->signal[(s->offset + s->sent) % SIGNAL_LEN], buf);
+        }
+        s->out.insert(s->out.end(), buf, buf + len);
+        s->sent += count;
+    }
+    s->bytes_queued += (long) (s->out.size() - before);
+    load_chunk c;
+    c.byte_end = s->bytes_queued;
+    c.sample_end = s->sent;
+    s->chunks.push_back(c);
+    if (s->chunks.size() > 4096) {
+        s->chunks.pop_front();      // The gateway sends no events; keep the bookkeeping bounded
+    }
+}
+
+/* Sends what it can and timestamps the chunks completed. Returns false if the connection failed. */
+static bool send_out(load_stream *s) {
+    while (s->out_pos < s->out.size()) {
+        ssize_t put = send(s->fd, &s->out[s->out_pos], s->out.size() - s->out_pos, MSG_NOSIGNAL);
+        if (put < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        s->out_pos += (size_t) put;
+        s->bytes_written += put;
+    }
+    load_clock::time_point now = load_clock::now();
+    for (size_t k = 0; k < s->chunks.size() && s->chunks[k].byte_end <= s->bytes_written; k++) {
+        if (s->chunks[k].written == load_clock::time_point()) {
+            s->chunks[k].written = now;
+        }
+    }
+    return true;
+}
+
+/* Reads event records. Returns false once the gateway closed the connection. */
+static bool receive(load_stream *s, load_result *r) {
+    uint8_t buf[4096];
+    for (;;) {
+        ssize_t got = recv(s->fd, buf, sizeof(buf), 0);
+        if (got == 0) {
+            return false;
+        }
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                r->failed++;
+                return false;
+            }
+            return true;
+        }
+        load_clock::time_point now = load_clock::now();
+        for (ssize_t b = 0; b < got; b++) {
+            s->in[s->in_len++] = buf[b];
+            if (s->in_len < GW_EVENT_LEN) {
+                continue;
+            }
+            s->in_len = 0;
+            gw_event ev;
+            gw_event_decode(s->in, &ev);
+            if (ev.type == GW_QRS) {
+                r->qrs++;
+            } else if (ev.type == GW_NOISY) {
+                r->noisy++;
+            } else if (ev.type == GW_CLEAN) {
+                r->clean++;
+            }
+            // Events come in sample order, so earlier chunks are not needed again
+            while (!s->chunks.empty() && s->chunks.front().sample_end <= (long) ev.sample) {
+                s->chunks.pop_front();
+            }
+            if (!s->chunks.empty() && s->chunks.front().written != load_clock::time_point()) {
+                r->latency_us.push_back(
+                    (float) std::chrono::duration<double, std::micro>(now - s->chunks.front().written).count());
+            }
+        }
+    }
+}
+
+static void set_interest(int epfd, load_stream *s, uint32_t interest) {
+    if (interest != s->interest) {
+        struct epoll_event ev;
+        ev.events = interest;
+        ev.data.ptr = s;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, s->fd, &ev);
+        s->interest = interest;
+    }
+}
+
+static void drive(std::vector<load_stream *> streams, const load_options *opt, load_clock::time_point t0,
+                  load_result *r) {
+    int epfd = epoll_create1(0);
+    for (size_t k = 0; k < streams.size(); k++) {
+        struct epoll_event ev;
+        streams[k]->interest = ev.events = EPOLLIN | (opt->rate > 0 ? 0u : (uint32_t) EPOLLOUT);
+        ev.data.ptr = streams[k];
+        epoll_ctl(epfd, EPOLL_CTL_ADD, streams[k]->fd, &ev);
+    }
+    load_clock::duration tick = std::chrono::duration_cast<load_clock::duration>(
+        std::chrono::duration<double, std::milli>(opt->chunk_ms));
+    load_clock::time_point stop = t0 + std::chrono::duration_cast<load_clock::duration>(
+                                           std::chrono::duration<double>(opt->seconds));
+    load_clock::time_point drain_end = stop + std::chrono::duration_cast<load_clock::duration>(
+                                                  std::chrono::duration<double>(DRAIN_TIMEOUT_S));
+    load_clock::time_point next_tick = t0;
+    size_t open = streams.size();
+    bool sending = true;
+    while (open > 0) {
+        load_clock::time_point now = load_clock::now();
+        if (now >= drain_end) {
+            break;
+        }
+        if (sending && now >= stop) {
+            sending = false;
+        }
+        if (opt->rate > 0 && sending && now >= next_tick) {
+            long due = (long) (opt->rate * std::chrono::duration<double>(now - t0).count());
+            for (size_t k = 0; k < streams.size(); k++) {
+                load_stream *s = streams[k];
+                if (s->closed) {
+                    continue;
+                }
+                if (s->out.size() - s->out_pos >= OUT_BACKLOG) {
+                    r->backlogged++;
+                    continue;
+                }
+                generate(s, due, opt->frame);
+                if (!send_out(s)) {
+                    r->failed++;
+                    s->closed = true;
+                    open--;
+                    close(s->fd);
+                    continue;
+                }
+                set_interest(epfd, s, EPOLLIN | (s->out_pos < s->out.size() ? (uint32_t) EPOLLOUT : 0u));
+            }
+            next_tick += tick;
+        }
+        if (!sending) {
+            for (size_t k = 0; k < streams.size(); k++) {
+                load_stream *s = streams[k];
+                if (!s->closed && !s->shut && s->out_pos == s->out.size()) {
+                    shutdown(s->fd, SHUT_WR);
+                    s->shut = true;
+                    set_interest(epfd, s, EPOLLIN);
+                }
+            }
+        }
+
+        int timeout = 100;
+        if (opt->rate > 0 && sending) {
+            timeout = (int) std::max<long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(next_tick - now).count());
+        }
+        struct epoll_event ready[64];
+        int n = epoll_wait(epfd, ready, 64, timeout);
+        for (int e = 0; e < n; e++) {
+            load_stream *s = (load_stream *) ready[e].data.ptr;
+            if (s->closed) {
+                continue;
+            }
+            bool ok = true;
+            if (ready[e].events & EPOLLOUT) {
+                if (opt->rate <= 0 && sending && s->out_pos == s->out.size()) {
+                    generate(s, s->sent + FLAT_OUT_BLOCK, opt->frame);
+                }
+                ok = send_out(s);
+                if (!ok) {
+                    r->failed++;
+                }
+                if (ok && (opt->rate > 0 || !sending) && s->out_pos == s->out.size()) {
+                    set_interest(epfd, s, EPOLLIN);     // Nothing more to send until the next tick
+                }
+            }
+            if (ok && (ready[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                ok = receive(s, r);
+            }
+            if (!ok) {
+                s->closed = true;
+                open--;
+                close(s->fd);
+            }
+        }
+    }
+    for (size_t k = 0; k < streams.size(); k++) {
+        load_stream *s = streams[k];
+        r->samples += s->sent;
+        if (!s->closed) {
+            r->failed++;    // Still open at the drain timeout
+            close(s->fd);
+        }
+    }
+    close(epfd);
+}
+
+static double percentile(const std::vector<float> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t k = (size_t) (p * (sorted.size() - 1) + 0.5);
+    return sorted[k];
+}
+
+int main(int argc, char **argv) {
+    load_options opt;
+    opt.path = NULL;
+    opt.host = "127.0.0.1";
+    opt.port = 0;
+    opt.streams = 100;
+    opt.rate = 360.0;
+    opt.seconds = 10.0;
+    opt.chunk_ms = 10.0;
+    opt.frame = 0;
+    opt.threads = 1;
+    float noise_amp = 0.0f;
+    bool usage = false;
+    for (int a = 1; a < argc && !usage; a++) {
+        if (argv[a][0] == '-' && argv[a][1] != '\0' && argv[a][2] == '\0' && a + 1 < argc) {
+            const char *v = argv[++a];
+            switch (argv[a - 1][1]) {
+            case 'u': opt.path = v; break;
+            case 'p': opt.port = atoi(v); break;
+            case 'H': opt.host = v; break;
+            case 'n': opt.streams = atoi(v); break;
+            case 'r': opt.rate = atof(v); break;
+            case 't': opt.seconds = atof(v); break;
+            case 'c': opt.chunk_ms = atof(v); break;
+            case 'F': opt.frame = atoi(v); break;
+            case 'N': noise_amp = (float) atof(v); break;
+            case 'w': opt.threads = atoi(v); break;
+            default: usage = true; break;
+            }
+        } else {
+            usage = true;
+        }
+    }
+    if (usage || (opt.path == NULL && opt.port == 0) || opt.streams < 1 || opt.frame < 0 ||
+        opt.frame > LINK_MAX_SAMPLES || opt.chunk_ms <= 0) {
+        fprintf(stderr, "usage: %s (-u path | -p port [-H host]) [-n streams] [-r rate] [-t seconds] [-c ms] "
+                        "[-F frame] [-N noise] [-w threads]\n", argv[0]);
+        return 1;
+    }
+    opt.threads = std::max(1, std::min(opt.threads, opt.streams));
+
+    std::vector<std::vector<int16_t> > signals(SIGNAL_CHANNELS);
+    for (int c = 0; c < SIGNAL_CHANNELS; c++) {
+        synth_ecg gen;
+        synth_ecg_init(&gen, c, noise_amp);
+        gen.clean_lead_s = 20.0f;
+        gen.segment_s = 20.0f;
+        for (int k = 0; k < SIGNAL_LEN; k++) {
+            signals[c].push_back((int16_t) synth_ecg_next(&gen));
+        }
+    }
+
+    std::vector<load_stream> streams(opt.streams);
+    for (int k = 0; k < opt.streams; k++) {
+        load_stream &s = streams[k];
+        s.fd = connect_stream(opt);
+        if (s.fd < 0) {
+            return 1;
+        }
+        s.signal = signals[k % SIGNAL_CHANNELS].data();
+        s.offset = (k / SIGNAL_CHANNELS) * 997L;
+        s.sent = 0;
+        s.seq = 0;
+        s.out_pos = 0;
+        s.bytes_queued = s.bytes_written = 0;
+        s.in_len = 0;
+        s.interest = 0;
+        s.shut = s.closed = false;
+    }
+
+    std::vector<load_result> results(opt.threads);
+    std::vector<std::thread> threads;
+    load_clock::time_point t0 = load_clock::now();
+    for (int t = 0; t < opt.threads; t++) {
+        std::vector<load_stream *> mine;
+        for (int k = t; k < opt.streams; k += opt.threads) {
+            mine.push_back(&streams[k]);
+        }
+        load_result &r = results[t];
+        r.samples = r.qrs = r.noisy = r.clean = r.backlogged = r.failed = 0;
+        threads.push_back(std::thread(drive, mine, &opt, t0, &r));
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+
+    load_result total;
+    total.samples = total.qrs = total.noisy = total.clean = total.backlogged = total.failed = 0;
+    for (size_t t = 0; t < results.size(); t++) {
+        const load_result &r = results[t];
+        total.samples += r.samples;
+        total.qrs += r.qrs;
+        total.noisy += r.noisy;
+        total.clean += r.clean;
+        total.backlogged += r.backlogged;
+        total.failed += r.failed;
+        total.latency_us.insert(total.latency_us.end(), r.latency_us.begin(), r.latency_us.end());
+    }
+    std::sort(total.latency_us.begin(), total.latency_us.end());
+
+    printf("%d streams, %s, %.0f s, %s\n", opt.streams, opt.frame ? "framed link" : "3-byte link", opt.seconds,
+           opt.rate > 0 ? "paced" : "flat out");
+    printf("samples sent: %ld (%.0f/s", total.samples, total.samples / opt.seconds);
+    if (opt.rate > 0) {
+        printf(", target %.0f/s", opt.rate * opt.streams);
+    }
+    printf(")\n");
+    printf("events: %ld QRS (%.1f per minute of 360 Hz ECG), %ld noisy, %ld clean\n", total.qrs,
+           total.qrs / (total.samples / 360.0 / 60.0), total.noisy, total.clean);
+    printf("event latency (us): p50 %.0f, p90 %.0f, p99 %.0f, max %.0f over %zu events\n",
+           percentile(total.latency_us, 0.50), percentile(total.latency_us, 0.90),
+           percentile(total.latency_us, 0.99), percentile(total.latency_us, 1.0), total.latency_us.size());
+    if (opt.rate > 0) {
+        printf("backlogged stream ticks: %ld\n", total.backlogged);
+    }
+    if (total.failed > 0) {
+        printf("failed connections: %ld\n", total.failed);
+    }
+    return total.failed > 0 ? 1 : 0;
+}
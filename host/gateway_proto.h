@@ -0,0 +1,112 @@
+/* Wire format of the ECG gateway - host only
+ *
+ * Every connection to ecg_gateway carries one ECG stream in the format the
+ * sender board emits: either the 3-byte protocol (low byte, high byte, '\0'
+ * per int16 sample) or, with -F, link frames (link_frame.h). gw_decoder
+ * turns the received bytes into samples exactly as main.cpp does.
+ *
+ * The gateway answers on the same connection with fixed size event records
+ * instead of per-sample values:
+ *
+ *      sample (uint32, little-endian)  type (uint8)  3 zero bytes
+ *
+ * where sample is the index of the stream sample (0 for the first sample
+ * received on the connection) at which a QRS complex was detected or the
+ * noise classification changed.
+ */
+
+#ifndef _gateway_proto
+#define _gateway_proto
+
+#include "link_frame.h"
+#include <stdint.h>
+
+enum {
+    GW_EVENT_LEN = 8        // Bytes per event record
+};
+
+enum gw_event_type {
+    GW_QRS = 1,             // QRS onset
+    GW_NOISY = 2,           // Classification changed to noisy
+    GW_CLEAN = 3            // Classification changed to clean
+};
+
+typedef struct _gw_event {
+    uint32_t sample;
+    uint8_t type;
+} gw_event;
+
+static inline void gw_event_encode(const gw_event *ev, uint8_t *out) {
+    out[0] = (uint8_t) ev->sample;
+    out[1] = (uint8_t) (ev->sample >> 8);
+    out[2] = (uint8_t) (ev->sample >> 16);
+    out[3] = (uint8_t) (ev->sample >> 24);
+    out[4] = ev->type;
+    out[5] = out[6] = out[7] = 0;
+}
+
+static inline void gw_event_decode(const uint8_t *in, gw_event *ev) {
+    ev->sample = (uint32_t) in[0] | (uint32_t) in[1] << 8 | (uint32_t) in[2] << 16 | (uint32_t) in[3] << 24;
+    ev->type = in[4];
+}
+
+/* Sample decoder of one stream: the 3-byte decoder of main.cpp or a
+ * link_decoder.
+ */
+typedef struct _gw_decoder {
+    bool framed;
+    link_decoder link;
+    union {
+        short s;
+        char h[sizeof(short)];
+    } data;
+    unsigned i;
+} gw_decoder;
+
+static inline void gw_decoder_init(gw_decoder *dec, bool framed) {
+    dec->framed = framed;
+    link_decoder_init(&dec->link);
+    dec->data.s = 0;
+    dec->i = 0;
+}
+
+/**
+ * @brief Decodes received bytes into samples.
+ *
+ * @param dec Decoder of the stream.
+ * @param in Received bytes.
+ * @param n Number of bytes.
+ * @param out Receives the samples; room for n + LINK_MAX_SAMPLES is always enough.
+ * @return int Number of samples decoded.
+ */
+static inline int gw_decode(gw_decoder *dec, const uint8_t *in, int n, int16_t *out) {
+    int count = 0;
+    for (int b = 0; b < n; b++) {
+        if (dec->framed) {
+            if (link_decode_byte(&dec->link, in[b])) {
+                for (int s = 0; s < dec->link.frame.count; s++) {
+                    out[count++] = dec->link.frame.samples[s];
+                }
+            }
+            continue;
+        }
+        char d = (char) in[b];
+        if (d == '\0' && dec->i >= sizeof(short)) {
+            dec->i = 0;
+            out[count++] = (int16_t) dec->data.s;
+        } else if (dec->i < sizeof(short)) {
+            dec->data.h[dec->i++] = d;
+        }
+    }
+    return count;
+}
+
+/* Encodes one sample in the 3-byte protocol; returns the 3 bytes written. */
+static inline int gw_encode_3byte(int16_t v, uint8_t *out) {
+    out[0] = (uint8_t) (v & 0xFF);
+    out[1] = (uint8_t) ((v >> 8) & 0xFF);
+    out[2] = 0;
+    return 3;
+}
+
+#endif
@@ -0,0 +1,363 @@
+/* Golden-output regression check of the detector kernels - host only
+ *
+ * host/golden/ holds reference traces of the detector as it was before the
+ * optimized kernels: the original main.cpp loop over the array API of the
+ * baseline library (pan_T_Filter(Ain, yOut), pan_T_Threshold() on the
+ * spki/npki arrays and the NSR test), recorded by host/golden_record. For
+ * every sample of a signal a trace holds the raw input, the filtered value,
+ * the MWI output, QRS_detected and cur_noise_state (golden.h).
+ * host/golden/golden.txt lists the signals, where their input comes from
+ * and their tolerances:
+ *
+ *   name  source  settle_s  filtered mwi slack  fixed_filtered fixed_mwi fixed_slack
+ *
+ *   source := synth:channel:noise_amp:seconds:segment_s  (synth_ecg.h, segment_s
+ *                                                          clean lead-in, then
+ *                                                          alternating segments)
+ *           | wfdb:record:signal:start_s:seconds         (an excerpt of a record
+ *                                                          under host/golden)
+ *
+ * Every kernel runs every signal's stored input and its outputs are
+ * compared with the stored ones:
+ *
+ *   legacy     pan_T_Filter(Ain, yOut) + pan_T_Threshold(arrays) + the NSR
+ *              test of the original main.cpp, one child process per signal
+ *   detector   pan_T_Detector_Process() + pan_T_Noise_Update(), float
+ *   fixed      the same with pan_T_fixed (fixed_* tolerances)
+ *   state      pan_T_Filter(state) + pan_T_Threshold(state)
+ *   generic    pan_T_Filter_Generic() + pan_T_Threshold(state)
+ *   block      pan_T_Filter_Block() over the whole signal + pan_T_Threshold(state)
+ *   multi      pan_T_Multi_Process(), the signal in lane 0
+ *
+ * Only legacy, detector and fixed produce a noise state. filtered and mwi
+ * may differ from the reference by their tolerance times the signal's
+ * largest |reference| value; a QRS or noise flag may differ on a sample if
+ * the reference has the same flag value within slack samples of it, so
+ * edges may move by up to slack. Flags are not compared in the first
+ * settle_s seconds, while the thresholds of the fixed-point pipeline, which
+ * cannot represent the tiny start-up levels, catch up with the float ones.
+ *
+ * Against the baseline reference the float kernels reproduce filtered
+ * exactly and every flag; their running-sum MWI differs from the baseline's
+ * 30-tap sum by rounding, at most 3.6e-7 of the largest MWI value (generic
+ * keeps the tap sum and is exact). The fixed-point pipeline stays within
+ * 2.5e-5 of it, and its flag edges move by a few samples. The manifest's
+ * tolerances (1e-6/1e-5, slack 0; 1e-4/1e-4, slack 12) leave a margin over
+ * that.
+ *
+ * Each kernel/signal pair prints its worst errors and the first divergent
+ * sample. The exit status is 1 if any pair diverged, or if a signal of
+ * golden.txt has no trace, unless -S allows skipping it.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -I. host/golden.cpp host/wfdb.cpp BME463_lib.cpp pan_T_multi.cpp -o golden
+ *
+ * Usage:
+ *   ./golden [-S] [-d dir] [-k kernel,...] [signal...]
+ *
+ *   -S      := report signals without a trace and carry on
+ *   dir     := directory of golden.txt and the .gold traces, default host/golden
+ *   signal  := names from golden.txt to run, default all
+ */
+
+#include "golden.h"
+#include "pan_T_multi.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* Outputs of a kernel run. */
+struct kernel_trace {
+    std::vector<float> filtered;
+    std::vector<float> mwi;
+    std::vector<uint8_t> flags;
+    bool has_noise;
+};
+
+typedef void (*kernel_fn)(const std::vector<golden_sample> &in, kernel_trace *out);
+
+/* Original main.cpp loop over the array API, in a child process. */
+static void run_legacy(const std::vector<golden_sample> &in, kernel_trace *out) {
+    std::vector<golden_sample> samples(in);
+    if (!golden_run_legacy_forked(&samples)) {
+        fprintf(stderr, "legacy kernel failed\n");
+        exit(1);
+    }
+    for (size_t n = 0; n < samples.size(); n++) {
+        out->filtered.push_back(samples[n].filtered);
+        out->mwi.push_back(samples[n].mwi);
+        out->flags.push_back(samples[n].flags);
+    }
+    out->has_noise = true;
+}
+
+/* Float detector and noise stage, as main.cpp runs them. */
+static void run_detector(const std::vector<golden_sample> &in, kernel_trace *out) {
+    pan_T_Detector det;
+    pan_T_Noise_State noise;
+    pan_T_Detector_Init(&det);
+    pan_T_Noise_Init(&noise);
+    for (size_t n = 0; n < in.size(); n++) {
+        float filtered;
+        bool qrs = pan_T_Detector_Process(&det, wfdb_to_input(in[n].input), &filtered);
+        bool noisy = pan_T_Noise_Update(&noise, &det);
+        out->filtered.push_back(filtered);
+        out->mwi.push_back(det.filter.mwi[0]);
+        out->flags.push_back((qrs ? GOLDEN_QRS : 0u) | (noisy ? GOLDEN_NOISY : 0u));
+    }
+    out->has_noise = true;
+}
+
+static void run_fixed(const std::vector<golden_sample> &in, kernel_trace *out) {
+    pan_T_Detector_T<pan_T_fixed> det;
+    pan_T_Noise_T<pan_T_fixed> noise;
+    pan_T_Detector_Init(&det);
+    pan_T_Noise_Init(&noise);
+    for (size_t n = 0; n < in.size(); n++) {
+        pan_T_fixed::sample filtered;
+        bool qrs = pan_T_Detector_Process(&det, pan_T_fixed::from_input(wfdb_to_input(in[n].input)), &filtered);
+        bool noisy = pan_T_Noise_Update(&noise, &det);
+        out->filtered.push_back(pan_T_fixed::to_float(filtered));
+        out->mwi.push_back(pan_T_fixed::to_float(det.filter.mwi[0]));
+        out->flags.push_back((qrs ? GOLDEN_QRS : 0u) | (noisy ? GOLDEN_NOISY : 0u));
+    }
+    out->has_noise = true;
+}
+
+/* Threshold stage of the filter variants below. */
+struct threshold_channel {
+    pan_T_Threshold_State state;
+    float thresholdi1, spki, npki;
+    delay_line<8> spki_window, npki_window;
+
+    void init() {
+        pan_T_Threshold_Init(&state);
+        thresholdi1 = spki = npki = 0.0f;
+        spki_window.clear();
+        npki_window.clear();
+    }
+
+    bool process(const float *yOut) {
+        return pan_T_Threshold(&state, yOut, &thresholdi1, &spki, &npki, &spki_window, &npki_window);
+    }
+};
+
+static void run_filter(const std::vector<golden_sample> &in, kernel_trace *out, bool generic) {
+    pan_T_Filter_State filter;
+    threshold_channel thr;
+    pan_T_Filter_Init(&filter);
+    thr.init();
+    for (size_t n = 0; n < in.size(); n++) {
+        float ain = wfdb_to_input(in[n].input);
+        float filtered = generic ? pan_T_Filter_Generic(&filter, ain) : pan_T_Filter(&filter, ain);
+        bool qrs = thr.process(filter.mwi.taps());
+        out->filtered.push_back(filtered);
+        out->mwi.push_back(filter.mwi[0]);
+        out->flags.push_back(qrs ? GOLDEN_QRS : 0u);
+    }
+    out->has_noise = false;
+}
+
+static void run_state(const std::vector<golden_sample> &in, kernel_trace *out) {
+    run_filter(in, out, false);
+}
+
+static void run_generic(const std::vector<golden_sample> &in, kernel_trace *out) {
+    run_filter(in, out, true);
+}
+
+static void run_block(const std::vector<golden_sample> &in, kernel_trace *out) {
+    std::vector<float> ain(in.size());
+    for (size_t n = 0; n < in.size(); n++) {
+        ain[n] = wfdb_to_input(in[n].input);
+    }
+    pan_T_Filter_State filter;
+    pan_T_Filter_Init(&filter);
+    out->filtered.resize(in.size());
+    out->mwi.resize(in.size());
+    pan_T_Filter_Block(&filter, ain.data(), (int) ain.size(), out->filtered.data(), out->mwi.data());
+    threshold_channel thr;
+    thr.init();
+    float yOut[3] = {0.0f, 0.0f, 0.0f};
+    for (size_t n = 0; n < in.size(); n++) {
+        yOut[2] = yOut[1];
+        yOut[1] = yOut[0];
+        yOut[0] = out->mwi[n];
+        out->flags.push_back(thr.process(yOut) ? GOLDEN_QRS : 0u);
+    }
+    out->has_noise = false;
+}
+
+static void run_multi(const std::vector<golden_sample> &in, kernel_trace *out) {
+    static pan_T_Multi group;
+    pan_T_Multi_Init(&group);
+    float lanes[PAN_T_MULTI_LANES] = {0.0f};
+    float filtered[PAN_T_MULTI_LANES];
+    for (size_t n = 0; n < in.size(); n++) {
+        lanes[0] = wfdb_to_input(in[n].input);
+        int qrs = pan_T_Multi_Process(&group, lanes, filtered);
+        out->filtered.push_back(filtered[0]);
+        out->mwi.push_back(group.mwi.row(0)[0]);
+        out->flags.push_back((qrs & 1) ? GOLDEN_QRS : 0u);
+    }
+    out->has_noise = false;
+}
+
+struct kernel {
+    const char *name;
+    kernel_fn run;
+    bool fixed;                 // Uses the fixed_* tolerances
+};
+
+static const kernel kernels[] = {
+    {"legacy", run_legacy, false},
+    {"detector", run_detector, false},
+    {"fixed", run_fixed, true},
+    {"state", run_state, false},
+    {"generic", run_generic, false},
+    {"block", run_block, false},
+    {"multi", run_multi, false},
+};
+static const int n_kernels = sizeof(kernels) / sizeof(kernels[0]);
+
+/* True if the reference flag bit has value want within slack samples of n. */
+static bool flag_near(const std::vector<golden_sample> &ref, long n, uint8_t bit, bool want, long slack) {
+    long lo = n - slack < 0 ? 0 : n - slack;
+    long hi = n + slack >= (long) ref.size() ? (long) ref.size() - 1 : n + slack;
+    for (long i = lo; i <= hi; i++) {
+        if (((ref[i].flags & bit) != 0) == want) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Compares a kernel's outputs with a trace and prints one result line.
+ * Returns false if they diverge.
+ */
+static bool compare(const char *signal, const char *kname, const std::vector<golden_sample> &ref, float fs,
+                    const kernel_trace &got, const golden_tolerance &tol, double settle_s) {
+    long settle = (long) (settle_s * fs);
+    double ref_f = 0.0, ref_m = 0.0;
+    for (size_t n = 0; n < ref.size(); n++) {
+        ref_f = fmax(ref_f, fabs(ref[n].filtered));
+        ref_m = fmax(ref_m, fabs(ref[n].mwi));
+    }
+    ref_f = ref_f > 0.0 ? ref_f : 1.0;
+    ref_m = ref_m > 0.0 ? ref_m : 1.0;
+
+    double max_f = 0.0, max_m = 0.0;
+    long flag_diffs = 0, diverged = 0, first = -1;
+    char what[128] = "";
+    for (long n = 0; n < (long) ref.size(); n++) {
+        double ef = fabs(got.filtered[n] - ref[n].filtered) / ref_f;
+        double em = fabs(got.mwi[n] - ref[n].mwi) / ref_m;
+        max_f = fmax(max_f, ef);
+        max_m = fmax(max_m, em);
+        bool bad = false;
+        if (ef > tol.filtered) {
+            bad = true;
+            if (first < 0) snprintf(what, sizeof(what), "filtered %.6g, expected %.6g", got.filtered[n], ref[n].filtered);
+        }
+        if (em > tol.mwi) {
+            if (!bad && first < 0) snprintf(what, sizeof(what), "mwi %.6g, expected %.6g", got.mwi[n], ref[n].mwi);
+            bad = true;
+        }
+        for (int b = 0; b < 2 && n >= settle; b++) {
+            uint8_t bit = b == 0 ? GOLDEN_QRS : GOLDEN_NOISY;
+            if ((bit == GOLDEN_NOISY && !got.has_noise) || ((got.flags[n] ^ ref[n].flags) & bit) == 0) {
+                continue;
+            }
+            flag_diffs++;
+            bool v = (got.flags[n] & bit) != 0;
+            if (!flag_near(ref, n, bit, v, tol.slack)) {
+                if (!bad && first < 0) {
+                    snprintf(what, sizeof(what), "%s %d, expected %d", bit == GOLDEN_QRS ? "QRS" : "noise", v, !v);
+                }
+                bad = true;
+            }
+        }
+        if (bad) {
+            diverged++;
+            if (first < 0) {
+                first = n;
+            }
+        }
+    }
+    printf("%-18s %-9s %10.2e %10.2e %8ld %8ld  ", signal, kname, max_f, max_m, flag_diffs, diverged);
+    if (first < 0) {
+        printf("ok\n");
+    } else {
+        printf("DIVERGES at sample %ld (%.3f s): %s\n", first, first / fs, what);
+    }
+    return first < 0;
+}
+
+int main(int argc, char **argv) {
+    std::string dir = "host/golden";
+    std::string kernel_list;
+    bool allow_skip = false;
+    std::vector<std::string> only;
+    bool usage = false;
+    for (int a = 1; a < argc && !usage; a++) {
+        if (strcmp(argv[a], "-S") == 0) {
+            allow_skip = true;
+        } else if (argv[a][0] == '-' && argv[a][1] != '\0' && argv[a][2] == '\0' && a + 1 < argc) {
+            const char *v = argv[++a];
+            switch (argv[a - 1][1]) {
+            case 'd': dir = v; break;
+            case 'k': kernel_list = "," + std::string(v) + ","; break;
+            default: usage = true; break;
+            }
+        } else if (argv[a][0] == '-') {
+            usage = true;
+        } else {
+            only.push_back(argv[a]);
+        }
+    }
+    if (usage) {
+        fprintf(stderr, "usage: %s [-S] [-d dir] [-k kernel,...] [signal...]\n", argv[0]);
+        return 1;
+    }
+    std::vector<golden_signal> signals;
+    if (!golden_read_manifest(dir + "/golden.txt", &signals)) {
+        return 1;
+    }
+
+    printf("%-18s %-9s %10s %10s %8s %8s\n", "signal", "kernel", "filtered", "mwi", "flags", "bad");
+    int failed = 0, checked = 0, missing_traces = 0;
+    for (size_t s = 0; s < signals.size(); s++) {
+        const golden_signal &sig = signals[s];
+        if (!golden_wanted(sig, only)) {
+            continue;
+        }
+        std::string path = dir + "/" + sig.name + ".gold";
+        golden_header h;
+        std::vector<golden_sample> ref;
+        bool missing;
+        if (!golden_read(path, &h, &ref, &missing)) {
+            if (!missing) {
+                return 1;
+            }
+            printf("%-18s %-9s not recorded (%s)%s\n", sig.name.c_str(), "-", sig.source.c_str(),
+                   allow_skip ? ", skipped" : "");
+            missing_traces++;
+            continue;
+        }
+        for (int k = 0; k < n_kernels; k++) {
+            if (!kernel_list.empty() && kernel_list.find("," + std::string(kernels[k].name) + ",") == std::string::npos) {
+                continue;
+            }
+            kernel_trace got;
+            kernels[k].run(ref, &got);
+            failed += !compare(sig.name.c_str(), kernels[k].name, ref, h.fs, got,
+                               kernels[k].fixed ? sig.fixed_tol : sig.tol, sig.settle_s);
+            checked++;
+        }
+    }
+    printf("%d of %d runs diverged, %d signals not recorded\n", failed, checked, missing_traces);
+    return failed > 0 || (missing_traces > 0 && !allow_skip) ? 1 : 0;
+}
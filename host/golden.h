@@ -0,0 +1,299 @@
+/* Golden trace format and the reference detector - host only
+ *
+ * Shared by host/golden (the checker) and host/golden_record (the
+ * recorder). A .gold file holds, for every sample of a signal, the raw
+ * input and the reference filtered value, MWI output, QRS_detected and
+ * cur_noise_state; golden.txt lists the signals, where their input comes
+ * from and the tolerances of the kernels against the reference.
+ *
+ * The reference is the per-sample code of the original main.cpp over the
+ * array API of BME463_lib.h, golden_run_legacy(). golden_record builds it
+ * against the library as it was before the optimized kernels, golden
+ * against the current one, whose array API wraps them.
+ */
+
+#ifndef _golden
+#define _golden
+
+#include "BME463_lib.h"
+#include "synth_ecg.h"
+#include "wfdb.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#define GOLDEN_MAGIC 0x444c4f47u        // "GOLD" in a little endian file
+#define GOLDEN_VERSION 1
+
+// golden_sample.flags
+#define GOLDEN_QRS 1u
+#define GOLDEN_NOISY 2u
+
+// NSR limit of the original main.cpp
+#ifndef SNR_THRESHOLD
+#define SNR_THRESHOLD 0.09
+#endif
+
+/* Header of a .gold file, followed by n golden_samples. */
+struct golden_header {
+    uint32_t magic;             // GOLDEN_MAGIC
+    uint32_t version;           // GOLDEN_VERSION
+    uint32_t sample_size;       // sizeof(golden_sample)
+    uint32_t n;                 // Samples
+    float fs;                   // Input sample rate, Hz
+    char source[108];           // source column of golden.txt it was recorded from
+};
+
+/* Reference output of one sample. */
+struct golden_sample {
+    int16_t input;              // Raw ADC value; the detector gets wfdb_to_input(input)
+    uint8_t flags;              // GOLDEN_QRS, GOLDEN_NOISY
+    uint8_t pad;
+    float filtered;
+    float mwi;
+};
+
+/* Tolerance of one kernel class on one signal. */
+struct golden_tolerance {
+    double filtered;            // Fraction of the largest |filtered|
+    double mwi;                 // Fraction of the largest mwi
+    long slack;                 // Samples a flag edge may move
+};
+
+/* A line of golden.txt. */
+struct golden_signal {
+    std::string name;
+    std::string source;
+    double settle_s;            // Start-up seconds without flag comparison
+    golden_tolerance tol;       // Float kernels
+    golden_tolerance fixed_tol; // Fixed-point kernel
+};
+
+/* Reads golden.txt; returns false, with a message, on a malformed line. */
+static inline bool golden_read_manifest(const std::string &path, std::vector<golden_signal> *out) {
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == NULL) {
+        fprintf(stderr, "cannot open %s\n", path.c_str());
+        return false;
+    }
+    char line[512];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        char name[64], source[256];
+        golden_signal s;
+        const char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0') {
+            continue;
+        }
+        if (sscanf(p, "%63s %255s %lf %lf %lf %ld %lf %lf %ld", name, source, &s.settle_s, &s.tol.filtered,
+                   &s.tol.mwi, &s.tol.slack, &s.fixed_tol.filtered, &s.fixed_tol.mwi, &s.fixed_tol.slack) != 9) {
+            fprintf(stderr, "%s:%d: expected name source settle_s filtered mwi slack fixed_filtered fixed_mwi "
+                            "fixed_slack\n", path.c_str(), lineno);
+            fclose(f);
+            return false;
+        }
+        s.name = name;
+        s.source = source;
+        out->push_back(s);
+    }
+    fclose(f);
+    return true;
+}
+
+/* True if the signal is selected by the names given on the command line. */
+static inline bool golden_wanted(const golden_signal &sig, const std::vector<std::string> &only) {
+    bool wanted = only.empty();
+    for (size_t i = 0; i < only.size(); i++) {
+        wanted = wanted || only[i] == sig.name;
+    }
+    return wanted;
+}
+
+/* Input of a source; returns false if it cannot be produced. */
+static inline bool golden_load_source(const std::string &source, const std::string &records_dir,
+                                      std::vector<golden_sample> *in, float *fs) {
+    std::vector<std::string> f;
+    size_t start = 0, colon;
+    while ((colon = source.find(':', start)) != std::string::npos) {
+        f.push_back(source.substr(start, colon - start));
+        start = colon + 1;
+    }
+    f.push_back(source.substr(start));
+    golden_sample zero;
+    memset(&zero, 0, sizeof(zero));
+
+    if (f[0] == "synth" && f.size() == 5) {
+        synth_ecg s;
+        synth_ecg_init(&s, atoi(f[1].c_str()), (float) atof(f[2].c_str()));
+        s.clean_lead_s = s.segment_s = (float) atof(f[4].c_str());
+        long n = (long) (atof(f[3].c_str()) * s.fs);
+        *fs = s.fs;
+        for (long i = 0; i < n; i++) {
+            int v = synth_ecg_next(&s);
+            zero.input = (int16_t) (v < -32768 ? -32768 : v > 32767 ? 32767 : v);
+            in->push_back(zero);
+        }
+        return true;
+    }
+    if (f[0] == "wfdb" && f.size() == 5) {
+        std::string path = records_dir + "/" + f[1];
+        wfdb_record rec;
+        wfdb_stream stream;
+        if (!wfdb_open(&rec, path.c_str()) || !wfdb_stream_open(&stream, &rec, atoi(f[2].c_str()))) {
+            return false;
+        }
+        *fs = (float) rec.fs;
+        wfdb_stream_seek(&stream, (long) (atof(f[3].c_str()) * rec.fs));
+        long n = (long) (atof(f[4].c_str()) * rec.fs);
+        std::vector<int> raw(n);
+        long got = 0, step;
+        while (got < n && (step = wfdb_stream_read(&stream, raw.data() + got, n - got)) > 0) {
+            got += step;
+        }
+        wfdb_stream_close(&stream);
+        for (long i = 0; i < got; i++) {
+            zero.input = (int16_t) raw[i];
+            in->push_back(zero);
+        }
+        return got > 0;
+    }
+    fprintf(stderr, "unknown source %s\n", source.c_str());
+    return false;
+}
+
+static inline bool golden_write(const std::string &path, const std::string &source, float fs,
+                                const std::vector<golden_sample> &samples) {
+    golden_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic = GOLDEN_MAGIC;
+    h.version = GOLDEN_VERSION;
+    h.sample_size = sizeof(golden_sample);
+    h.n = (uint32_t) samples.size();
+    h.fs = fs;
+    strncpy(h.source, source.c_str(), sizeof(h.source) - 1);
+    FILE *f = fopen(path.c_str(), "wb");
+    if (f == NULL) {
+        fprintf(stderr, "cannot write %s\n", path.c_str());
+        return false;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(samples.data(), sizeof(golden_sample), samples.size(), f) == samples.size();
+    return fclose(f) == 0 && ok;
+}
+
+/* Reads a trace; returns false if it is missing, and prints why if it is invalid. */
+static inline bool golden_read(const std::string &path, golden_header *h, std::vector<golden_sample> *samples,
+                               bool *missing) {
+    FILE *f = fopen(path.c_str(), "rb");
+    *missing = f == NULL;
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fread(h, sizeof(*h), 1, f) == 1 && h->magic == GOLDEN_MAGIC && h->version == GOLDEN_VERSION &&
+              h->sample_size == sizeof(golden_sample);
+    if (ok) {
+        samples->resize(h->n);
+        ok = fread(samples->data(), sizeof(golden_sample), h->n, f) == h->n;
+    }
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "%s: not a version %d golden trace\n", path.c_str(), GOLDEN_VERSION);
+    }
+    return ok;
+}
+
+/* Runs the main loop body of the original main.cpp over the inputs of
+ * samples and stores its outputs in them: pan_T_Filter(Ain, yOut) and
+ * pan_T_Threshold() on the spki/npki arrays, then the NSR test and the
+ * restore of the last clean arrays on a noisy to clean transition. The
+ * array API keeps the filter and threshold state in function statics, so a
+ * process can run one signal; golden_run_legacy_forked() runs each in a
+ * child.
+ */
+static inline void golden_run_legacy(std::vector<golden_sample> *samples) {
+    float output[3] = {0.0, 0.0, 0.0};
+    float npki = 0.0, spki = 0.0;
+    float npki_array[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    float spki_array[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    float spki_array_clean[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    float npki_array_clean[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    float thresholdi1 = 0.0;
+    bool prev_noise_state = false;
+    for (size_t n = 0; n < samples->size(); n++) {
+        golden_sample *s = &(*samples)[n];
+        float filter_splice = pan_T_Filter(wfdb_to_input(s->input), output);
+        bool QRS_detected = pan_T_Threshold(output, &thresholdi1, &spki, &npki, spki_array, npki_array);
+
+        float NSR = npki / sqrt(npki * npki + spki * spki);
+        bool cur_noise_state = NSR > SNR_THRESHOLD;
+        if (!cur_noise_state) {
+            save_array(npki_array, npki_array_clean, 8);
+            save_array(spki_array, spki_array_clean, 8);
+        }
+        if (!cur_noise_state && prev_noise_state) {
+            save_array(npki_array_clean, npki_array, 8);
+            save_array(spki_array_clean, spki_array, 8);
+            spki = array_average(spki_array, 8);
+            npki = array_average(npki_array, 8);
+        }
+        prev_noise_state = cur_noise_state;
+
+        s->filtered = filter_splice;
+        s->mwi = output[0];
+        s->flags = (uint8_t) ((QRS_detected ? GOLDEN_QRS : 0u) | (cur_noise_state ? GOLDEN_NOISY : 0u));
+    }
+}
+
+/* golden_run_legacy() in a child process, so the signal starts from the
+ * zero state of a fresh process; the child returns the samples through a
+ * pipe. Returns false if the child could not run or failed.
+ */
+static inline bool golden_run_legacy_forked(std::vector<golden_sample> *samples) {
+    int fd[2];
+    if (pipe(fd) != 0) {
+        perror("pipe");
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(fd[0]);
+        close(fd[1]);
+        return false;
+    }
+    size_t left = samples->size() * sizeof(golden_sample);
+    if (pid == 0) {
+        close(fd[0]);
+        golden_run_legacy(samples);
+        const char *p = (const char *) samples->data();
+        while (left > 0) {
+            ssize_t put = write(fd[1], p, left);
+            if (put <= 0) {
+                _exit(1);
+            }
+            p += put;
+            left -= (size_t) put;
+        }
+        _exit(0);
+    }
+    close(fd[1]);
+    char *p = (char *) samples->data();
+    ssize_t got;
+    while (left > 0 && (got = read(fd[0], p, left)) > 0) {
+        p += got;
+        left -= (size_t) got;
+    }
+    close(fd[0]);
+    int status;
+    return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0 && left == 0;
+}
+
+#endif
@@ -0,0 +1,102 @@
+/* Golden trace recorder - host only
+ *
+ * Records the reference traces host/golden checks the kernels against
+ * (see golden.h and host/golden.cpp): for every signal of golden.txt, its
+ * input from the source column and the outputs of the original main.cpp
+ * loop, golden_run_legacy(), in a fresh process per signal.
+ *
+ * The reference is meant to be the detector as it was before the optimized
+ * kernels, so build this tool against that library: baseline commit
+ * 0bd993e, whose BME463_lib.h has the same array API. Built against the
+ * current library it records the current array API instead, which is only
+ * useful to look at a difference.
+ *
+ * A source that cannot be read (a record not under -p) is recorded again
+ * from the input stored in its existing trace, if that trace was recorded
+ * from the same source. Only record after a change that is meant to alter
+ * the reference, and commit the new traces with it.
+ *
+ * Build (from the repository root):
+ *   mkdir -p /tmp/pan_T_base && git show 0bd993e:BME463_lib.h > /tmp/pan_T_base/BME463_lib.h
+ *   git show 0bd993e:BME463_lib.cpp > /tmp/pan_T_base/BME463_lib.cpp
+ *   g++ -O2 -I/tmp/pan_T_base -I. host/golden_record.cpp host/wfdb.cpp /tmp/pan_T_base/BME463_lib.cpp -o golden_record
+ *
+ * Usage:
+ *   ./golden_record [-d dir] [-p records_dir] [signal...]
+ *
+ *   dir         := directory of golden.txt and the .gold traces, default host/golden
+ *   records_dir := directory the wfdb sources are relative to, default dir
+ *   signal      := names from golden.txt to record, default all
+ */
+
+#include "golden.h"
+
+int main(int argc, char **argv) {
+    std::string dir = "host/golden";
+    std::string records_dir;
+    std::vector<std::string> only;
+    bool usage = false;
+    for (int a = 1; a < argc && !usage; a++) {
+        if (argv[a][0] == '-' && argv[a][1] != '\0' && argv[a][2] == '\0' && a + 1 < argc) {
+            const char *v = argv[++a];
+            switch (argv[a - 1][1]) {
+            case 'd': dir = v; break;
+            case 'p': records_dir = v; break;
+            default: usage = true; break;
+            }
+        } else if (argv[a][0] == '-') {
+            usage = true;
+        } else {
+            only.push_back(argv[a]);
+        }
+    }
+    if (usage) {
+        fprintf(stderr, "usage: %s [-d dir] [-p records_dir] [signal...]\n", argv[0]);
+        return 1;
+    }
+    if (records_dir.empty()) {
+        records_dir = dir;
+    }
+    std::vector<golden_signal> signals;
+    if (!golden_read_manifest(dir + "/golden.txt", &signals)) {
+        return 1;
+    }
+
+    int recorded = 0, failed = 0;
+    for (size_t s = 0; s < signals.size(); s++) {
+        const golden_signal &sig = signals[s];
+        if (!golden_wanted(sig, only)) {
+            continue;
+        }
+        std::string path = dir + "/" + sig.name + ".gold";
+        std::vector<golden_sample> samples;
+        float fs;
+        if (!golden_load_source(sig.source, records_dir, &samples, &fs)) {
+            golden_header h;
+            bool missing;
+            samples.clear();
+            if (!golden_read(path, &h, &samples, &missing) || sig.source != h.source) {
+                fprintf(stderr, "%s: source %s not available, not recorded\n", sig.name.c_str(), sig.source.c_str());
+                failed++;
+                continue;
+            }
+            fs = h.fs;
+            printf("%s: source not available, using the input stored in the trace\n", sig.name.c_str());
+        }
+        if (!golden_run_legacy_forked(&samples) || !golden_write(path, sig.source, fs, samples)) {
+            fprintf(stderr, "%s: not recorded\n", sig.name.c_str());
+            failed++;
+            continue;
+        }
+        long beats = 0, noisy = 0;
+        for (size_t n = 0; n < samples.size(); n++) {
+            beats += (samples[n].flags & GOLDEN_QRS) && (n == 0 || !(samples[n - 1].flags & GOLDEN_QRS));
+            noisy += (samples[n].flags & GOLDEN_NOISY) != 0;
+        }
+        printf("%s: %zu samples from %s, %ld QRS, %.1f%% noisy\n", path.c_str(), samples.size(), sig.source.c_str(),
+               beats, 100.0 * noisy / samples.size());
+        recorded++;
+    }
+    printf("%d traces recorded, %d failed\n", recorded, failed);
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,350 @@
+/* Pipe loopback of the sender/receiver serial link - host only
+ *
+ * Stands in for the UART between the boards with a pipe: a sender thread
+ * writes the samples into it, paced at the baud rate (-B, 10 bits per
+ * byte, 0 for unpaced), and a receiver thread reads whatever has arrived,
+ * like RXfxn() draining the UART, and decodes it. Both protocols run over
+ * the same samples, one after the other:
+ *
+ *  - 3-byte: low, high, '\0' per sample, decoded exactly as main.cpp does
+ *    without PAN_T_FRAMED_LINK;
+ *  - framed: link frames of -F samples (link_frame.h), decoded with
+ *    link_decode_byte().
+ *
+ * The sender reads a new sample every 1/-r s (0 makes all samples available
+ * at once, so the link is the bottleneck) and transmits a frame once its
+ * last sample is read. -e drops and -c corrupts (one random bit) each byte
+ * with the given probability before it enters the pipe.
+ *
+ * For each protocol it reports the bytes per sample, the sustained rate of
+ * decoded samples, how many samples arrived intact, arrived with a wrong
+ * value or were lost, and the latency from the moment a sample was read to
+ * the moment the receiver decoded it. Unpaced (-B 0 -r 0), the rate is
+ * bounded by one write() per frame, so it mostly shows the per-frame cost.
+ *
+ * Before the runs it feeds the framed decoder blocks of back-to-back false
+ * sync pairs, A5 5A seq count with the count 2 lower at every pair, so the
+ * frame each pair claims ends where the first one does and fails its CRC
+ * while the decoder is dropping the enclosing one. Then come valid frames.
+ * It reports the deepest stack the decoder used with 1 and with 16 pairs
+ * per block (the deepest nesting a 32-sample frame allows). The two must be
+ * equal and the valid frames must be decoded; otherwise the exit status
+ * is 1.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -pthread -I. host/link_loopback.cpp host/wfdb.cpp link_frame.cpp stack_watermark.cpp -o link_loopback
+ *
+ * Usage:
+ *   ./link_loopback [-n samples] [-r rate] [-B baud] [-F frame] [-e drop] [-c corrupt] [-s signal] [record]
+ */
+
+#include "link_frame.h"
+#include "stack_watermark.h"
+#include "synth_ecg.h"
+#include "wfdb.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+typedef std::chrono::steady_clock link_clock;
+
+struct link_options {
+    double rate;        // Samples per second read by the sender, 0 for all at once
+    double baud;        // 0 for unpaced
+    int frame;          // Samples per link frame
+    double drop;        // Byte drop probability
+    double corrupt;     // Byte corruption probability
+};
+
+/* Shared by the sender and receiver threads of one run. The pipe orders the
+ * sender's writes to owner before the receiver's reads of the same bytes.
+ */
+struct link_run {
+    const std::vector<int16_t> *in;
+    const link_options *opt;
+    bool framed;
+    int fd[2];
+    link_clock::time_point t0;
+    std::vector<long> owner;        // Sample index of the last sample of each written byte's frame,
+                                    // sized for the worst case so it never moves
+
+    // Receiver results
+    std::vector<bool> delivered;
+    long intact;
+    long wrong;
+    double latency_sum;
+    double latency_max;
+    double elapsed;
+    long bytes_written;
+    link_decoder link;
+};
+
+/* Time at which sample k has been read by the sender. */
+static link_clock::time_point sample_time(const link_run *run, long k) {
+    return run->t0 + std::chrono::duration_cast<link_clock::duration>(
+                         std::chrono::duration<double>(run->opt->rate > 0 ? k / run->opt->rate : 0.0));
+}
+
+static void sender(link_run *run) {
+    const std::vector<int16_t> &in = *run->in;
+    const link_options &opt = *run->opt;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    double byte_s = opt.baud > 0 ? 10.0 / opt.baud : 0.0;
+    link_clock::time_point line_free = run->t0;
+    int per_frame = run->framed ? opt.frame : 1;
+    uint8_t seq = 0;
+    std::vector<uint8_t> chunk;
+    for (long k0 = 0; k0 < (long) in.size(); k0 += per_frame) {
+        int count = (int) std::min<long>(per_frame, in.size() - k0);
+        long last = k0 + count - 1;
+        uint8_t frame[LINK_FRAME_MAX];
+        int len;
+        if (run->framed) {
+            link_frame f;
+            f.seq = seq++;
+            f.count = (uint8_t) count;
+            std::copy(in.begin() + k0, in.begin() + k0 + count, f.samples);
+            len = link_encode(&f, frame);
+        } else {
+            frame[0] = (uint8_t) (in[k0] & 0xFF);
+            frame[1] = (uint8_t) ((in[k0] >> 8) & 0xFF);
+            frame[2] = 0;
+            len = 3;
+        }
+
+        // The frame leaves when its last sample is read and the line is free,
+        // and takes len byte times.
+        link_clock::time_point start = std::max(sample_time(run, last), line_free);
+        line_free = start + std::chrono::duration_cast<link_clock::duration>(std::chrono::duration<double>(len * byte_s));
+        std::this_thread::sleep_until(line_free);
+
+        chunk.clear();
+        for (int j = 0; j < len; j++) {
+            if (opt.drop > 0 && u(rng) < opt.drop) {
+                continue;
+            }
+            uint8_t b = frame[j];
+            if (opt.corrupt > 0 && u(rng) < opt.corrupt) {
+                b ^= (uint8_t) (1u << (rng() & 7));
+            }
+            run->owner[run->bytes_written + (long) chunk.size()] = last;
+            chunk.push_back(b);
+        }
+        if (!chunk.empty() && write(run->fd[1], chunk.data(), chunk.size()) != (ssize_t) chunk.size()) {
+            perror("write");
+            break;
+        }
+        run->bytes_written += (long) chunk.size();
+    }
+    close(run->fd[1]);
+}
+
+/* Records sample k with value v as decoded now. */
+static void deliver(link_run *run, long k, int16_t v, link_clock::time_point now) {
+    if (k < 0 || k >= (long) run->in->size() || (*run->in)[k] != v) {
+        run->wrong++;
+        return;
+    }
+    if (run->delivered[k]) {
+        return;
+    }
+    run->delivered[k] = true;
+    run->intact++;
+    double lat = std::chrono::duration<double, std::micro>(now - sample_time(run, k)).count();
+    run->latency_sum += lat;
+    run->latency_max = std::max(run->latency_max, lat);
+}
+
+static void receiver(link_run *run) {
+    // The globals of main.cpp's 3-byte decoder
+    union {
+        short s;
+        char h[sizeof(short)];
+    } data;
+    unsigned i = 0;
+
+    link_decoder_init(&run->link);
+    uint8_t buf[256];
+    long consumed = 0;
+    ssize_t got;
+    while ((got = read(run->fd[0], buf, sizeof(buf))) > 0) {
+        link_clock::time_point now = link_clock::now();
+        for (ssize_t b = 0; b < got; b++, consumed++) {
+            long last = run->owner[consumed];
+            if (run->framed) {
+                if (link_decode_byte(&run->link, buf[b])) {
+                    const link_frame &f = run->link.frame;
+                    for (int s = 0; s < f.count; s++) {
+                        deliver(run, last - (f.count - 1 - s), f.samples[s], now);
+                    }
+                }
+                continue;
+            }
+            char d = (char) buf[b];
+            if (d == '\0' && i >= sizeof(short)) {
+                i = 0;
+                deliver(run, last, (int16_t) data.s, now);
+            } else if (i < sizeof(short)) {
+                data.h[i++] = d;
+            }
+        }
+    }
+    run->elapsed = std::chrono::duration<double>(link_clock::now() - run->t0).count();
+}
+
+static bool run_link(link_run *run) {
+    if (pipe(run->fd) != 0) {
+        perror("pipe");
+        return false;
+    }
+    size_t n = run->in->size();
+    run->owner.assign(LINK_FRAME_LEN(1) * n, 0);   // One-sample frames are the longest encoding
+    run->delivered.assign(n, false);
+    run->intact = run->wrong = 0;
+    run->latency_sum = run->latency_max = 0.0;
+    run->bytes_written = 0;
+    run->t0 = link_clock::now();
+    std::thread r(receiver, run);
+    std::thread s(sender, run);
+    s.join();
+    r.join();
+    close(run->fd[0]);
+    return true;
+}
+
+/* Decodes 256 blocks of pairs nested false sync pairs, then three valid
+ * frames, and returns the deepest stack use below this function, in bytes;
+ * *frames receives the frames decoded.
+ */
+static uint32_t false_sync_stack(int pairs, uint32_t *frames) {
+    std::vector<uint8_t> bytes;
+    for (int block = 0; block < 256; block++) {
+        size_t start = bytes.size();
+        for (int p = 0; p < pairs; p++) {
+            const uint8_t pair[] = {LINK_SYNC0, LINK_SYNC1, 0, (uint8_t) (LINK_MAX_SAMPLES - 2 * p)};
+            bytes.insert(bytes.end(), pair, pair + sizeof(pair));
+        }
+        bytes.resize(start + LINK_FRAME_MAX, 0);    // Up to the end of the first pair's frame
+    }
+    for (int k = 0; k < 3; k++) {
+        link_frame f;
+        f.seq = (uint8_t) k;
+        f.count = LINK_MAX_SAMPLES;
+        std::fill(f.samples, f.samples + f.count, (int16_t) 0x5AA5);
+        uint8_t frame[LINK_FRAME_MAX];
+        int len = link_encode(&f, frame);
+        bytes.insert(bytes.end(), frame, frame + len);
+    }
+    link_decoder dec;
+    link_decoder_init(&dec);
+    stack_watermark w;
+    stack_paint(&w, 16384);
+    for (size_t b = 0; b < bytes.size(); b++) {
+        link_decode_byte(&dec, bytes[b]);
+    }
+    uint32_t used = stack_high_water(&w);
+    *frames = dec.frames;
+    return used;
+}
+
+static void print_run(const char *name, const link_run *run) {
+    long n = (long) run->in->size();
+    printf("%-8s %7.3f %10.0f %9ld %7ld %7ld %10.1f %10.1f\n", name, (double) run->bytes_written / n,
+           run->intact / run->elapsed, run->intact, run->wrong, n - run->intact,
+           run->intact ? run->latency_sum / run->intact : 0.0, run->latency_max);
+}
+
+int main(int argc, char **argv) {
+    link_options opt = {360.0, 115200.0, 16, 0.0, 0.0};
+    long n = 3600;
+    int signal = 0;
+    const char *record = NULL;
+    for (int a = 1; a < argc; a++) {
+        if (argv[a][0] == '-' && argv[a][1] != '\0' && argv[a][2] == '\0' && a + 1 < argc) {
+            const char *v = argv[++a];
+            switch (argv[a - 1][1]) {
+            case 'n': n = atol(v); break;
+            case 'r': opt.rate = atof(v); break;
+            case 'B': opt.baud = atof(v); break;
+            case 'F': opt.frame = std::min(std::max(atoi(v), 1), LINK_MAX_SAMPLES); break;
+            case 'e': opt.drop = atof(v); break;
+            case 'c': opt.corrupt = atof(v); break;
+            case 's': signal = atoi(v); break;
+            default:
+                fprintf(stderr, "usage: %s [-n samples] [-r rate] [-B baud] [-F frame] [-e drop] [-c corrupt] [-s signal] [record]\n", argv[0]);
+                return 1;
+            }
+        } else {
+            record = argv[a];
+        }
+    }
+
+    // The ADC values the sender transmits
+    std::vector<int16_t> in;
+    if (record != NULL) {
+        wfdb_record rec;
+        wfdb_stream stream;
+        if (!wfdb_open(&rec, record) || !wfdb_stream_open(&stream, &rec, signal)) {
+            return 1;
+        }
+        std::vector<int> raw(n);
+        long got = wfdb_stream_read(&stream, raw.data(), n);
+        wfdb_stream_close(&stream);
+        in.assign(raw.begin(), raw.begin() + (got > 0 ? got : 0));
+    } else {
+        synth_ecg gen;
+        synth_ecg_init(&gen, 0, 0.0f);
+        for (long k = 0; k < n; k++) {
+            in.push_back((int16_t) synth_ecg_next(&gen));
+        }
+    }
+    if (in.empty()) {
+        fprintf(stderr, "no input samples\n");
+        return 1;
+    }
+
+    printf("%ld samples, %s, %s, drop %g, corrupt %g\n", (long) in.size(),
+           opt.rate > 0 ? "paced sampling" : "all samples ready", opt.baud > 0 ? "paced baud" : "unpaced", opt.drop,
+           opt.corrupt);
+    if (opt.rate > 0) {
+        printf("sampling %.0f Hz\n", opt.rate);
+    }
+    if (opt.baud > 0) {
+        printf("baud %.0f, framed link %d samples per frame\n", opt.baud, opt.frame);
+    }
+    uint32_t frames_one, frames_many;
+    uint32_t stack_one = false_sync_stack(1, &frames_one);
+    uint32_t stack_many = false_sync_stack(LINK_MAX_SAMPLES / 2, &frames_many);
+    printf("false sync pairs: 1 -> %u frames, %u stack bytes; %d -> %u frames, %u stack bytes\n", frames_one,
+           stack_one, LINK_MAX_SAMPLES / 2, frames_many, stack_many);
+    if (stack_many != stack_one || frames_one < 2 || frames_many < 2) {
+        fprintf(stderr, "framed decoder: stack use grows with false sync pairs or valid frames were lost\n");
+        return 1;
+    }
+    printf("%-8s %7s %10s %9s %7s %7s %10s %10s\n", "link", "B/samp", "samples/s", "intact", "wrong", "lost",
+           "mean us", "max us");
+
+    link_run run;
+    run.in = &in;
+    run.opt = &opt;
+    run.framed = false;
+    if (!run_link(&run)) {
+        return 1;
+    }
+    print_run("3-byte", &run);
+
+    run.framed = true;
+    if (!run_link(&run)) {
+        return 1;
+    }
+    print_run("framed", &run);
+    printf("framed decoder: frames %u, crc errors %u, bad headers %u, lost frames %u, skipped bytes %u\n",
+           run.link.frames, run.link.crc_errors, run.link.bad_headers, run.link.lost_frames, run.link.skipped_bytes);
+    return 0;
+}
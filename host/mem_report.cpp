@@ -0,0 +1,216 @@
+/* RAM and flash budget of the receiver build - host only
+ *
+ * The F303K8 has 64 KiB of flash and 12 KiB of SRAM, shared by the static
+ * data (.data, which is also stored in flash, and .bss), the heap of the
+ * mbed library and the stack. This tool reports:
+ *
+ *  - the size of the per-channel detector state main.cpp keeps (detector
+ *    and noise state, float and fixed point, at the default rate and
+ *    decimated from SAMP_RATE), and of its fixed buffers;
+ *  - with object files or a linked image of the board build as arguments,
+ *    the text, rodata, data and bss of every module, with
+ *    flash = text + rodata + data and RAM = data + bss;
+ *  - how many more channels fit in the RAM budget (-r, default the 12288
+ *    bytes of the part) once the static RAM and a stack reserve (-k,
+ *    default 2048) are taken off. Without ELF files the static RAM is the
+ *    sum of main.cpp's buffers and one channel, which leaves out the mbed
+ *    library's own data.
+ *
+ * The structure sizes are the host's: the detector state holds no pointers,
+ * so they equal the board's; rt_stats and spsc_queue may differ by a few
+ * bytes of padding. The stack figure to use for -k is the high-water mark
+ * main.cpp measures in a -DPAN_T_RT_STATS build (stack_used, see
+ * stack_watermark.h) plus a margin.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -I. host/mem_report.cpp -o mem_report
+ *
+ * Usage:
+ *   ./mem_report [-r ram_bytes] [-k stack_bytes] [file.o | image.elf]...
+ *
+ *   file.o    := object files of the board build (arm-none-eabi-g++ -c), one row each
+ *   image.elf := the linked image, one row for the whole program
+ */
+
+#include "BME463_lib.h"
+#include "decimator.h"
+#include "flight_rec.h"
+#include "link_frame.h"
+#include "receiver_config.h"
+#include "rt_stats.h"
+#include "spsc_queue.h"
+#include "stack_watermark.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* Allocated bytes of one ELF file by kind. */
+struct elf_sizes {
+    unsigned long text;
+    unsigned long rodata;
+    unsigned long data;
+    unsigned long bss;
+};
+
+static bool read_file(const char *path, std::vector<unsigned char> *out) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    unsigned char buf[65536];
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), f)) > 0) {
+        out->insert(out->end(), buf, buf + got);
+    }
+    fclose(f);
+    return true;
+}
+
+/* Little endian field of n bytes at data[pos]. */
+static unsigned long long field(const std::vector<unsigned char> &data, size_t pos, int n) {
+    unsigned long long v = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        v = (v << 8) | data[pos + i];
+    }
+    return v;
+}
+
+/* Sums the SHF_ALLOC sections of an ELF32 or ELF64 little endian file by
+ * their flags: executable = text, writable and SHT_NOBITS = bss, writable =
+ * data, the rest rodata. Returns false if the file is not such an ELF.
+ */
+static bool elf_section_sizes(const std::vector<unsigned char> &data, elf_sizes *out) {
+    const unsigned SHT_NOBITS = 8;
+    const unsigned long long SHF_WRITE = 1, SHF_ALLOC = 2, SHF_EXECINSTR = 4;
+    memset(out, 0, sizeof(*out));
+    if (data.size() < 52 || memcmp(&data[0], "\177ELF", 4) != 0 || data[5] != 1) {
+        return false;
+    }
+    bool is64 = data[4] == 2;
+    int w = is64 ? 8 : 4;
+    size_t shoff = (size_t) field(data, is64 ? 0x28 : 0x20, w);
+    size_t shentsize = (size_t) field(data, is64 ? 0x3A : 0x2E, 2);
+    size_t shnum = (size_t) field(data, is64 ? 0x3C : 0x30, 2);
+    if (shoff == 0 || shoff + shnum * shentsize > data.size()) {
+        return false;
+    }
+    for (size_t s = 0; s < shnum; s++) {
+        size_t sh = shoff + s * shentsize;
+        unsigned type = (unsigned) field(data, sh + 4, 4);
+        unsigned long long flags = field(data, sh + 8, w);
+        unsigned long size = (unsigned long) field(data, sh + (is64 ? 0x20 : 0x14), w);
+        if (!(flags & SHF_ALLOC)) {
+            continue;
+        }
+        if (flags & SHF_EXECINSTR) {
+            out->text += size;
+        } else if (type == SHT_NOBITS) {
+            out->bss += size;
+        } else if (flags & SHF_WRITE) {
+            out->data += size;
+        } else {
+            out->rodata += size;
+        }
+    }
+    return true;
+}
+
+static void print_size(const char *name, size_t bytes) {
+    printf("  %-44s %6zu\n", name, bytes);
+}
+
+/* Detector and noise state of one channel, printed by part. */
+template <typename Ops, typename Rate>
+static size_t channel_size(const char *label) {
+    size_t det = sizeof(pan_T_Detector_T<Ops, Rate>);
+    size_t noise = sizeof(pan_T_Noise_T<Ops>);
+    printf("  %-20s %4d Hz %9zu %9zu %9zu\n", label, (int) Rate::fs, det, noise, det + noise);
+    return det + noise;
+}
+
+int main(int argc, char **argv) {
+    long ram = 12288;
+    long stack_reserve = 2048;
+    std::vector<const char *> files;
+    bool usage = false;
+    for (int a = 1; a < argc && !usage; a++) {
+        if (argv[a][0] == '-' && argv[a][1] != '\0' && argv[a][2] == '\0' && a + 1 < argc) {
+            const char *v = argv[++a];
+            switch (argv[a - 1][1]) {
+            case 'r': ram = atol(v); break;
+            case 'k': stack_reserve = atol(v); break;
+            default: usage = true; break;
+            }
+        } else if (argv[a][0] == '-') {
+            usage = true;
+        } else {
+            files.push_back(argv[a]);
+        }
+    }
+    if (usage) {
+        fprintf(stderr, "usage: %s [-r ram_bytes] [-k stack_bytes] [file.o | image.elf]...\n", argv[0]);
+        return 1;
+    }
+
+    printf("Per-channel state (bytes)\n");
+    printf("  %-20s %7s %9s %9s %9s\n", "", "rate", "detector", "noise", "channel");
+    size_t channel = channel_size<pan_T_float, pan_T_default_rate>("float");
+    channel_size<pan_T_fixed, pan_T_default_rate>("fixed");
+    channel_size<pan_T_float, pan_T_rate<SAMP_RATE / 2> >("float, decimate 2");
+    channel_size<pan_T_fixed, pan_T_rate<SAMP_RATE / 2> >("fixed, decimate 2");
+    channel_size<pan_T_float, pan_T_rate<SAMP_RATE> >("float, native rate");
+
+    printf("\nmain.cpp buffers (bytes)\n");
+    size_t fixed = 0;
+    print_size("rx_bytes", sizeof(spsc_queue<uint8_t, RX_QUEUE_LEN>));
+    fixed += sizeof(spsc_queue<uint8_t, RX_QUEUE_LEN>);
+    print_size("samples", sizeof(spsc_queue<timed_sample, SAMPLE_QUEUE_LEN>));
+    fixed += sizeof(spsc_queue<timed_sample, SAMPLE_QUEUE_LEN>);
+    print_size("playout (PAN_T_FRAMED_LINK)", sizeof(spsc_queue<int16_t, PLAYOUT_QUEUE_LEN>));
+    print_size("link (PAN_T_FRAMED_LINK)", sizeof(link_decoder));
+    print_size("rt (PAN_T_RT_STATS)", sizeof(rt_stats));
+    print_size("stack (PAN_T_RT_STATS)", sizeof(stack_watermark));
+    print_size("flight (PAN_T_FLIGHT_REC)", sizeof(flight_rec));
+    print_size("front_end (PAN_T_DECIMATE=2, stack)", sizeof(decimator<2>));
+    print_size("default build: rx_bytes + samples", fixed);
+
+    long used = (long) (fixed + channel);
+    if (!files.empty()) {
+        printf("\nModules (bytes)\n");
+        printf("  %-28s %7s %7s %7s %7s %7s %7s\n", "file", "text", "rodata", "data", "bss", "flash", "RAM");
+        elf_sizes total;
+        memset(&total, 0, sizeof(total));
+        for (size_t f = 0; f < files.size(); f++) {
+            std::vector<unsigned char> data;
+            elf_sizes s;
+            if (!read_file(files[f], &data)) {
+                return 1;
+            }
+            if (!elf_section_sizes(data, &s)) {
+                fprintf(stderr, "%s: not a little endian ELF file\n", files[f]);
+                return 1;
+            }
+            std::string name(files[f]);
+            size_t slash = name.find_last_of('/');
+            name = slash == std::string::npos ? name : name.substr(slash + 1);
+            printf("  %-28s %7lu %7lu %7lu %7lu %7lu %7lu\n", name.c_str(), s.text, s.rodata, s.data, s.bss,
+                   s.text + s.rodata + s.data, s.data + s.bss);
+            total.text += s.text;
+            total.rodata += s.rodata;
+            total.data += s.data;
+            total.bss += s.bss;
+        }
+        printf("  %-28s %7lu %7lu %7lu %7lu %7lu %7lu\n", "TOTAL", total.text, total.rodata, total.data, total.bss,
+               total.text + total.rodata + total.data, total.data + total.bss);
+        used = (long) (total.data + total.bss);
+    }
+
+    long left = ram - stack_reserve - used;
+    printf("\nRAM budget: %ld bytes - %ld stack - %ld static = %ld free\n", ram, stack_reserve, used, left);
+    printf("room for %ld more float channels at %d Hz (%zu bytes each)\n", left > 0 ? left / (long) channel : 0L,
+           (int) pan_T_default_rate::fs, channel);
+    return left >= 0 ? 0 : 2;
+}
@@ -0,0 +1,166 @@
+/* Noise classification and beat detection metrics - host only
+ *
+ * Scores the detector the way the README's "Testing Metrics" section does:
+ * every sample of a MIT-BIH Noise Stress Test record is known to be clean
+ * (the lead-in and every other segment) or noisy, and cur_noise_state is
+ * counted as a true/false positive/negative against it. TPR, FPR, TNR and
+ * FNR are the duty ratios measured on the scope.
+ *
+ * Beat detection is scored against the reference beat annotations: a QRS
+ * detection (rising edge of QRS_detected) matches an annotated beat if it
+ * starts within [beat - pre, beat + post] samples. Each detection matches
+ * at most one beat.
+ *
+ * The tools that score a corpus this way also share how they take their
+ * records and matching window from the command line.
+ */
+
+#ifndef _nst_metrics
+#define _nst_metrics
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Clean/noisy schedule of a noise stress test record.
+ */
+typedef struct _nst_schedule {
+    double clean_lead_s;    // Clean lead-in, s (300 in the NST records)
+    double segment_s;       // Alternating noisy/clean segment length, s (120)
+    float fs;
+} nst_schedule;
+
+static inline bool nst_noisy(const nst_schedule *s, long n) {
+    double t = n / (double) s->fs - s->clean_lead_s;
+    return t >= 0.0 && ((long) (t / s->segment_s) % 2) == 0;
+}
+
+/**
+ * @brief Confusion counts of the noise classification, in samples.
+ */
+typedef struct _nst_confusion {
+    long tp;    // Noisy and classified noisy
+    long fn;    // Noisy and classified clean
+    long fp;    // Clean and classified noisy
+    long tn;    // Clean and classified clean
+} nst_confusion;
+
+static inline void nst_confusion_add(nst_confusion *c, bool expected_noisy, bool classified_noisy) {
+    if (expected_noisy) {
+        if (classified_noisy) c->tp++; else c->fn++;
+    } else {
+        if (classified_noisy) c->fp++; else c->tn++;
+    }
+}
+
+static inline void nst_confusion_merge(nst_confusion *into, const nst_confusion *c) {
+    into->tp += c->tp;
+    into->fn += c->fn;
+    into->fp += c->fp;
+    into->tn += c->tn;
+}
+
+static inline double nst_ratio(long a, long b) {
+    return a + b > 0 ? (double) a / (double) (a + b) : 0.0;
+}
+
+static inline double nst_tpr(const nst_confusion *c) { return nst_ratio(c->tp, c->fn); }
+static inline double nst_fnr(const nst_confusion *c) { return nst_ratio(c->fn, c->tp); }
+static inline double nst_fpr(const nst_confusion *c) { return nst_ratio(c->fp, c->tn); }
+static inline double nst_tnr(const nst_confusion *c) { return nst_ratio(c->tn, c->fp); }
+
+/**
+ * @brief Beat detection counts.
+ */
+typedef struct _nst_beats {
+    long tp;    // Annotated beats with a matching detection
+    long fn;    // Annotated beats without one
+    long fp;    // Detections not matching any beat
+} nst_beats;
+
+/**
+ * @brief Matches QRS detections against annotated beats.
+ *
+ * @param beats Beat sample indices, ascending.
+ * @param nbeats Number of beats.
+ * @param det Detection onset sample indices, ascending.
+ * @param ndet Number of detections.
+ * @param pre Samples a detection may precede its beat by.
+ * @param post Samples a detection may follow its beat by.
+ * @param matched Optional, receives for every beat the index of its detection or -1.
+ */
+static inline nst_beats nst_match_beats(const long *beats, long nbeats, const long *det, long ndet,
+                                        long pre, long post, long *matched) {
+    nst_beats r = {0, 0, 0};
+    long j = 0;
+    for (long i = 0; i < nbeats; i++) {
+        while (j < ndet && det[j] < beats[i] - pre) {
+            r.fp++;     // Too early for this beat and every later one
+            j++;
+        }
+        if (j < ndet && det[j] <= beats[i] + post) {
+            r.tp++;
+            if (matched) matched[i] = j;
+            j++;
+        } else {
+            r.fn++;
+            if (matched) matched[i] = -1;
+        }
+    }
+    r.fp += ndet - j;
+    return r;
+}
+
+static inline double nst_sensitivity(const nst_beats *b) { return nst_ratio(b->tp, b->fn); }
+static inline double nst_ppv(const nst_beats *b) { return nst_ratio(b->tp, b->fp); }
+
+/**
+ * @brief Parses a "pre[,post]" matching window in ms; post is left as is if not given.
+ */
+static inline void nst_parse_window(const char *arg, double *pre_ms, double *post_ms) {
+    const char *comma = strchr(arg, ',');
+    *pre_ms = atof(arg);
+    if (comma != NULL) {
+        *post_ms = atof(comma + 1);
+    }
+}
+
+/**
+ * @brief Appends the record paths (without .hea) of a directory, sorted, or the argument itself.
+ *
+ * @param arg A directory of records, or a record path with or without ".hea".
+ * @param out Receives the record paths.
+ */
+static inline void nst_collect_records(const char *arg, std::vector<std::string> *out) {
+    struct stat st;
+    if (stat(arg, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        std::string path(arg);
+        if (path.size() > 4 && path.compare(path.size() - 4, 4, ".hea") == 0) {
+            path.erase(path.size() - 4);
+        }
+        out->push_back(path);
+        return;
+    }
+    DIR *dir = opendir(arg);
+    if (dir == NULL) {
+        return;
+    }
+    std::vector<std::string> found;
+    struct dirent *e;
+    while ((e = readdir(dir)) != NULL) {
+        size_t len = strlen(e->d_name);
+        if (len > 4 && strcmp(e->d_name + len - 4, ".hea") == 0) {
+            found.push_back(std::string(arg) + "/" + std::string(e->d_name, len - 4));
+        }
+    }
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+    out->insert(out->end(), found.begin(), found.end());
+}
+
+#endif
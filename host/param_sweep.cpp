@@ -0,0 +1,584 @@
+/* Threshold and noise parameter sweep over cached filter outputs - host only
+ *
+ * The threshold stage and the noise classification only see the integrated
+ * (MWI) output of the filter cascade, which does not depend on any of their
+ * parameters. So this tool runs pan_T_Filter_Block() once per record and
+ * signal and keeps the MWI stream in a cache file (-c directory):
+ *
+ *      mwi_cache_header    (magic, format version, source .dat size/mtime, ...)
+ *      float mwi[samples]  yOut[0] of every sample, native byte order
+ *
+ * A cache file is reused as long as its header matches the record, and read
+ * through a read-only memory mapping. Then every point of the parameter grid
+ *
+ *   -T  SNR_THRESHOLD of the NSR test              (default 0.05:0.15:0.01)
+ *   -f  fraction of spki - npki above npki that    (default 0.125:0.375:0.0625)
+ *       sets the threshold (0.25 in pan_T_Threshold)
+ *   -W  length of the spki/npki windows            (default 4,8,16)
+ *
+ * (lists as a,b,c or start:stop:step) is evaluated on every record, one task
+ * per point and record on the work pool, with a copy of pan_T_Threshold()
+ * and pan_T_Noise_Update() that takes the parameters at run time. At the
+ * default point (0.09, 0.25, 8) the copy is checked sample by sample against
+ * the library functions on every record; the tool fails if they differ.
+ *
+ * For every point it prints the noise classification rates (as batch_eval,
+ * with the -l/-g schedule) and the QRS sensitivity and positive predictivity
+ * against the annotations, the default point marked with *, followed by the
+ * points with the best balanced accuracy (TPR + TNR) / 2.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -pthread -I. host/param_sweep.cpp host/wfdb.cpp BME463_lib.cpp -o param_sweep
+ *
+ * Usage:
+ *   ./param_sweep [-j threads] [-c cache_dir] [-s signal] [-l lead_s] [-g segment_s] [-a ext]
+ *                 [-w pre,post] [-T list] [-f list] [-W list] [-o out.csv] <records>...
+ */
+
+#include "BME463_lib.h"
+#include "nst_metrics.h"
+#include "wfdb.h"
+#include "work_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define MWI_CACHE_MAGIC "PTMWI\0\0\0"
+#define MWI_CACHE_VERSION 2     // Bump whenever the filter cascade changes its output
+
+struct mwi_cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t filter_fs;         // PAN_T_FS the filters were designed for
+    float fs;                   // Record sample rate
+    int32_t signal;
+    int64_t samples;
+    int64_t source_size;        // Signal file the cache was built from
+    int64_t source_mtime;
+};
+
+/* One record and signal: its cached MWI stream and reference beats. */
+struct sweep_record {
+    std::string path;
+    int signal;
+    // Filled by prepare()
+    bool ok;
+    bool built;                 // Cache was (re)built rather than reused
+    std::string name;
+    float fs;
+    long samples;
+    const float *mwi;
+    void *map;
+    size_t map_size;
+    bool have_beats;
+    std::vector<long> beats;
+    long library_mismatches;    // Default point vs pan_T_Threshold()/pan_T_Noise_Update()
+};
+
+struct sweep_params {
+    double snr;
+    float fraction;
+    int window;
+};
+
+struct sweep_options {
+    std::string cache_dir;
+    double clean_lead_s;
+    double segment_s;
+    std::string annotator;
+    double pre_ms;
+    double post_ms;
+};
+
+struct sweep_result {
+    nst_confusion noise;
+    nst_beats beats;
+};
+
+/* Flags of one sample, to compare the default point with the library. */
+struct sweep_flags {
+    std::vector<bool> qrs, noisy;
+};
+
+/**
+ * @brief pan_T_Threshold() + pan_T_Noise_Update() of a pan_T_Detector with
+ * run-time parameters, fed with cached MWI outputs.
+ *
+ * Same operations in the same order as the library, so at the default
+ * parameters the results are bit-identical.
+ */
+template <int N>
+struct sweep_channel {
+    // Threshold stage
+    delay_line<pan_T_default_rate::peak_ring> mwi;
+    float peakt;
+    float peaki;
+    bool QRS_detected;
+    uint32_t peaks;
+    float thresholdi1;
+    float spki;
+    float npki;
+    running_window<N> spki_window;
+    running_window<N> npki_window;
+    // Noise classification
+    bool cur_noise_state;
+    bool prev_noise_state;
+    uint32_t seen_peaks;
+    running_window<N> spki_window_clean;
+    running_window<N> npki_window_clean;
+
+    void init() {
+        memset(this, 0, sizeof(*this));
+        seen_peaks = 0xFFFFFFFFu;
+    }
+
+    static float average(const running_window<N> &w) {
+        return w.sum * (1.0f / N);
+    }
+
+    bool threshold(float y, const sweep_params &p) {
+        const int lag = pan_T_default_rate::peak_lag;
+        mwi.push(y);
+        const float *yOut = mwi.taps();
+        if (yOut[0] > yOut[lag] && yOut[0] > peakt) {
+            peakt = yOut[0];
+        }
+        if (peakt > thresholdi1) {
+            QRS_detected = true;
+        }
+        if (yOut[0] <= yOut[lag] && yOut[0] < 0.5f * peakt) {
+            peaki = peakt;
+            QRS_detected = false;
+            if (peaki > thresholdi1) {
+                spki_window.push(peaki);
+                spki = average(spki_window);
+            } else {
+                npki_window.push(peaki);
+                npki = average(npki_window);
+            }
+            thresholdi1 = npki + p.fraction * (spki - npki);
+            peakt = 0;
+            peaks++;
+        }
+        return QRS_detected;
+    }
+
+    bool noise(const sweep_params &p) {
+        if (peaks == seen_peaks) {
+            return cur_noise_state;
+        }
+        seen_peaks = peaks;
+        float NSR = npki / sqrt(npki * npki + spki * spki);
+        cur_noise_state = NSR > p.snr;
+        if (!cur_noise_state) {
+            npki_window_clean = npki_window;
+            spki_window_clean = spki_window;
+        }
+        if (!cur_noise_state && prev_noise_state) {
+            npki_window = npki_window_clean;
+            spki_window = spki_window_clean;
+            spki = average(spki_window);
+            npki = average(npki_window);
+        }
+        prev_noise_state = cur_noise_state;
+        return cur_noise_state;
+    }
+};
+
+template <int N>
+static void sweep_run(const sweep_record *rec, const sweep_params &p, const sweep_options *opt, sweep_result *res,
+                      sweep_flags *flags) {
+    sweep_channel<N> *ch = new sweep_channel<N>();
+    ch->init();
+    nst_schedule schedule = {opt->clean_lead_s, opt->segment_s, rec->fs};
+    memset(res, 0, sizeof(*res));
+    std::vector<long> onsets;
+    bool prev_qrs = false;
+    for (long n = 0; n < rec->samples; n++) {
+        bool qrs = ch->threshold(rec->mwi[n], p);
+        bool noisy = ch->noise(p);
+        nst_confusion_add(&res->noise, nst_noisy(&schedule, n), noisy);
+        if (qrs && !prev_qrs) {
+            onsets.push_back(n);
+        }
+        prev_qrs = qrs;
+        if (flags != NULL) {
+            flags->qrs[n] = qrs;
+            flags->noisy[n] = noisy;
+        }
+    }
+    delete ch;
+    if (rec->have_beats) {
+        long pre = (long) (opt->pre_ms * rec->fs / 1000.0);
+        long post = (long) (opt->post_ms * rec->fs / 1000.0);
+        res->beats = nst_match_beats(rec->beats.data(), (long) rec->beats.size(), onsets.data(), (long) onsets.size(),
+                                     pre, post, NULL);
+    }
+}
+
+static const int sweep_windows[] = {2, 3, 4, 5, 6, 8, 10, 12, 16};
+
+static bool sweep(const sweep_record *rec, const sweep_params &p, const sweep_options *opt, sweep_result *res,
+                  sweep_flags *flags) {
+    switch (p.window) {
+    case 2: sweep_run<2>(rec, p, opt, res, flags); return true;
+    case 3: sweep_run<3>(rec, p, opt, res, flags); return true;
+    case 4: sweep_run<4>(rec, p, opt, res, flags); return true;
+    case 5: sweep_run<5>(rec, p, opt, res, flags); return true;
+    case 6: sweep_run<6>(rec, p, opt, res, flags); return true;
+    case 8: sweep_run<8>(rec, p, opt, res, flags); return true;
+    case 10: sweep_run<10>(rec, p, opt, res, flags); return true;
+    case 12: sweep_run<12>(rec, p, opt, res, flags); return true;
+    case 16: sweep_run<16>(rec, p, opt, res, flags); return true;
+    default: return false;
+    }
+}
+
+/* Runs the filter cascade over a record and writes its cache file. */
+static bool build_cache(sweep_record *r, const wfdb_record &rec, const mwi_cache_header &hdr, const std::string &file) {
+    wfdb_stream stream;
+    if (!wfdb_stream_open(&stream, &rec, r->signal)) {
+        return false;
+    }
+    std::string tmp = file + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (f == NULL) {
+        fprintf(stderr, "cannot write %s\n", tmp.c_str());
+        wfdb_stream_close(&stream);
+        return false;
+    }
+    mwi_cache_header h = hdr;
+    fwrite(&h, sizeof(h), 1, f);    // samples is patched in below
+
+    pan_T_Filter_State *state = new pan_T_Filter_State();
+    pan_T_Filter_Init(state);
+    int raw[4096];
+    float in[4096], mwi[4096];
+    long got;
+    h.samples = 0;
+    while ((got = wfdb_stream_read(&stream, raw, 4096)) > 0) {
+        for (long i = 0; i < got; i++) {
+            in[i] = wfdb_to_input(raw[i]);
+        }
+        pan_T_Filter_Block(state, in, (int) got, NULL, mwi);
+        fwrite(mwi, sizeof(float), (size_t) got, f);
+        h.samples += got;
+    }
+    delete state;
+    wfdb_stream_close(&stream);
+    bool ok = fseek(f, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, f) == 1;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), file.c_str()) != 0) {
+        fprintf(stderr, "cannot write %s\n", file.c_str());
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/* Maps the cache file of a record if its header matches. */
+static bool map_cache(sweep_record *r, const mwi_cache_header &hdr, const std::string &file) {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    mwi_cache_header h;
+    bool ok = fstat(fd, &st) == 0 && read(fd, &h, sizeof(h)) == (ssize_t) sizeof(h) &&
+              memcmp(h.magic, hdr.magic, sizeof(h.magic)) == 0 && h.version == hdr.version &&
+              h.filter_fs == hdr.filter_fs && h.fs == hdr.fs && h.signal == hdr.signal &&
+              h.source_size == hdr.source_size && h.source_mtime == hdr.source_mtime &&
+              (int64_t) st.st_size == (int64_t) sizeof(h) + h.samples * (int64_t) sizeof(float);
+    if (ok) {
+        r->map_size = (size_t) st.st_size;
+        r->map = mmap(NULL, r->map_size, PROT_READ, MAP_SHARED, fd, 0);
+        ok = r->map != MAP_FAILED;
+    }
+    close(fd);
+    if (ok) {
+        r->mwi = (const float *) ((const char *) r->map + sizeof(h));
+        r->samples = (long) h.samples;
+    }
+    return ok;
+}
+
+/* Opens (building if needed) the cache of a record, loads its beats and
+ * checks the default point against the library.
+ */
+static void prepare(sweep_record *r, const sweep_options *opt) {
+    r->ok = false;
+    r->built = false;
+    r->map = NULL;
+    wfdb_record rec;
+    struct stat st;
+    if (!wfdb_open(&rec, r->path.c_str()) || r->signal >= rec.nsig || stat(rec.sig[r->signal].file, &st) != 0) {
+        return;
+    }
+    r->name = rec.name;
+    r->fs = rec.fs;
+
+    mwi_cache_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MWI_CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version = MWI_CACHE_VERSION;
+    hdr.filter_fs = PAN_T_FS;
+    hdr.fs = rec.fs;
+    hdr.signal = r->signal;
+    hdr.source_size = (int64_t) st.st_size;
+    hdr.source_mtime = (int64_t) st.st_mtime;
+    char file[1024];
+    snprintf(file, sizeof(file), "%s/%s_%d.mwi", opt->cache_dir.c_str(), rec.name, r->signal);
+    if (!map_cache(r, hdr, file)) {
+        if (!build_cache(r, rec, hdr, file) || !map_cache(r, hdr, file)) {
+            return;
+        }
+        r->built = true;
+    }
+
+    r->have_beats = false;
+    if (!opt->annotator.empty()) {
+        wfdb_annotation *ann;
+        long count = wfdb_read_annotations(r->path.c_str(), opt->annotator.c_str(), &ann);
+        if (count >= 0) {
+            for (long i = 0; i < count; i++) {
+                if (wfdb_is_beat(ann[i].code) && ann[i].sample < r->samples) {
+                    r->beats.push_back(ann[i].sample);
+                }
+            }
+            free(ann);
+            r->have_beats = true;
+        }
+    }
+
+    // The default point against the library threshold and noise stages
+    sweep_params def = {SNR_THRESHOLD, 0.25f, 8};
+    sweep_result res;
+    sweep_flags flags;
+    flags.qrs.resize(r->samples);
+    flags.noisy.resize(r->samples);
+    sweep(r, def, opt, &res, &flags);
+    pan_T_Detector *det = new pan_T_Detector();
+    pan_T_Noise_State *noise = new pan_T_Noise_State();
+    pan_T_Detector_Init(det);
+    pan_T_Noise_Init(noise);
+    r->library_mismatches = 0;
+    for (long n = 0; n < r->samples; n++) {
+        det->filter.mwi.push(r->mwi[n]);
+        bool qrs = pan_T_Threshold<pan_T_float>(&det->threshold, det->filter.mwi.taps(), &det->thresholdi1, &det->spki,
+                                                &det->npki, &det->spki_window, &det->npki_window,
+                                                (int) pan_T_default_rate::peak_lag);
+        bool noisy = pan_T_Noise_Update(noise, det);
+        r->library_mismatches += qrs != flags.qrs[n] || noisy != flags.noisy[n];
+    }
+    delete det;
+    delete noise;
+    r->ok = true;
+}
+
+/* Parses a,b,c or start:stop:step. */
+static bool parse_list(const char *arg, std::vector<double> *out) {
+    out->clear();
+    double a, b, step;
+    if (sscanf(arg, "%lf:%lf:%lf", &a, &b, &step) == 3) {
+        if (step <= 0) {
+            return false;
+        }
+        for (long k = 0; a + k * step <= b + step * 1e-6; k++) {
+            out->push_back(a + k * step);
+        }
+        return !out->empty();
+    }
+    const char *p = arg;
+    while (*p != '\0') {
+        char *end;
+        out->push_back(strtod(p, &end));
+        if (end == p) {
+            return false;
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return !out->empty();
+}
+
+static double balanced_accuracy(const nst_confusion *c) {
+    return 0.5 * (nst_tpr(c) + nst_tnr(c));
+}
+
+static void print_point(const sweep_params &p, const sweep_result &r, bool is_default) {
+    printf("%c %6.3f %7.4f %4d  %6.3f %6.3f %6.3f %6.3f  %6.4f %6.4f  %6.4f\n", is_default ? '*' : ' ', p.snr,
+           p.fraction, p.window, nst_tpr(&r.noise), nst_fnr(&r.noise), nst_fpr(&r.noise), nst_tnr(&r.noise),
+           nst_sensitivity(&r.beats), nst_ppv(&r.beats), balanced_accuracy(&r.noise));
+}
+
+int main(int argc, char **argv) {
+    sweep_options opt = {"mwi_cache", 300.0, 120.0, "atr", 100.0, 350.0};
+    unsigned threads = 0;
+    int signal = 0;
+    const char *csv_path = NULL;
+    std::vector<double> snrs, fractions, windows;
+    parse_list("0.05:0.15:0.01", &snrs);
+    parse_list("0.125:0.375:0.0625", &fractions);
+    parse_list("4,8,16", &windows);
+    std::vector<std::string> paths;
+    bool usage = false;
+    for (int a = 1; a < argc && !usage; a++) {
+        if (argv[a][0] == '-' && argv[a][1] != '\0' && argv[a][2] == '\0' && a + 1 < argc) {
+            const char *v = argv[++a];
+            switch (argv[a - 1][1]) {
+            case 'j': threads = (unsigned) atoi(v); break;
+            case 'c': opt.cache_dir = v; break;
+            case 's': signal = atoi(v); break;
+            case 'l': opt.clean_lead_s = atof(v); break;
+            case 'g': opt.segment_s = atof(v); break;
+            case 'a': opt.annotator = v; break;
+            case 'w': nst_parse_window(v, &opt.pre_ms, &opt.post_ms); break;
+            case 'T': usage = !parse_list(v, &snrs); break;
+            case 'f': usage = !parse_list(v, &fractions); break;
+            case 'W': usage = !parse_list(v, &windows); break;
+            case 'o': csv_path = v; break;
+            default: usage = true; break;
+            }
+        } else {
+            nst_collect_records(argv[a], &paths);
+        }
+    }
+    for (size_t w = 0; w < windows.size(); w++) {
+        const int *end = sweep_windows + sizeof(sweep_windows) / sizeof(sweep_windows[0]);
+        if (std::find(sweep_windows, end, (int) windows[w]) == end) {
+            fprintf(stderr, "window length %g not supported (2-6, 8, 10, 12, 16)\n", windows[w]);
+            return 1;
+        }
+    }
+    if (usage || paths.empty()) {
+        fprintf(stderr, "usage: %s [-j threads] [-c cache_dir] [-s signal] [-l lead_s] [-g segment_s] [-a ext] "
+                        "[-w pre,post] [-T list] [-f list] [-W list] [-o out.csv] <records>...\n"
+                        "lists: a,b,c or start:stop:step\n", argv[0]);
+        return 1;
+    }
+    mkdir(opt.cache_dir.c_str(), 0777);
+
+    // Filter every record once, or map its cache
+    std::vector<sweep_record> records(paths.size());
+    work_pool prep(threads);
+    for (size_t r = 0; r < paths.size(); r++) {
+        sweep_record *rec = &records[r];
+        rec->path = paths[r];
+        rec->signal = signal;
+        prep.add([rec, &opt] { prepare(rec, &opt); });
+    }
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    prep.run();
+    double prep_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    long samples = 0, built = 0, mismatches = 0;
+    for (size_t r = 0; r < records.size(); r++) {
+        if (!records[r].ok) {
+            fprintf(stderr, "%s: skipped\n", records[r].path.c_str());
+            continue;
+        }
+        samples += records[r].samples;
+        built += records[r].built;
+        mismatches += records[r].library_mismatches;
+    }
+
+    // One task per grid point and record
+    std::vector<sweep_params> grid;
+    for (size_t i = 0; i < snrs.size(); i++) {
+        for (size_t j = 0; j < fractions.size(); j++) {
+            for (size_t k = 0; k < windows.size(); k++) {
+                sweep_params p = {snrs[i], (float) fractions[j], (int) windows[k]};
+                grid.push_back(p);
+            }
+        }
+    }
+    std::vector<sweep_result> results(grid.size() * records.size());
+    work_pool pool(threads);
+    for (size_t g = 0; g < grid.size(); g++) {
+        for (size_t r = 0; r < records.size(); r++) {
+            if (!records[r].ok) {
+                continue;
+            }
+            const sweep_record *rec = &records[r];
+            const sweep_params *p = &grid[g];
+            sweep_result *res = &results[g * records.size() + r];
+            pool.add([rec, p, res, &opt] { sweep(rec, *p, &opt, res, NULL); });
+        }
+    }
+    t0 = std::chrono::steady_clock::now();
+    pool.run();
+    double sweep_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    // Totals per grid point
+    std::vector<sweep_result> totals(grid.size());
+    for (size_t g = 0; g < grid.size(); g++) {
+        memset(&totals[g], 0, sizeof(totals[g]));
+        for (size_t r = 0; r < records.size(); r++) {
+            if (!records[r].ok) {
+                continue;
+            }
+            const sweep_result &res = results[g * records.size() + r];
+            nst_confusion_merge(&totals[g].noise, &res.noise);
+            totals[g].beats.tp += res.beats.tp;
+            totals[g].beats.fn += res.beats.fn;
+            totals[g].beats.fp += res.beats.fp;
+        }
+    }
+
+    printf("  %6s %7s %4s  %6s %6s %6s %6s  %6s %6s  %6s\n", "snr", "frac", "win", "TPR", "FNR", "FPR", "TNR", "Se",
+           "+P", "bal");
+    std::vector<size_t> order;
+    for (size_t g = 0; g < grid.size(); g++) {
+        const sweep_params &p = grid[g];
+        bool is_default = fabs(p.snr - SNR_THRESHOLD) < 1e-9 && p.fraction == 0.25f && p.window == 8;
+        print_point(p, totals[g], is_default);
+        order.push_back(g);
+    }
+    std::sort(order.begin(), order.end(), [&totals](size_t a, size_t b) {
+        return balanced_accuracy(&totals[a].noise) > balanced_accuracy(&totals[b].noise);
+    });
+    printf("best balanced accuracy:\n");
+    for (size_t k = 0; k < order.size() && k < 5; k++) {
+        print_point(grid[order[k]], totals[order[k]], false);
+    }
+
+    if (csv_path != NULL) {
+        FILE *csv = fopen(csv_path, "w");
+        if (csv == NULL) {
+            fprintf(stderr, "cannot write %s\n", csv_path);
+            return 1;
+        }
+        fprintf(csv, "snr,fraction,window,tp,fn,fp,tn,tpr,fnr,fpr,tnr,beat_tp,beat_fn,beat_fp,sensitivity,ppv\n");
+        for (size_t g = 0; g < grid.size(); g++) {
+            const sweep_result &t = totals[g];
+            fprintf(csv, "%g,%g,%d,%ld,%ld,%ld,%ld,%.6f,%.6f,%.6f,%.6f,%ld,%ld,%ld,%.6f,%.6f\n", grid[g].snr,
+                    grid[g].fraction, grid[g].window, t.noise.tp, t.noise.fn, t.noise.fp, t.noise.tn,
+                    nst_tpr(&t.noise), nst_fnr(&t.noise), nst_fpr(&t.noise), nst_tnr(&t.noise), t.beats.tp,
+                    t.beats.fn, t.beats.fp, nst_sensitivity(&t.beats), nst_ppv(&t.beats));
+        }
+        fclose(csv);
+    }
+
+    printf("%zu records, %.1f M samples: cache %ld built, %zu reused in %.2f s\n", records.size(), samples * 1e-6,
+           built, records.size() - built, prep_s);
+    printf("%zu grid points in %.2f s (%.0f M samples/s, %.2f s per point)\n", grid.size(), sweep_s,
+           grid.size() * samples / sweep_s * 1e-6, sweep_s / grid.size());
+    if (mismatches > 0) {
+        printf("default point differs from pan_T_Threshold()/pan_T_Noise_Update() in %ld samples\n", mismatches);
+        return 2;
+    }
+    for (size_t r = 0; r < records.size(); r++) {
+        if (records[r].map != NULL) {
+            munmap(records[r].map, records[r].map_size);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+/* Detector sample rate and decimation comparison - host only
+ *
+ * Runs the detector over the same input in several configurations:
+ *
+ *  - "200 taps":   pan_T_rate<200> on every input sample, whatever the input
+ *                  rate (what main.cpp does without PAN_T_DECIMATE);
+ *  - "native":     the delays designed for the input rate, every sample;
+ *  - "decimate M": decimator<M> in front of the delays for input rate / M.
+ *
+ * and reports, for each, the beat sensitivity and positive predictivity of
+ * the QRS onsets against the true beats (the R waves of the synthetic ECG, or
+ * the .atr annotations of a record) and the time per input sample, so the
+ * saving of detecting at a lower internal rate can be weighed against its
+ * accuracy. Detections are matched 100 ms before to 350 ms after a beat.
+ *
+ * The synthetic ECG can be generated at 360, 500 or 1000 Hz (-f); records
+ * are taken at their own rate, which must be 360 Hz.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -I. host/rate_compare.cpp host/wfdb.cpp BME463_lib.cpp -o rate_compare
+ *
+ * Usage:
+ *   ./rate_compare [-f fs] [-t seconds] [-n noise] [-s signal] [record]
+ */
+
+#include "BME463_lib.h"
+#include "decimator.h"
+#include "nst_metrics.h"
+#include "synth_ecg.h"
+#include "wfdb.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+struct rate_result {
+    std::vector<long> onsets;   // Input sample index of every QRS onset
+    double ns;                  // Per input sample
+};
+
+/* Detector with the delays of Rate behind an M times decimator. */
+template <int M, typename Rate>
+static rate_result run(const std::vector<float> &in) {
+    rate_result r;
+    pan_T_Detector_T<pan_T_float, Rate> det;
+    pan_T_Noise_T<pan_T_float> noise;
+    decimator<M> front_end;
+    pan_T_Detector_Init(&det);
+    pan_T_Noise_Init(&noise);
+    front_end.init();
+    bool prev = false;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < in.size(); n++) {
+        float x = in[n];
+        if (M > 1 && !front_end.push(x, &x)) {
+            continue;
+        }
+        bool qrs = pan_T_Detector_Process(&det, x, (float *) NULL);
+        pan_T_Noise_Update(&noise, &det);
+        if (qrs && !prev) {
+            r.onsets.push_back((long) n);
+        }
+        prev = qrs;
+    }
+    r.ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / in.size();
+    return r;
+}
+
+struct rate_config {
+    const char *name;
+    int fs_in;
+    int fs_detector;
+    rate_result (*fn)(const std::vector<float> &);
+};
+
+static const rate_config configs[] = {
+    {"200 taps", 360, 200, run<1, pan_T_rate<200> >},
+    {"native", 360, 360, run<1, pan_T_rate<360> >},
+    {"decimate 2", 360, 180, run<2, pan_T_rate<180> >},
+    {"200 taps", 500, 200, run<1, pan_T_rate<200> >},
+    {"native", 500, 500, run<1, pan_T_rate<500> >},
+    {"decimate 2", 500, 250, run<2, pan_T_rate<250> >},
+    {"decimate 5", 500, 100, run<5, pan_T_rate<100> >},
+    {"200 taps", 1000, 200, run<1, pan_T_rate<200> >},
+    {"native", 1000, 1000, run<1, pan_T_rate<1000> >},
+    {"decimate 2", 1000, 500, run<2, pan_T_rate<500> >},
+    {"decimate 4", 1000, 250, run<4, pan_T_rate<250> >},
+    {"decimate 5", 1000, 200, run<5, pan_T_rate<200> >},
+};
+
+int main(int argc, char **argv) {
+    int fs = 1000;
+    double seconds = 600.0;
+    float noise_amp = 0.0f;
+    int signal = 0;
+    const char *record = NULL;
+    for (int a = 1; a < argc; a++) {
+        if (argv[a][0] == '-' && argv[a][1] != '\0' && argv[a][2] == '\0' && a + 1 < argc) {
+            const char *v = argv[++a];
+            switch (argv[a - 1][1]) {
+            case 'f': fs = atoi(v); break;
+            case 't': seconds = atof(v); break;
+            case 'n': noise_amp = (float) atof(v); break;
+            case 's': signal = atoi(v); break;
+            default:
+                fprintf(stderr, "usage: %s [-f fs] [-t seconds] [-n noise] [-s signal] [record]\n", argv[0]);
+                return 1;
+            }
+        } else {
+            record = argv[a];
+        }
+    }
+
+    // Input and true beats, as input sample indices
+    std::vector<float> in;
+    std::vector<long> beats;
+    if (record != NULL) {
+        wfdb_record rec;
+        wfdb_stream stream;
+        if (!wfdb_open(&rec, record) || !wfdb_stream_open(&stream, &rec, signal)) {
+            return 1;
+        }
+        fs = (int) (rec.fs + 0.5);
+        int raw[4096];
+        long got;
+        while ((got = wfdb_stream_read(&stream, raw, 4096)) > 0) {
+            for (long i = 0; i < got; i++) {
+                in.push_back(wfdb_to_input(raw[i]));
+            }
+        }
+        wfdb_stream_close(&stream);
+        wfdb_annotation *ann = NULL;
+        long nann = wfdb_read_annotations(record, "atr", &ann);
+        for (long i = 0; i < nann; i++) {
+            if (wfdb_is_beat(ann[i].code)) {
+                beats.push_back(ann[i].sample);
+            }
+        }
+        free(ann);
+    } else {
+        synth_ecg gen;
+        synth_ecg_init(&gen, 0, noise_amp);
+        gen.fs = (float) fs;
+        long n = (long) (seconds * fs);
+        for (long i = 0; i < n; i++) {
+            in.push_back(synth_ecg_next(&gen) / 2048.0f);
+        }
+        for (double t = 0.30 * gen.rr; t * fs < n; t += gen.rr) {
+            beats.push_back((long) (t * fs + 0.5));   // R wave peaks
+        }
+    }
+
+    bool any = false;
+    printf("%ld samples at %d Hz, %ld beats\n", (long) in.size(), fs, (long) beats.size());
+    printf("%-12s %8s %7s %7s %7s %8s %8s %10s\n", "config", "det fs", "tp", "fn", "fp", "Se", "PPV", "ns/sample");
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        const rate_config &cfg = configs[c];
+        if (cfg.fs_in != fs) {
+            continue;
+        }
+        any = true;
+        rate_result r = cfg.fn(in);
+        nst_beats b = nst_match_beats(beats.data(), (long) beats.size(), r.onsets.data(), (long) r.onsets.size(),
+                                      fs / 10, fs * 35 / 100, NULL);
+        printf("%-12s %8d %7ld %7ld %7ld %8.4f %8.4f %10.2f\n", cfg.name, cfg.fs_detector, b.tp, b.fn, b.fp,
+               nst_sensitivity(&b), nst_ppv(&b), r.ns);
+    }
+    if (!any) {
+        fprintf(stderr, "no configurations for %d Hz input (360, 500 or 1000)\n", fs);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+/* WFDB record replay - host only
+ *
+ * Streams one signal of a WFDB record (e.g. an MIT-BIH Noise Stress Test
+ * record) through pan_T_Detector and pan_T_Noise_Update() at CPU speed, the
+ * same way main.cpp feeds the receiver board, and reports the detected beats
+ * and the replay speed.
+ *
+ * With -f the detector state also goes through a flight recorder
+ * (flight_rec.h) and its images are appended to a file for
+ * host/flight_decode: one image per noise transition selected with -T
+ * (noisy, clean or both, default both), holding -p records from the
+ * transition on (default half the ring), or with -T none the whole run,
+ * one image per full ring. Build with -DFLIGHT_REC_LEN=n for a longer ring
+ * than the board's.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -I. host/replay.cpp host/wfdb.cpp BME463_lib.cpp flight_rec.cpp -o replay
+ *
+ * Usage:
+ *   ./replay [-f flight.bin] [-T noisy|clean|both|none] [-p post] <record> [signal] [out.csv]
+ *
+ *   record  := record path without extension, e.g. nstdb/118e06
+ *   signal  := signal number, default 0
+ *   out.csv := optional per-sample dump: sample,input,filtered,mwi,threshold,spki,npki,qrs
+ */
+
+#include "BME463_lib.h"
+#include "flight_rec.h"
+#include "wfdb.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char **argv) {
+    const char *flight_path = NULL;
+    uint32_t trigger_mask = FLIGHT_TRIG_NOISY | FLIGHT_TRIG_CLEAN;
+    uint32_t post = FLIGHT_REC_LEN / 2;
+    const char *args[3] = {NULL, NULL, NULL};
+    int nargs = 0;
+    bool usage = false;
+    for (int a = 1; a < argc && !usage; a++) {
+        if (argv[a][0] == '-' && argv[a][1] != '\0' && argv[a][2] == '\0' && a + 1 < argc) {
+            const char *v = argv[++a];
+            switch (argv[a - 1][1]) {
+            case 'f': flight_path = v; break;
+            case 'T':
+                trigger_mask = strcmp(v, "noisy") == 0 ? FLIGHT_TRIG_NOISY
+                             : strcmp(v, "clean") == 0 ? FLIGHT_TRIG_CLEAN
+                             : strcmp(v, "none") == 0 ? 0u
+                             : FLIGHT_TRIG_NOISY | FLIGHT_TRIG_CLEAN;
+                break;
+            case 'p': post = (uint32_t) atoi(v); break;
+            default: usage = true; break;
+            }
+        } else if (nargs < 3) {
+            args[nargs++] = argv[a];
+        } else {
+            usage = true;
+        }
+    }
+    if (usage || nargs < 1) {
+        fprintf(stderr, "usage: %s [-f flight.bin] [-T noisy|clean|both|none] [-p post] <record> [signal] [out.csv]\n",
+                argv[0]);
+        return 1;
+    }
+    int signal = nargs > 1 ? atoi(args[1]) : 0;
+    FILE *csv = NULL;
+    FILE *flight_file = NULL;
+
+    wfdb_record rec;
+    wfdb_stream stream;
+    if (!wfdb_open(&rec, args[0]) || !wfdb_stream_open(&stream, &rec, signal)) {
+        return 1;
+    }
+    if (nargs > 2) {
+        csv = fopen(args[2], "w");
+        if (csv == NULL) {
+            fprintf(stderr, "cannot write %s\n", args[2]);
+            return 1;
+        }
+        fprintf(csv, "sample,input,filtered,mwi,threshold,spki,npki,qrs\n");
+    }
+    static flight_rec flight;
+    long images = 0;
+    if (flight_path != NULL) {
+        flight_file = fopen(flight_path, "wb");
+        if (flight_file == NULL) {
+            fprintf(stderr, "cannot write %s\n", flight_path);
+            return 1;
+        }
+        flight_rec_init(&flight, FLIGHT_FLOAT, rec.fs, trigger_mask, post);
+    }
+
+    pan_T_Detector det;
+    pan_T_Noise_State noise;
+    pan_T_Detector_Init(&det);
+    pan_T_Noise_Init(&noise);
+    static int raw[4096];
+    long n = 0;
+    long beats = 0;
+    bool prev_qrs = false;
+
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    long got;
+    while ((got = wfdb_stream_read(&stream, raw, 4096)) > 0) {
+        for (long i = 0; i < got; i++, n++) {
+            float input = wfdb_to_input(raw[i]);
+            float filtered;
+            bool qrs = pan_T_Detector_Process(&det, input, &filtered);
+            pan_T_Noise_Update(&noise, &det);
+            beats += qrs && !prev_qrs;
+            prev_qrs = qrs;
+            if (csv != NULL) {
+                fprintf(csv, "%ld,%g,%g,%g,%g,%g,%g,%d\n", n, input, filtered, det.filter.mwi[0],
+                        det.thresholdi1, det.spki, det.npki, qrs);
+            }
+            if (flight_file != NULL) {
+                flight_rec_record(&flight, &det, &noise, filtered, qrs);
+                if (flight.state == FLIGHT_FROZEN || (trigger_mask == 0 && flight_rec_size(&flight) == FLIGHT_REC_LEN)) {
+                    fwrite(&flight, sizeof(flight), 1, flight_file);
+                    flight_rec_arm(&flight);
+                    images++;
+                }
+            }
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    wfdb_stream_close(&stream);
+    if (csv != NULL) {
+        fclose(csv);
+    }
+    if (flight_file != NULL) {
+        // The recording in progress: the rest of the run, or a trigger cut short by the end of it
+        if (flight_rec_size(&flight) > 0 && (trigger_mask == 0 || flight.state != FLIGHT_ARMED)) {
+            fwrite(&flight, sizeof(flight), 1, flight_file);
+            images++;
+        }
+        fclose(flight_file);
+    }
+
+    double duration = n / rec.fs;
+    printf("record %s signal %d (%s): %ld samples at %g Hz (%.1f min)\n", rec.name, signal,
+           rec.sig[signal].description, n, rec.fs, duration / 60.0);
+    printf("QRS detections: %ld (%.1f bpm)\n", beats, duration > 0 ? beats * 60.0 / duration : 0.0);
+    printf("replay time: %.3f s (%.0fx real time, %.1f Msamples/s)\n", elapsed,
+           elapsed > 0 ? duration / elapsed : 0.0, elapsed > 0 ? n / elapsed / 1e6 : 0.0);
+    if (flight_file != NULL) {
+        printf("flight recorder: %ld images of %d records in %s\n", images, FLIGHT_REC_LEN, flight_path);
+    }
+    return 0;
+}
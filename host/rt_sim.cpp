@@ -0,0 +1,320 @@
+/* Simulated-timer run of the receiver's ISR and main loop - host only
+ *
+ * Replays the sampling scheme of main.cpp against a virtual microsecond
+ * clock, with the rt_stats instrumentation compiled in:
+ *
+ *  - the sender transmits every sample as 3 bytes (low, high, '\0') once
+ *    per its own sample period, which drifts against the receiver's by -d
+ *    ppm, or with -F n link frames of n samples (link_frame.h, main.cpp
+ *    built with -DPAN_T_FRAMED_LINK), paced at the serial baud rate; -p
+ *    drops whole frames at random;
+ *  - RXfxn() queues every byte on arrival and ISRfxn() fires every 1/fs s
+ *    of virtual time, both also while the main loop is processing;
+ *  - the main loop waits for the next interrupt, decodes the queued bytes
+ *    and drains the sample queue through pan_T_Detector_Process() +
+ *    pan_T_Noise_Update() as main.cpp. The execution time per sample is the
+ *    measured host time scaled by -x (the F303K8 runs at 72 MHz without
+ *    caches), or a fixed -c microseconds.
+ *
+ * The queue lengths, batch sizes, playout prefill and default rate come
+ * from receiver_config.h, as in main.cpp. The ISR, frame and processing
+ * hooks are the RT_STATS_* macros main.cpp uses, and the virtual clock replaces us_ticker_read(), so the statistics
+ * show what the board would report: overrun and stale ticks, tick-to-done
+ * latency and the worst-case execution time.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -I. host/rt_sim.cpp host/wfdb.cpp BME463_lib.cpp rt_stats.cpp link_frame.cpp -o rt_sim
+ *
+ * Usage:
+ *   ./rt_sim [-r record] [-s signal] [-t seconds] [-f fs] [-b baud] [-d ppm] [-p drop] [-x scale] [-c cost_us] [-F frame]
+ */
+
+#define PAN_T_RT_STATS
+#include "BME463_lib.h"
+#include "link_frame.h"
+#include "receiver_config.h"
+#include "rt_stats.h"
+#include "spsc_queue.h"
+#include "synth_ecg.h"
+#include "wfdb.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static double sim_time_us;     // Virtual clock
+
+static uint32_t sim_clock(void) {
+    return (uint32_t) (unsigned long long) sim_time_us;
+}
+
+/* The globals, interrupt handlers and per-byte code of main.cpp; framed
+ * selects the PAN_T_FRAMED_LINK build.
+ */
+struct receiver {
+    union {
+        short s;
+        char h[sizeof(short)];
+    } data;
+    int num;
+    unsigned i;
+    bool framed;
+    spsc_queue<uint8_t, RX_QUEUE_LEN> rx_bytes;
+    link_decoder link;
+    spsc_queue<int16_t, PLAYOUT_QUEUE_LEN> playout;
+    bool playing;
+    spsc_queue<timed_sample, SAMPLE_QUEUE_LEN> samples;
+    pan_T_Detector det;
+    pan_T_Noise_State noise;
+    rt_stats rt;
+
+    void RXfxn(uint8_t b) {
+        rx_bytes.push(b);
+    }
+
+    void ISRfxn() {
+        if (framed) {
+            if (!playing && playout.size() >= PLAYOUT_PREFILL) {
+                playing = true;
+            }
+            int16_t raw;
+            if (playing && playout.pop(&raw)) {
+                num = raw;
+                RT_STATS_FRAME(&rt);
+            } else {
+                playing = false;
+            }
+        }
+        timed_sample sample;
+        sample.time = sim_clock();
+        sample.value = (float) num / 2048.0f;
+        bool queued = samples.push(sample);
+        RT_STATS_TICK(&rt, !queued);
+    }
+
+    void byte_received(uint8_t b) {
+        if (framed) {
+            if (link_decode_byte(&link, b)) {
+                for (int s = 0; s < link.frame.count; s++) {
+                    playout.push(link.frame.samples[s]);
+                }
+            }
+            return;
+        }
+        char d = (char) b;
+        if (d == '\0' && i >= sizeof(short)) {
+            i = 0;
+            num = (int) data.s;
+            RT_STATS_FRAME(&rt);
+        } else if (i < sizeof(short)) {
+            data.h[i++] = d;
+        }
+    }
+};
+
+/* A byte on the wire and the time its stop bit arrives. */
+struct wire_byte {
+    double arrival;
+    uint8_t value;
+};
+
+/* Interrupt sources in virtual time, run in time order. */
+struct interrupts {
+    receiver *rx;
+    const std::vector<wire_byte> *bytes;
+    size_t next_byte;
+    double next_tick;
+    double tick_period;
+
+    double next() const {
+        return next_byte < bytes->size() ? std::min(next_tick, (*bytes)[next_byte].arrival) : next_tick;
+    }
+
+    /* Runs every interrupt due up to t and leaves the clock at t. */
+    void run_until(double t) {
+        for (double e = next(); e <= t; e = next()) {
+            sim_time_us = e;
+            if (next_byte < bytes->size() && (*bytes)[next_byte].arrival <= next_tick) {
+                rx->RXfxn((*bytes)[next_byte++].value);
+            } else {
+                rx->ISRfxn();
+                next_tick += tick_period;
+            }
+        }
+        sim_time_us = t;
+    }
+};
+
+struct sim_options {
+    double seconds;
+    double fs;
+    double baud;
+    double drift_ppm;
+    double drop;
+    double scale;
+    double cost_us;     // > 0 overrides scale
+    int frame;          // Samples per link frame, 0 for the 3-byte protocol
+};
+
+static void print_stats(const rt_stats *s, double fs) {
+    printf("ticks %u, processed %u, overruns %u (%.3f%%), stale %u (%.3f%%), frames %u\n",
+           s->ticks, s->processed, s->overruns, 100.0 * s->overruns / (s->ticks ? s->ticks : 1),
+           s->stale, 100.0 * s->stale / (s->ticks ? s->ticks : 1), s->frames);
+    printf("latency us: min %u, mean %.1f, max %u (period %.1f)\n",
+           s->processed ? s->latency_min : 0, rt_stats_mean_latency(s), s->latency_max, 1e6 / fs);
+    printf("execution us: worst %u, last %u, load %.3f\n", s->exec_max, s->exec_last, rt_stats_load(s));
+    printf("latency histogram:\n");
+    for (int b = 0; b < RT_STATS_BINS; b++) {
+        if (s->hist[b] == 0) {
+            continue;
+        }
+        unsigned lo = b == 0 ? 0 : 1u << b;
+        if (b == RT_STATS_BINS - 1) {
+            printf("  >= %6u us %10u\n", lo, s->hist[b]);
+        } else {
+            printf("  %6u - %6u us %10u\n", lo, (2u << b) - 1, s->hist[b]);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    sim_options opt = {600.0, SAMP_RATE, 115200.0, 100.0, 0.0, 30.0, 0.0, 0};
+    const char *record = NULL;
+    int signal = 0;
+    for (int a = 1; a + 1 < argc; a += 2) {
+        const char *v = argv[a + 1];
+        switch (argv[a][1]) {
+        case 'r': record = v; break;
+        case 's': signal = atoi(v); break;
+        case 't': opt.seconds = atof(v); break;
+        case 'f': opt.fs = atof(v); break;
+        case 'b': opt.baud = atof(v); break;
+        case 'd': opt.drift_ppm = atof(v); break;
+        case 'p': opt.drop = atof(v); break;
+        case 'x': opt.scale = atof(v); break;
+        case 'c': opt.cost_us = atof(v); break;
+        case 'F': opt.frame = std::min(std::max(atoi(v), 0), LINK_MAX_SAMPLES); break;
+        default:
+            fprintf(stderr, "usage: %s [-r record] [-s signal] [-t seconds] [-f fs] [-b baud] [-d ppm] [-p drop] [-x scale] [-c cost_us] [-F frame]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Samples the sender transmits.
+    long n = (long) (opt.seconds * opt.fs);
+    std::vector<int> samples(n);
+    if (record != NULL) {
+        wfdb_record rec;
+        wfdb_stream stream;
+        if (!wfdb_open(&rec, record) || !wfdb_stream_open(&stream, &rec, signal)) {
+            return 1;
+        }
+        n = wfdb_stream_read(&stream, samples.data(), n);
+        samples.resize(n);
+        wfdb_stream_close(&stream);
+    } else {
+        synth_ecg gen;
+        synth_ecg_init(&gen, 0, 0.0f);
+        for (long k = 0; k < n; k++) {
+            samples[k] = synth_ecg_next(&gen);
+        }
+    }
+
+    static receiver rx;     // Zero initialized like main.cpp's globals
+    rx.framed = opt.frame > 0;
+    rx.rx_bytes.clear();
+    link_decoder_init(&rx.link);
+    rx.playout.clear();
+    rx.samples.clear();
+    pan_T_Detector_Init(&rx.det);
+    pan_T_Noise_Init(&rx.noise);
+    rt_stats_init(&rx.rt, sim_clock, (uint32_t) (1e6 / opt.fs));
+
+    double tick_period = 1e6 / opt.fs;
+    double send_period = tick_period * (1.0 + opt.drift_ppm * 1e-6);
+    double byte_time = 10.0 * 1e6 / opt.baud;  // 8N1
+    srand(1);
+
+    // What the sender puts on the wire: a frame leaves once its last sample
+    // is read and the line is free.
+    std::vector<wire_byte> wire;
+    double line_free = 0.0;
+    int per_frame = rx.framed ? opt.frame : 1;
+    uint8_t seq = 0;
+    for (long k0 = 0; k0 < n; k0 += per_frame) {
+        int count = (int) std::min<long>(per_frame, n - k0);
+        if (opt.drop > 0 && rand() < opt.drop * RAND_MAX) {
+            seq++;
+            continue;   // Frame lost
+        }
+        uint8_t frame[LINK_FRAME_MAX];
+        int len;
+        if (rx.framed) {
+            link_frame f;
+            f.seq = seq++;
+            f.count = (uint8_t) count;
+            for (int j = 0; j < count; j++) {
+                f.samples[j] = (int16_t) samples[k0 + j];
+            }
+            len = link_encode(&f, frame);
+        } else {
+            short s = (short) samples[k0];
+            frame[0] = (uint8_t) (s & 0xFF);
+            frame[1] = (uint8_t) ((s >> 8) & 0xFF);
+            frame[2] = 0;
+            len = 3;
+        }
+        double t = std::max((k0 + count - 1) * send_period, line_free);
+        for (int j = 0; j < len; j++) {
+            t += byte_time;
+            wire_byte b = {t, frame[j]};
+            wire.push_back(b);
+        }
+        line_free = t;
+    }
+
+    interrupts irq = {&rx, &wire, 0, tick_period, tick_period};
+    sim_time_us = 0.0;
+    double end_us = n * tick_period;    // Stop at the end of the input even if processing lags
+    while (sim_time_us < end_us) {
+        // Idle until the next interrupt
+        irq.run_until(std::min(irq.next(), end_us));
+
+        uint8_t bytes[RX_BATCH];
+        int nbytes = rx.rx_bytes.pop(bytes, RX_BATCH);
+        for (int b = 0; b < nbytes; b++) {
+            rx.byte_received(bytes[b]);
+        }
+
+        timed_sample batch[SAMPLE_BATCH];
+        int count = rx.samples.pop(batch, SAMPLE_BATCH);
+        for (int b = 0; b < count; b++) {
+            RT_STATS_BEGIN_AT(&rx.rt, batch[b].time);
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            float filtered;
+            pan_T_Detector_Process(&rx.det, batch[b].value, &filtered);
+            pan_T_Noise_Update(&rx.noise, &rx.det);
+            double cost = opt.cost_us > 0 ? opt.cost_us
+                : std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() * opt.scale;
+            // Interrupts during processing delay it, then processing resumes.
+            irq.run_until(sim_time_us + cost);
+            RT_STATS_END(&rx.rt);
+        }
+    }
+
+    rt_stats snap;
+    rt_stats_snapshot(&rx.rt, &snap);
+    printf("%.0f s at %.0f Hz, %.0f baud, sender drift %+.0f ppm, frame drop %.4f, %s, %s\n", opt.seconds, opt.fs,
+           opt.baud, opt.drift_ppm, opt.drop, opt.cost_us > 0 ? "fixed cost" : "scaled host cost",
+           rx.framed ? "framed link" : "3-byte link");
+    print_stats(&snap, opt.fs);
+    printf("sample queue: high-water %u of %d, overflows %u\n", rx.samples.high_water, rx.samples.capacity(), rx.samples.overflows);
+    printf("rx byte queue: high-water %u of %d, overflows %u\n", rx.rx_bytes.high_water, rx.rx_bytes.capacity(), rx.rx_bytes.overflows);
+    if (rx.framed) {
+        printf("link: frames %u, crc errors %u, bad headers %u, lost frames %u, skipped bytes %u; playout high-water %u of %d\n",
+               rx.link.frames, rx.link.crc_errors, rx.link.bad_headers, rx.link.lost_frames, rx.link.skipped_bytes,
+               rx.playout.high_water, rx.playout.capacity());
+    }
+    return 0;
+}
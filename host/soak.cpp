@@ -0,0 +1,356 @@
+/* Accelerated long-duration soak test of the detector - host only
+ *
+ * The LP and HP stages are recursive filters with poles on the unit circle:
+ * a rounding error that enters their feedback is never forgotten. This tool
+ * replays a looped input (records, or a synthetic ECG) equivalent to -d
+ * hours of monitoring at full CPU speed through one detector kernel and, in
+ * lock-step, through a double precision reference (pan_T_double below, the
+ * same pipeline instantiated with double arithmetic). For every -i hours of
+ * signal it prints the worst deviation from the reference of
+ *
+ *  - the LP and HP filter outputs (absolute, in input units),
+ *  - the MWI output, the threshold, spki and npki (relative to the largest
+ *    reference value of the interval),
+ *  - and the samples where the QRS or noise flag differs,
+ *
+ * plus the kernel's sustained samples per second (the reference is not
+ * timed). A stable kernel shows errors that stay flat over the run; drift
+ * shows as errors that grow from interval to interval.
+ *
+ * Kernels (-k):
+ *   detector   pan_T_Detector_Process(), the float pipeline main.cpp runs
+ *   generic    pan_T_Filter_Generic() (filter_IIR()/filter_FIR()), 200 sps only
+ *   fixed      the fixed-point pipeline of -DPAN_T_FIXED_POINT
+ *
+ * -R sets the rate the detector's filters are designed for (pan_T_rate;
+ * 200 as in main.cpp, or 360 to match the input rate). The exit status is 1
+ * if an error of the last interval is more than twice that of the first
+ * (and above rounding level), so the tool can gate a kernel change; run at
+ * least 4 intervals so that a random walk shows.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -I. host/soak.cpp host/wfdb.cpp BME463_lib.cpp -o soak
+ *
+ * Usage:
+ *   ./soak [-k kernel] [-R rate] [-d hours] [-i hours] [-n noise] [-s signal] [record...]
+ */
+
+#include "BME463_lib.h"
+#include "synth_ecg.h"
+#include "wfdb.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define BLOCK 8192
+
+/**
+ * @brief Double number format: the float pipeline's operations in double.
+ */
+struct pan_T_double {
+    typedef double sample;
+    typedef double wide;
+
+    static sample from_input(float Ain) { return Ain; }
+    static float to_float(sample x) { return (float) x; }
+
+    template <int HpLen>
+    static sample hp_gain(sample acc) { return acc / HpLen; }
+    static sample deriv_gain(sample acc) { return 0.125 * acc; }
+    static sample square(sample x) { return x * x; }
+    template <int MwiShift>
+    static sample mwi_gain(wide sum) { return sum / (1 << MwiShift); }
+    static sample half(sample x) { return 0.5 * x; }
+    static sample quarter(sample x) { return 0.25 * x; }
+    static sample running_avg8(const sample *w) {
+        double sum = 0.0;
+        for (int i = 0; i < 8; i++) {
+            sum += w[i];
+        }
+        return average8(sum);
+    }
+    static sample average8(wide sum) { return sum * 0.125; }
+    static bool noisy(sample npki, sample spki, float *NSR) {
+        double nsr = npki / sqrt(npki * npki + spki * spki);
+        *NSR = (float) nsr;
+        return nsr > SNR_THRESHOLD;
+    }
+};
+
+/* Scale of the LP output and of the levels (HP, MWI, thresholds) to input units. */
+template <typename Ops>
+struct soak_scale {
+    static double lp() { return 1.0; }
+    static double level() { return 1.0; }
+};
+
+template <>
+struct soak_scale<pan_T_fixed> {
+    static double lp() { return 1.0 / (1 << pan_T_fixed::input_q); }
+    static double level() { return 1.0 / (1 << pan_T_fixed::level_q); }
+};
+
+/* Per-sample values of one block. */
+struct soak_trace {
+    std::vector<double> lp, hp, mwi, thr, spki, npki;
+    std::vector<bool> qrs, noisy;
+
+    void resize(size_t n) {
+        lp.resize(n);
+        hp.resize(n);
+        mwi.resize(n);
+        thr.resize(n);
+        spki.resize(n);
+        npki.resize(n);
+        qrs.resize(n);
+        noisy.resize(n);
+    }
+};
+
+/* One channel: a detector with its noise classification. */
+template <typename Ops, typename Rate>
+struct soak_channel {
+    pan_T_Detector_T<Ops, Rate> det;
+    pan_T_Noise_T<Ops> noise;
+    bool generic;   // Filter with pan_T_Filter_Generic()
+
+    void init() {
+        pan_T_Detector_Init(&det);
+        pan_T_Noise_Init(&noise);
+    }
+
+    bool step(float x, typename Ops::sample *hp);
+
+    void run(const float *in, int n, soak_trace *t) {
+        typedef soak_scale<Ops> scale;
+        for (int k = 0; k < n; k++) {
+            typename Ops::sample hp;
+            t->qrs[k] = step(in[k], &hp);
+            t->noisy[k] = pan_T_Noise_Update(&noise, &det);
+            t->lp[k] = det.filter.y1[0] * scale::lp();
+            t->hp[k] = hp * scale::level();
+            t->mwi[k] = det.filter.mwi[0] * scale::level();
+            t->thr[k] = det.thresholdi1 * scale::level();
+            t->spki[k] = det.spki * scale::level();
+            t->npki[k] = det.npki * scale::level();
+        }
+    }
+};
+
+template <typename Ops, typename Rate>
+bool soak_channel<Ops, Rate>::step(float x, typename Ops::sample *hp) {
+    return pan_T_Detector_Process(&det, Ops::from_input(x), hp);
+}
+
+/* The generic filter only exists for the float state at the default rate. */
+template <>
+bool soak_channel<pan_T_float, pan_T_default_rate>::step(float x, float *hp) {
+    if (!generic) {
+        return pan_T_Detector_Process(&det, x, hp);
+    }
+    *hp = pan_T_Filter_Generic(&det.filter, x);
+    return pan_T_Threshold<pan_T_float>(&det.threshold, det.filter.mwi.taps(), &det.thresholdi1, &det.spki,
+                                        &det.npki, &det.spki_window, &det.npki_window,
+                                        (int) pan_T_default_rate::peak_lag);
+}
+
+/* Worst deviation of one value over an interval, and its largest reference value. */
+struct soak_error {
+    double diff;
+    double scale;
+
+    double rel() const {
+        return scale > 0.0 ? diff / scale : diff;
+    }
+};
+
+/* Worst deviations over one report interval. */
+struct soak_errors {
+    soak_error lp, hp, mwi, thr, spki, npki;
+    long qrs, noisy;
+
+    void clear() {
+        memset(this, 0, sizeof(*this));
+    }
+};
+
+static void track(soak_error *e, const std::vector<double> &a, const std::vector<double> &ref, int n) {
+    for (int k = 0; k < n; k++) {
+        e->diff = std::max(e->diff, fabs(a[k] - ref[k]));
+        e->scale = std::max(e->scale, fabs(ref[k]));
+    }
+}
+
+static void compare(soak_errors *e, const soak_trace &a, const soak_trace &ref, int n) {
+    track(&e->lp, a.lp, ref.lp, n);
+    track(&e->hp, a.hp, ref.hp, n);
+    track(&e->mwi, a.mwi, ref.mwi, n);
+    track(&e->thr, a.thr, ref.thr, n);
+    track(&e->spki, a.spki, ref.spki, n);
+    track(&e->npki, a.npki, ref.npki, n);
+    for (int k = 0; k < n; k++) {
+        e->qrs += a.qrs[k] != ref.qrs[k];
+        e->noisy += a.noisy[k] != ref.noisy[k];
+    }
+}
+
+/* True if a deviation more than doubled and is past rounding level. */
+static bool grew(double first, double last, double floor) {
+    return last > floor && last > 2.0 * std::max(first, floor);
+}
+
+struct soak_options {
+    std::string kernel;
+    double hours;
+    double interval_h;
+    double fs;
+};
+
+template <typename Ops, typename Rate>
+static int soak(const std::vector<float> &in, const soak_options &opt) {
+    soak_channel<Ops, Rate> *kernel = new soak_channel<Ops, Rate>();
+    soak_channel<pan_T_double, Rate> *ref = new soak_channel<pan_T_double, Rate>();
+    kernel->generic = opt.kernel == "generic";
+    ref->generic = false;
+    kernel->init();
+    ref->init();
+
+    long total = (long) (opt.hours * 3600.0 * opt.fs);
+    long per_interval = std::max(1L, (long) (opt.interval_h * 3600.0 * opt.fs));
+    soak_trace ta, tr;
+    ta.resize(BLOCK);
+    tr.resize(BLOCK);
+    std::vector<float> block(BLOCK);
+    soak_errors e, first;
+    e.clear();
+    first.clear();
+    bool have_first = false;
+    double kernel_s = 0.0, interval_s = 0.0;
+    long interval_n = 0;
+    size_t pos = 0;
+
+    printf("%d sps filters, %s kernel, %.1f h of %.0f Hz input (%zu sample loop)\n", (int) Rate::fs,
+           opt.kernel.c_str(), opt.hours, opt.fs, in.size());
+    printf("%8s %10s %10s %10s %10s %10s %10s %6s %6s %10s\n", "hour", "lp abs", "hp abs", "mwi rel", "thr rel",
+           "spki rel", "npki rel", "qrs", "noise", "Msample/s");
+    for (long done = 0; done < total;) {
+        int n = (int) std::min<long>(std::min<long>(BLOCK, total - done), per_interval - interval_n);
+        for (int k = 0; k < n; k++) {
+            block[k] = in[pos];
+            pos = pos + 1 < in.size() ? pos + 1 : 0;
+        }
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        kernel->run(block.data(), n, &ta);
+        double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        kernel_s += dt;
+        interval_s += dt;
+        ref->run(block.data(), n, &tr);
+        compare(&e, ta, tr, n);
+        done += n;
+        interval_n += n;
+        if (interval_n == per_interval || done == total) {
+            printf("%8.1f %10.3g %10.3g %10.3g %10.3g %10.3g %10.3g %6ld %6ld %10.2f\n", done / opt.fs / 3600.0,
+                   e.lp.diff, e.hp.diff, e.mwi.rel(), e.thr.rel(), e.spki.rel(), e.npki.rel(), e.qrs, e.noisy,
+                   interval_n / interval_s * 1e-6);
+            fflush(stdout);
+            if (!have_first) {
+                first = e;
+                have_first = true;
+            }
+            if (done < total) {
+                e.clear();
+            }
+            interval_n = 0;
+            interval_s = 0.0;
+        }
+    }
+
+    printf("sustained: %.2f Msample/s (%.1f ns/sample), %.0fx real time\n", total / kernel_s * 1e-6,
+           kernel_s / total * 1e9, total / kernel_s / opt.fs);
+    bool drift = grew(first.lp.diff, e.lp.diff, 1e-5) || grew(first.hp.diff, e.hp.diff, 1e-5) ||
+                 grew(first.mwi.rel(), e.mwi.rel(), 1e-4) || grew(first.thr.rel(), e.thr.rel(), 1e-4);
+    printf("%s\n", drift ? "DRIFT: errors of the last interval more than doubled over the first" : "stable");
+    delete kernel;
+    delete ref;
+    return drift ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    soak_options opt;
+    opt.kernel = "detector";
+    opt.hours = 24.0;
+    opt.interval_h = 1.0;
+    opt.fs = 360.0;
+    int rate = 200;
+    float noise_amp = 0.0f;
+    int signal = 0;
+    std::vector<const char *> records;
+    bool usage = false;
+    for (int a = 1; a < argc && !usage; a++) {
+        if (argv[a][0] == '-' && argv[a][1] != '\0' && argv[a][2] == '\0' && a + 1 < argc) {
+            const char *v = argv[++a];
+            switch (argv[a - 1][1]) {
+            case 'k': opt.kernel = v; break;
+            case 'R': rate = atoi(v); break;
+            case 'd': opt.hours = atof(v); break;
+            case 'i': opt.interval_h = atof(v); break;
+            case 'n': noise_amp = (float) atof(v); break;
+            case 's': signal = atoi(v); break;
+            default: usage = true; break;
+            }
+        } else if (argv[a][0] == '-') {
+            usage = true;
+        } else {
+            records.push_back(argv[a]);
+        }
+    }
+    bool known = opt.kernel == "detector" || opt.kernel == "fixed" || (opt.kernel == "generic" && rate == 200);
+    if (usage || !known || (rate != 200 && rate != 360) || opt.hours <= 0 || opt.interval_h <= 0) {
+        fprintf(stderr, "usage: %s [-k detector|generic|fixed] [-R 200|360] [-d hours] [-i hours] [-n noise] "
+                        "[-s signal] [record...]\n(generic needs -R 200)\n", argv[0]);
+        return 1;
+    }
+
+    // The records one after the other, or 10 min of synthetic ECG with the NST noise schedule
+    std::vector<float> in;
+    for (size_t r = 0; r < records.size(); r++) {
+        wfdb_record rec;
+        wfdb_stream stream;
+        if (!wfdb_open(&rec, records[r]) || !wfdb_stream_open(&stream, &rec, signal)) {
+            return 1;
+        }
+        opt.fs = rec.fs;
+        int raw[4096];
+        long got;
+        while ((got = wfdb_stream_read(&stream, raw, 4096)) > 0) {
+            for (long i = 0; i < got; i++) {
+                in.push_back(wfdb_to_input(raw[i]));
+            }
+        }
+        wfdb_stream_close(&stream);
+    }
+    if (records.empty()) {
+        synth_ecg gen;
+        synth_ecg_init(&gen, 0, noise_amp);
+        gen.clean_lead_s = 60.0f;
+        gen.segment_s = 60.0f;
+        for (long i = 0; i < (long) (600 * gen.fs); i++) {
+            in.push_back(synth_ecg_next(&gen) / 2048.0f);
+        }
+        opt.fs = gen.fs;
+    }
+    if (in.empty()) {
+        fprintf(stderr, "no samples\n");
+        return 1;
+    }
+
+    if (opt.kernel == "fixed") {
+        return rate == 200 ? soak<pan_T_fixed, pan_T_rate<200> >(in, opt) : soak<pan_T_fixed, pan_T_rate<360> >(in, opt);
+    }
+    return rate == 200 ? soak<pan_T_float, pan_T_rate<200> >(in, opt) : soak<pan_T_float, pan_T_rate<360> >(in, opt);
+}
@@ -0,0 +1,179 @@
+/* Threaded producer/consumer run of the detector over spsc_queue - host only
+ *
+ * A producer thread plays the part of ISRfxn(): it timestamps samples and
+ * pushes them into an spsc_queue at a fixed rate (-r, samples per second,
+ * 0 for as fast as possible). A consumer thread plays the main loop: it
+ * drains the queue in batches of up to -b samples and runs
+ * pan_T_Detector_Process() + pan_T_Noise_Update() on every sample. The
+ * queue and the rt_stats hooks are the ones main.cpp uses, with a host
+ * microsecond clock instead of us_ticker_read().
+ *
+ * Reports the sustained sample rate, overflows (lost samples), the queue's
+ * high-water mark and the push-to-processed latency, so you can find the
+ * rate the pipeline keeps up with on this machine.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -pthread -I. host/spsc_pipeline.cpp host/wfdb.cpp BME463_lib.cpp rt_stats.cpp -o spsc_pipeline
+ *
+ * Usage:
+ *   ./spsc_pipeline [-r rate] [-t seconds] [-b batch] [record]
+ */
+
+#define PAN_T_RT_STATS
+#include "BME463_lib.h"
+#include "rt_stats.h"
+#include "spsc_queue.h"
+#include "synth_ecg.h"
+#include "wfdb.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#define QUEUE_LEN 4096
+
+static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+static uint32_t host_clock(void) {
+    return (uint32_t) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static spsc_queue<timed_sample, QUEUE_LEN> samples;
+static rt_stats rt;
+static std::atomic<bool> producing(true);
+
+static void producer(const std::vector<float> *in, double rate, double seconds) {
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point stop = t0 + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                          std::chrono::duration<double>(seconds));
+    double period_ns = rate > 0 ? 1e9 / rate : 0.0;
+    size_t k = 0;
+    for (long n = 0;; n++) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now >= stop) {
+            break;
+        }
+        if (period_ns > 0) {
+            // Wait for this sample's tick, letting the consumer run meanwhile.
+            std::chrono::steady_clock::time_point due = t0 + std::chrono::nanoseconds((long long) (n * period_ns));
+            while (std::chrono::steady_clock::now() < due) {
+                std::this_thread::yield();
+            }
+        }
+        timed_sample sample;
+        sample.time = host_clock();
+        sample.value = (*in)[k];
+        k = k + 1 < in->size() ? k + 1 : 0;
+        RT_STATS_FRAME(&rt);
+        bool queued = samples.push(sample);
+        RT_STATS_TICK(&rt, !queued);
+        if (!queued && period_ns == 0) {
+            std::this_thread::yield();
+        }
+    }
+    producing = false;
+}
+
+static void consumer(int batch_len, long *beats) {
+    pan_T_Detector det;
+    pan_T_Noise_State noise;
+    pan_T_Detector_Init(&det);
+    pan_T_Noise_Init(&noise);
+    std::vector<timed_sample> batch(batch_len);
+    bool prev = false;
+    for (;;) {
+        bool last = !producing;     // Read before popping so nothing is left behind
+        int count = samples.pop(batch.data(), batch_len);
+        if (count == 0) {
+            if (last) {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        for (int k = 0; k < count; k++) {
+            RT_STATS_BEGIN_AT(&rt, batch[k].time);
+            bool qrs = pan_T_Detector_Process(&det, batch[k].value, NULL);
+            pan_T_Noise_Update(&noise, &det);
+            RT_STATS_END(&rt);
+            *beats += qrs && !prev;
+            prev = qrs;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    double rate = 0.0;
+    double seconds = 5.0;
+    int batch = 64;
+    const char *record = NULL;
+    for (int a = 1; a < argc; a++) {
+        if (argv[a][0] == '-' && argv[a][1] != '\0' && argv[a][2] == '\0' && a + 1 < argc) {
+            const char *v = argv[++a];
+            switch (argv[a - 1][1]) {
+            case 'r': rate = atof(v); break;
+            case 't': seconds = atof(v); break;
+            case 'b': batch = atoi(v) > 0 ? atoi(v) : 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-r rate] [-t seconds] [-b batch] [record]\n", argv[0]);
+                return 1;
+            }
+        } else {
+            record = argv[a];
+        }
+    }
+
+    // Input, replayed in a loop.
+    std::vector<float> in;
+    if (record != NULL) {
+        wfdb_record rec;
+        wfdb_stream stream;
+        if (!wfdb_open(&rec, record) || !wfdb_stream_open(&stream, &rec, 0)) {
+            return 1;
+        }
+        int raw[4096];
+        long got;
+        while ((got = wfdb_stream_read(&stream, raw, 4096)) > 0) {
+            for (long i = 0; i < got; i++) {
+                in.push_back(wfdb_to_input(raw[i]));
+            }
+        }
+        wfdb_stream_close(&stream);
+    } else {
+        synth_ecg gen;
+        synth_ecg_init(&gen, 0, 0.0f);
+        in.resize(360 * 600);
+        for (size_t i = 0; i < in.size(); i++) {
+            in[i] = synth_ecg_next(&gen) / 2048.0f;
+        }
+    }
+    if (in.empty()) {
+        fprintf(stderr, "no input samples\n");
+        return 1;
+    }
+
+    samples.clear();
+    rt_stats_init(&rt, host_clock, rate > 0 ? (uint32_t) (1e6 / rate) : 0);
+    long beats = 0;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    std::thread c(consumer, batch, &beats);
+    std::thread p(producer, &in, rate, seconds);
+    p.join();
+    c.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    rt_stats s;
+    rt_stats_snapshot(&rt, &s);
+    printf("target %s, %.1f s, batch %d, queue %d\n", rate > 0 ? "paced" : "unpaced", seconds, batch, samples.capacity());
+    if (rate > 0) {
+        printf("rate %.0f samples/s\n", rate);
+    }
+    printf("pushed %u, processed %u (%.3f Msamples/s), overflows %u (%.4f%%), high-water %u, beats %ld\n",
+           s.ticks - s.overruns, s.processed, s.processed / elapsed / 1e6, samples.overflows,
+           100.0 * samples.overflows / (s.ticks ? s.ticks : 1), samples.high_water, beats);
+    printf("latency us: min %u, mean %.1f, max %u; worst processing time %u us\n",
+           s.processed ? s.latency_min : 0, rt_stats_mean_latency(&s), s.latency_max, s.exec_max);
+    return 0;
+}
@@ -0,0 +1,66 @@
+/* Synthetic ECG for the host tools.
+ *
+ * Generates a deterministic ECG-like signal in the same units the sender
+ * board produces (11-bit ADC counts, divide by 2048 for the detector input):
+ * P, QRS and T waves as Gaussian bumps, baseline wander, and optional
+ * uniform noise bursts that follow the MIT-BIH Noise Stress Test schedule
+ * (clean lead-in, then alternating noisy/clean segments).
+ */
+
+#ifndef _synth_ecg
+#define _synth_ecg
+
+#include <math.h>
+#include <stdint.h>
+
+typedef struct _synth_ecg {
+    float fs;               // Sample rate, Hz
+    float rr;               // Beat interval, s
+    float noise_amp;        // Peak noise amplitude in ADC counts during noisy segments
+    float clean_lead_s;     // Clean lead-in, s
+    float segment_s;        // Length of the alternating noisy/clean segments, s
+    uint32_t seed;          // LCG state of the noise source
+    long n;                 // Next sample index
+} synth_ecg;
+
+/* Default record: 360 Hz, 75 bpm, MIT-BIH NST noise schedule. channel
+ * changes the phase, heart rate and noise sequence so channels differ.
+ */
+static inline void synth_ecg_init(synth_ecg *s, int channel, float noise_amp) {
+    s->fs = 360.0f;
+    s->rr = 0.8f + 0.013f * (channel % 16);
+    s->noise_amp = noise_amp;
+    s->clean_lead_s = 300.0f;
+    s->segment_s = 120.0f;
+    s->seed = 12345u + 7919u * (uint32_t) channel;
+    s->n = (long) channel * 37;
+}
+
+/* True if sample n falls into a noisy segment of the schedule. */
+static inline bool synth_ecg_noisy(const synth_ecg *s, long n) {
+    double t = n / (double) s->fs - s->clean_lead_s;
+    return t >= 0.0 && ((long) (t / s->segment_s) % 2) == 0;
+}
+
+static inline double synth_bump(double ph, double centre, double width) {
+    double d = (ph - centre) / width;
+    return exp(-d * d);
+}
+
+/* Next sample in ADC counts. */
+static inline int synth_ecg_next(synth_ecg *s) {
+    double t = s->n / (double) s->fs;
+    double ph = fmod(t, s->rr) / s->rr;
+    double v = 80.0 * synth_bump(ph, 0.10, 0.03)        // P
+             - 150.0 * synth_bump(ph, 0.28, 0.010)      // Q
+             + 900.0 * synth_bump(ph, 0.30, 0.012)      // R
+             + 200.0 * synth_bump(ph, 0.60, 0.05)       // T
+             + 100.0 * sin(2.0 * M_PI * 0.3 * t);       // Baseline wander
+    s->seed = s->seed * 1103515245u + 12345u;
+    double r = ((s->seed >> 16) & 0x7fff) / 32768.0 - 0.5;
+    v += (synth_ecg_noisy(s, s->n) ? s->noise_amp : 20.0) * r;
+    s->n++;
+    return (int) v;
+}
+
+#endif
@@ -0,0 +1,311 @@
+#include "wfdb.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Directory part of path including the trailing '/', or "" if none. */
+static void dir_of(const char *path, char *dir, size_t size) {
+    const char *slash = strrchr(path, '/');
+    size_t len = slash ? (size_t) (slash - path + 1) : 0;
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+}
+
+/* Parses the "format[xsamp][:skew][+offset]" field of a signal line. */
+static void parse_format(const char *field, wfdb_signal *sig) {
+    const char *plus = strchr(field, '+');
+    sig->format = atoi(field);
+    sig->offset = plus ? atol(plus + 1) : 0;
+}
+
+/* Parses the "gain[(baseline)][/units]" field; an empty or zero gain means 200. */
+static void parse_gain(const char *field, wfdb_signal *sig) {
+    const char *paren = strchr(field, '(');
+    sig->gain = (float) atof(field);
+    if (sig->gain == 0.0f) {
+        sig->gain = 200.0f;
+    }
+    sig->baseline = paren ? atoi(paren + 1) : sig->adczero;
+}
+
+bool wfdb_open(wfdb_record *rec, const char *path) {
+    char hea[512];
+    char dir[256];
+    char line[1024];
+    snprintf(hea, sizeof(hea), "%s.hea", path);
+    dir_of(path, dir, sizeof(dir));
+    memset(rec, 0, sizeof(*rec));
+
+    FILE *f = fopen(hea, "r");
+    if (f == NULL) {
+        fprintf(stderr, "wfdb: cannot open %s\n", hea);
+        return false;
+    }
+
+    // Record line, skipping comments: name[/segments] nsig [fs[/counterfreq][(base)] [nsamp ...]]
+    bool have_record = false;
+    int s = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+            continue;
+        }
+        char *save = NULL;
+        if (!have_record) {
+            char *name = strtok_r(line, " \t\r\n", &save);
+            char *nsig = strtok_r(NULL, " \t\r\n", &save);
+            char *fs = strtok_r(NULL, " \t\r\n", &save);
+            char *nsamp = strtok_r(NULL, " \t\r\n", &save);
+            if (name == NULL || nsig == NULL) {
+                break;
+            }
+            if (strchr(name, '/') != NULL) {
+                fprintf(stderr, "wfdb: %s: multi-segment records are not supported\n", hea);
+                fclose(f);
+                return false;
+            }
+            snprintf(rec->name, sizeof(rec->name), "%s", name);
+            rec->nsig = atoi(nsig);
+            rec->fs = fs ? (float) atof(fs) : 250.0f;
+            rec->nsamp = nsamp ? atol(nsamp) : 0;
+            if (rec->nsig <= 0 || rec->nsig > WFDB_MAX_SIGNALS) {
+                fprintf(stderr, "wfdb: %s: unsupported number of signals %d\n", hea, rec->nsig);
+                fclose(f);
+                return false;
+            }
+            have_record = true;
+            continue;
+        }
+        if (s >= rec->nsig) {
+            break;
+        }
+
+        // Signal line: file format gain adcres adczero initval checksum blocksize description
+        wfdb_signal *sig = &rec->sig[s];
+        char *fields[9];
+        int nf = 0;
+        char *tok;
+        while (nf < 9 && (tok = strtok_r(nf == 0 ? line : NULL, " \t\r\n", &save)) != NULL) {
+            fields[nf++] = tok;
+        }
+        if (nf < 2) {
+            fprintf(stderr, "wfdb: %s: bad signal line %d\n", hea, s + 1);
+            fclose(f);
+            return false;
+        }
+        if (fields[0][0] == '/') {
+            snprintf(sig->file, sizeof(sig->file), "%s", fields[0]);
+        } else {
+            snprintf(sig->file, sizeof(sig->file), "%s%s", dir, fields[0]);
+        }
+        parse_format(fields[1], sig);
+        sig->adczero = nf > 4 ? atoi(fields[4]) : 0;
+        if (nf > 2) {
+            parse_gain(fields[2], sig);
+        } else {
+            sig->gain = 200.0f;
+            sig->baseline = sig->adczero;
+        }
+        if (nf > 8) {
+            // The description is the rest of the line; strtok_r left it split.
+            snprintf(sig->description, sizeof(sig->description), "%s%s%s", fields[8], save && *save ? " " : "", save ? save : "");
+            sig->description[strcspn(sig->description, "\r\n")] = '\0';
+        }
+        if (sig->format != 212 && sig->format != 16) {
+            fprintf(stderr, "wfdb: %s: signal %d has unsupported format %d\n", hea, s, sig->format);
+            fclose(f);
+            return false;
+        }
+        s++;
+    }
+    fclose(f);
+    if (!have_record || s != rec->nsig) {
+        fprintf(stderr, "wfdb: %s: header is incomplete\n", hea);
+        return false;
+    }
+
+    // Signals sharing a file are interleaved frame by frame, in header order.
+    for (int i = 0; i < rec->nsig; i++) {
+        rec->sig[i].index = 0;
+        rec->sig[i].nsig_in_file = 0;
+        for (int j = 0; j < rec->nsig; j++) {
+            if (strcmp(rec->sig[i].file, rec->sig[j].file) == 0) {
+                if (j < i) {
+                    rec->sig[i].index++;
+                }
+                rec->sig[i].nsig_in_file++;
+                if (rec->sig[j].format != rec->sig[i].format) {
+                    fprintf(stderr, "wfdb: %s: mixed formats in %s are not supported\n", hea, rec->sig[i].file);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool wfdb_stream_open(wfdb_stream *stream, const wfdb_record *rec, int signal) {
+    memset(stream, 0, sizeof(*stream));
+    if (signal < 0 || signal >= rec->nsig) {
+        fprintf(stderr, "wfdb: %s has no signal %d\n", rec->name, signal);
+        return false;
+    }
+    const wfdb_signal *sig = &rec->sig[signal];
+    int fd = open(sig->file, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "wfdb: cannot open %s\n", sig->file);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= sig->offset) {
+        fprintf(stderr, "wfdb: %s is empty\n", sig->file);
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "wfdb: cannot map %s\n", sig->file);
+        return false;
+    }
+    madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+
+    stream->map = (const unsigned char *) map;
+    stream->map_size = (size_t) st.st_size;
+    stream->format = sig->format;
+    stream->offset = sig->offset;
+    stream->index = sig->index;
+    stream->nsig_in_file = sig->nsig_in_file;
+
+    // Samples actually present in the file; the header count may be missing.
+    long bytes = (long) st.st_size - sig->offset;
+    long values = sig->format == 212 ? bytes / 3 * 2 + (bytes % 3 == 2 ? 1 : 0) : bytes / 2;
+    long frames = values / sig->nsig_in_file;
+    stream->nsamp = (rec->nsamp > 0 && rec->nsamp < frames) ? rec->nsamp : frames;
+    return true;
+}
+
+/* Decodes the k-th value of a format 212 stream: pairs of 12-bit two's
+ * complement samples packed into 3 bytes.
+ */
+static inline int decode_212(const unsigned char *p, long k) {
+    const unsigned char *b = p + (k >> 1) * 3;
+    int v;
+    if ((k & 1) == 0) {
+        v = b[0] | ((b[1] & 0x0F) << 8);
+    } else {
+        v = b[2] | ((b[1] & 0xF0) << 4);
+    }
+    return v >= 2048 ? v - 4096 : v;
+}
+
+long wfdb_stream_read(wfdb_stream *stream, int *out, long n) {
+    if (stream->map == NULL) {
+        return 0;
+    }
+    if (n > stream->nsamp - stream->pos) {
+        n = stream->nsamp - stream->pos;
+    }
+    const unsigned char *data = stream->map + stream->offset;
+    long k = stream->pos * stream->nsig_in_file + stream->index;
+    if (stream->format == 212) {
+        for (long i = 0; i < n; i++, k += stream->nsig_in_file) {
+            out[i] = decode_212(data, k);
+        }
+    } else {
+        for (long i = 0; i < n; i++, k += stream->nsig_in_file) {
+            out[i] = (short) (data[2 * k] | (data[2 * k + 1] << 8));
+        }
+    }
+    stream->pos += n;
+    return n;
+}
+
+void wfdb_stream_seek(wfdb_stream *stream, long pos) {
+    stream->pos = pos < 0 ? 0 : (pos > stream->nsamp ? stream->nsamp : pos);
+}
+
+void wfdb_stream_close(wfdb_stream *stream) {
+    if (stream->map != NULL) {
+        munmap((void *) stream->map, stream->map_size);
+    }
+    memset(stream, 0, sizeof(*stream));
+}
+
+/* MIT annotation format: a stream of little-endian 16-bit words, the top 6
+ * bits an annotation code and the low 10 bits the sample interval since the
+ * previous annotation. A few pseudo codes carry extra fields.
+ */
+#define ANN_SKIP 59     // Next 4 bytes: 32-bit interval, high word first
+#define ANN_NUM 60
+#define ANN_SUB 61
+#define ANN_CHN 62      // Low 10 bits: chan of this and later annotations
+#define ANN_AUX 63      // Low 10 bits: length of an aux string that follows, padded to even
+
+long wfdb_read_annotations(const char *path, const char *annotator, wfdb_annotation **out) {
+    char name[512];
+    snprintf(name, sizeof(name), "%s.%s", path, annotator);
+    *out = NULL;
+    FILE *f = fopen(name, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "wfdb: cannot open %s\n", name);
+        return -1;
+    }
+
+    long count = 0;
+    long capacity = 0;
+    wfdb_annotation *ann = NULL;
+    long time = 0;
+    int chan = 0;
+    unsigned char w[4];
+    while (fread(w, 1, 2, f) == 2) {
+        int code = w[1] >> 2;
+        long interval = w[0] | ((w[1] & 0x03) << 8);
+        if (code == 0 && interval == 0) {
+            break;
+        }
+        if (code == ANN_SKIP) {
+            if (fread(w, 1, 4, f) != 4) {
+                break;
+            }
+            time += ((long) (w[0] | (w[1] << 8)) << 16) | (w[2] | (w[3] << 8));
+        } else if (code == ANN_AUX) {
+            fseek(f, (interval + 1) & ~1L, SEEK_CUR);
+        } else if (code == ANN_CHN) {
+            chan = (int) interval;
+        } else if (code == ANN_NUM || code == ANN_SUB) {
+            // Not needed for beat matching.
+        } else {
+            time += interval;
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 1024;
+                wfdb_annotation *grown = (wfdb_annotation *) realloc(ann, capacity * sizeof(*ann));
+                if (grown == NULL) {
+                    free(ann);
+                    fclose(f);
+                    fprintf(stderr, "wfdb: out of memory reading %s\n", name);
+                    return -1;
+                }
+                ann = grown;
+            }
+            ann[count].sample = time;
+            ann[count].code = code;
+            ann[count].chan = chan;
+            count++;
+        }
+    }
+    fclose(f);
+    *out = ann;
+    return count;
+}
+
+bool wfdb_is_beat(int code) {
+    return (code >= 1 && code <= 13) || code == 25 || code == 30 || code == 34 ||
+           code == 35 || code == 38 || code == 41;
+}
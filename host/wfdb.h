@@ -0,0 +1,132 @@
+/* WFDB (PhysioNet) record reader - host only
+ *
+ * Reads MIT-BIH style records: a text header (<record>.hea) describing one or
+ * more signals stored in binary signal files (<record>.dat) in format 212 or
+ * 16. Signal files are memory-mapped and decoded on the fly in chunks, so a
+ * record of any length is replayed without loading it into heap memory.
+ *
+ * Samples are returned as raw ADC values, the same integer the sender board
+ * transmits. wfdb_to_input() scales them like ISRfxn() does in main.cpp.
+ */
+
+#ifndef _wfdb
+#define _wfdb
+
+#include <stddef.h>
+
+#define WFDB_MAX_SIGNALS 16
+
+/**
+ * @brief One signal of a record, as described by its header line.
+ */
+typedef struct _wfdb_signal {
+    char file[512];         // Signal file path, relative paths resolved against the header
+    int format;             // 212 or 16
+    long offset;            // Byte offset of the first sample in the file
+    int index;              // Position of the signal within its file's frames
+    int nsig_in_file;       // Number of signals interleaved in the file
+    float gain;             // ADC units per physical unit
+    int baseline;           // ADC value of 0 physical units
+    int adczero;            // ADC value of the middle of the ADC range
+    char description[64];
+} wfdb_signal;
+
+/**
+ * @brief An open record.
+ */
+typedef struct _wfdb_record {
+    char name[64];
+    int nsig;
+    float fs;               // Sample rate, Hz
+    long nsamp;             // Samples per signal, 0 if not given in the header
+    wfdb_signal sig[WFDB_MAX_SIGNALS];
+} wfdb_record;
+
+/**
+ * @brief Decoding cursor over one signal of a record.
+ *
+ * Holds the memory mapping of the signal file. Open it with wfdb_stream_open()
+ * and release it with wfdb_stream_close().
+ */
+typedef struct _wfdb_stream {
+    const unsigned char *map;   // Mapped signal file
+    size_t map_size;
+    int format;
+    long offset;
+    int index;
+    int nsig_in_file;
+    long nsamp;                 // Samples available to this stream
+    long pos;                   // Next sample index
+} wfdb_stream;
+
+/**
+ * @brief Parses a record header.
+ *
+ * @param rec Record to fill.
+ * @param path Record path without extension, e.g. "data/118e06". ".hea" is appended.
+ * @return bool True on success; on failure a message is printed to stderr.
+ */
+bool wfdb_open(wfdb_record *rec, const char *path);
+
+/**
+ * @brief Memory-maps the file of one signal and positions the stream at sample 0.
+ *
+ * @param stream Stream to open.
+ * @param rec Record opened with wfdb_open().
+ * @param signal Signal number, 0 <= signal < rec->nsig.
+ * @return bool True on success; on failure a message is printed to stderr.
+ */
+bool wfdb_stream_open(wfdb_stream *stream, const wfdb_record *rec, int signal);
+
+/**
+ * @brief Decodes up to n samples from the current position.
+ *
+ * @param stream Open stream.
+ * @param out Raw ADC values.
+ * @param n Maximum number of samples to decode.
+ * @return long Number of samples decoded, 0 at the end of the signal.
+ */
+long wfdb_stream_read(wfdb_stream *stream, int *out, long n);
+
+/**
+ * @brief Moves the stream to sample index pos.
+ */
+void wfdb_stream_seek(wfdb_stream *stream, long pos);
+
+/**
+ * @brief Unmaps the signal file.
+ */
+void wfdb_stream_close(wfdb_stream *stream);
+
+/**
+ * @brief One annotation of an annotation file (e.g. the .atr beat labels).
+ */
+typedef struct _wfdb_annotation {
+    long sample;            // Sample index the annotation refers to
+    int code;               // MIT annotation code, 1 = NORMAL, 5 = PVC, ...
+    int chan;
+} wfdb_annotation;
+
+/**
+ * @brief Reads an MIT format annotation file.
+ *
+ * @param path Record path without extension.
+ * @param annotator Annotation file extension, e.g. "atr".
+ * @param out Receives a malloc'ed array of annotations; free() it when done.
+ * @return long Number of annotations, or -1 on error (message printed to stderr).
+ */
+long wfdb_read_annotations(const char *path, const char *annotator, wfdb_annotation **out);
+
+/**
+ * @brief True if an annotation code labels a beat (a QRS complex), as in WFDB's isqrs().
+ */
+bool wfdb_is_beat(int code);
+
+/**
+ * @brief Scales a raw ADC value to the detector input, like ISRfxn() does.
+ */
+static inline float wfdb_to_input(int num) {
+    return (float) num / 2048.0f;
+}
+
+#endif
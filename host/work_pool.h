@@ -0,0 +1,93 @@
+/* Work-stealing thread pool for the host tools - host only
+ *
+ * Every worker owns a deque of tasks. Tasks are dealt round-robin to the
+ * workers up front; a worker runs tasks from the back of its own deque and,
+ * once that is empty, steals from the front of the other workers' deques.
+ * Records differ a lot in length, so stealing keeps all cores busy until the
+ * last task is done.
+ *
+ * Usage:
+ *   work_pool pool(threads);
+ *   pool.add([&]{ ... });
+ *   pool.run();             // Blocks until every task has finished
+ */
+
+#ifndef _work_pool
+#define _work_pool
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class work_pool {
+public:
+    explicit work_pool(unsigned threads)
+        : queues_(threads ? threads : default_threads()), next_(0) {
+    }
+
+    static unsigned default_threads() {
+        unsigned n = std::thread::hardware_concurrency();
+        return n ? n : 1;
+    }
+
+    unsigned threads() const {
+        return (unsigned) queues_.size();
+    }
+
+    void add(std::function<void()> task) {
+        queues_[next_].tasks.push_back(task);
+        next_ = (next_ + 1) % queues_.size();
+    }
+
+    void run() {
+        std::vector<std::thread> workers;
+        for (unsigned i = 1; i < queues_.size(); i++) {
+            workers.push_back(std::thread(&work_pool::work, this, i));
+        }
+        work(0);
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+
+private:
+    struct queue {
+        std::mutex lock;
+        std::deque<std::function<void()> > tasks;
+    };
+
+    bool take(unsigned self, std::function<void()> *task) {
+        {
+            std::lock_guard<std::mutex> guard(queues_[self].lock);
+            if (!queues_[self].tasks.empty()) {
+                *task = queues_[self].tasks.back();
+                queues_[self].tasks.pop_back();
+                return true;
+            }
+        }
+        for (unsigned k = 1; k < queues_.size(); k++) {
+            queue &victim = queues_[(self + k) % queues_.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                *task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(unsigned self) {
+        std::function<void()> task;
+        while (take(self, &task)) {
+            task();
+        }
+    }
+
+    std::vector<queue> queues_;
+    size_t next_;
+};
+
+#endif
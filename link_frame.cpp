@@ -0,0 +1,140 @@
+#include "link_frame.h"
+#include <string.h>
+
+/**
+ * @brief CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) of a byte array.
+ *
+ * @param data Bytes to checksum.
+ * @param n Number of bytes.
+ * @return uint16_t The CRC.
+ */
+uint16_t link_crc16(const uint8_t *data, int n){
+    uint16_t crc = 0xFFFF;
+    for (int i = 0; i < n; i++) {
+        crc ^= (uint16_t) (data[i] << 8);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+        }
+    }
+    return crc;
+}
+
+/**
+ * @brief Serialises a frame.
+ *
+ * @param frame Frame to send, 1 <= frame->count <= LINK_MAX_SAMPLES.
+ * @param out Buffer of at least LINK_FRAME_LEN(frame->count) bytes.
+ * @return int Number of bytes written.
+ */
+int link_encode(const link_frame *frame, uint8_t *out){
+    int n = 0;
+    out[n++] = LINK_SYNC0;
+    out[n++] = LINK_SYNC1;
+    out[n++] = frame->seq;
+    out[n++] = frame->count;
+    for (int i = 0; i < frame->count; i++) {
+        uint16_t s = (uint16_t) frame->samples[i];
+        out[n++] = (uint8_t) (s & 0xFF);
+        out[n++] = (uint8_t) (s >> 8);
+    }
+    uint16_t crc = link_crc16(out + 2, n - 2);
+    out[n++] = (uint8_t) (crc & 0xFF);
+    out[n++] = (uint8_t) (crc >> 8);
+    return n;
+}
+
+/**
+ * @brief Resets a decoder and its counters.
+ */
+void link_decoder_init(link_decoder *dec){
+    memset(dec, 0, sizeof(*dec));
+}
+
+/* Drops the first from bytes of buf and any bytes after them up to the
+ * next sync byte, which becomes buf[0]. from is 1 to drop a bad frame, so
+ * a sync pattern inside it is not missed, and the frame length to drop a
+ * good one. Only bytes before a possible frame start count as skipped.
+ */
+static void shift_to_sync(link_decoder *dec, int from, bool skipped){
+    int next = from;
+    while (next < dec->pos && dec->buf[next] != LINK_SYNC0) {
+        next++;
+    }
+    dec->skipped_bytes += (uint32_t) (skipped ? next : next - from);
+    dec->pos -= next;
+    memmove(dec->buf, dec->buf + next, dec->pos);
+}
+
+/* Unpacks the valid frame at the start of buf. */
+static void unpack(link_decoder *dec){
+    link_frame *f = &dec->frame;
+    f->seq = dec->buf[2];
+    f->count = dec->buf[3];
+    for (int i = 0; i < f->count; i++) {
+        const uint8_t *p = dec->buf + LINK_HEADER_LEN + 2 * i;
+        f->samples[i] = (int16_t) (uint16_t) (p[0] | (p[1] << 8));
+    }
+    if (dec->frames > 0 && f->seq != dec->next_seq) {
+        dec->lost_frames += (uint8_t) (f->seq - dec->next_seq);
+    }
+    dec->next_seq = (uint8_t) (f->seq + 1);
+    dec->frames++;
+    dec->ready = true;
+}
+
+/**
+ * @brief Feeds one received byte to the decoder.
+ *
+ * buf holds the bytes from the current candidate sync byte on. Each byte is
+ * appended and buf is rescanned in place until it holds an incomplete
+ * candidate: a bad frame is dropped by shifting buf down to the next sync
+ * byte after its first one, and the rest is scanned again in the same loop,
+ * so neither the stack nor buf grows with the number of false sync pairs.
+ * In the unlikely case that the bytes kept after a bad frame hold more than
+ * one complete frame, only the last one is returned and the others show up
+ * in lost_frames.
+ *
+ * @param dec Decoder.
+ * @param b Received byte.
+ * @return bool True if the byte completed a valid frame; it is in dec->frame
+ *         until the next call.
+ */
+bool link_decode_byte(link_decoder *dec, uint8_t b){
+    dec->ready = false;
+    dec->buf[dec->pos++] = b;   // pos < LINK_FRAME_MAX between calls
+    while (dec->pos > 0) {
+        if (dec->buf[0] != LINK_SYNC0) {
+            shift_to_sync(dec, 0, true);
+            continue;
+        }
+        if (dec->pos < 2) {
+            break;
+        }
+        if (dec->buf[1] != LINK_SYNC1) {
+            shift_to_sync(dec, 1, true);
+            continue;
+        }
+        if (dec->pos < LINK_HEADER_LEN) {
+            break;
+        }
+        int count = dec->buf[3];
+        if (count < 1 || count > LINK_MAX_SAMPLES) {
+            dec->bad_headers++;
+            shift_to_sync(dec, 1, true);
+            continue;
+        }
+        int len = LINK_FRAME_LEN(count);
+        if (dec->pos < len) {
+            break;
+        }
+        uint16_t crc = (uint16_t) (dec->buf[len - 2] | (dec->buf[len - 1] << 8));
+        if (link_crc16(dec->buf + 2, len - 4) != crc) {
+            dec->crc_errors++;
+            shift_to_sync(dec, 1, true);
+            continue;
+        }
+        unpack(dec);
+        shift_to_sync(dec, len, false);
+    }
+    return dec->ready;
+}
@@ -0,0 +1,91 @@
+/* Framed, checksummed sample link between the sender and receiver boards.
+ *
+ * The original link sends every sample as its two bytes followed by a '\0'
+ * terminator. '\0' is also a valid data byte, so a single lost byte can make
+ * the receiver assemble wrong samples without noticing, and every sample
+ * costs 3 bytes on the wire. A link frame carries up to LINK_MAX_SAMPLES
+ * samples with a sequence number and a CRC:
+ *
+ *      0xA5 0x5A  seq  count  s0_lo s0_hi ... s(count-1)_hi  crc_lo crc_hi
+ *
+ * seq counts frames modulo 256, count is 1..LINK_MAX_SAMPLES, samples are
+ * little endian int16_t ADC values (num in main.cpp) and crc is the
+ * CRC-16/CCITT-FALSE of seq, count and the samples. With 16 samples per frame
+ * that is 2.375 bytes per sample.
+ *
+ * link_decode_byte() takes one byte at a time, so it can run on bytes as
+ * they come out of the receive interrupt's queue. It hunts for the sync
+ * bytes, checks the count and the CRC, and on any error restarts the hunt
+ * at the byte after the bad frame's first sync byte, so it resynchronises
+ * within one frame. The hunt rescans the bytes it holds in place, so its
+ * stack and buffer use do not depend on the input. Frames missing from the seq sequence are counted.
+ */
+
+#ifndef _link_frame
+#define _link_frame
+
+#include <stdint.h>
+
+#define LINK_SYNC0 0xA5
+#define LINK_SYNC1 0x5A
+#define LINK_MAX_SAMPLES 32
+#define LINK_HEADER_LEN 4                   // sync0, sync1, seq, count
+#define LINK_FRAME_LEN(count) (LINK_HEADER_LEN + 2 * (count) + 2)
+#define LINK_FRAME_MAX LINK_FRAME_LEN(LINK_MAX_SAMPLES)
+
+/**
+ * @brief Payload of one link frame.
+ */
+typedef struct _link_frame {
+    uint8_t seq;
+    uint8_t count;
+    int16_t samples[LINK_MAX_SAMPLES];
+} link_frame;
+
+/**
+ * @brief Byte-wise link frame decoder and its error counters.
+ */
+typedef struct _link_decoder {
+    uint8_t buf[LINK_FRAME_MAX];    // Bytes from the current candidate sync byte on
+    int pos;                        // Bytes in buf
+    bool ready;                     // A frame was completed by the last byte
+    uint8_t next_seq;
+    link_frame frame;               // Last complete frame
+
+    uint32_t frames;                // Frames decoded
+    uint32_t crc_errors;            // Frames dropped for a bad CRC
+    uint32_t bad_headers;           // Frames dropped for a bad count
+    uint32_t lost_frames;           // Gaps in the seq sequence
+    uint32_t skipped_bytes;         // Bytes discarded while hunting for sync
+} link_decoder;
+
+/**
+ * @brief CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) of a byte array.
+ */
+uint16_t link_crc16(const uint8_t *data, int n);
+
+/**
+ * @brief Serialises a frame.
+ *
+ * @param frame Frame to send, 1 <= frame->count <= LINK_MAX_SAMPLES.
+ * @param out Buffer of at least LINK_FRAME_LEN(frame->count) bytes.
+ * @return int Number of bytes written.
+ */
+int link_encode(const link_frame *frame, uint8_t *out);
+
+/**
+ * @brief Resets a decoder and its counters.
+ */
+void link_decoder_init(link_decoder *dec);
+
+/**
+ * @brief Feeds one received byte to the decoder.
+ *
+ * @param dec Decoder.
+ * @param b Received byte.
+ * @return bool True if the byte completed a valid frame; it is in dec->frame
+ *         until the next call.
+ */
+bool link_decode_byte(link_decoder *dec, uint8_t b);
+
+#endif
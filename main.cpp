@@ -18,11 +18,16 @@
 
 #include "mbed.h"
 #include "BME463_lib.h"
+#include "decimator.h"
+#include "flight_rec.h"
+#include "link_frame.h"
+#include "receiver_config.h"
+#include "rt_stats.h"
+#include "spsc_queue.h"
+#include "stack_watermark.h"
 #include <cstdio>
 #include <cstring>
 
-#define SNR_THRESHOLD 0.09
-
 //**************************************************************************
 /* Pin Declarations */
 //**************************************************************************
@@ -51,22 +56,81 @@ myShort data;
 char d;         // Variable to hold the current byte extracted from Sender
 int num;        // Integer version of the myShort value
 int i = 0;      // Index counter for number of bytes received
-float samp_rate = 360.0f;           // Sample rate of the ISR
+float samp_rate = SAMP_RATE;        // Sample rate of the ISR
 
 // Ticker for the ISR
 Ticker sampTick; 
 
+#ifdef PAN_T_RT_STATS
+// Overrun, latency and execution time statistics of the ISR and main loop
+// (build with -DPAN_T_RT_STATS). Read with rt_stats_snapshot() or a debugger.
+rt_stats rt;
+
+// Stack high-water mark below main()'s frame, in bytes, updated every
+// STACK_CHECK_PERIOD processed samples. STACK_PAINT_BYTES must not exceed
+// the stack the linker reserves (host/mem_report estimates the budget).
+#ifndef STACK_PAINT_BYTES
+#define STACK_PAINT_BYTES 1024
+#endif
+#define STACK_CHECK_PERIOD 4096
+stack_watermark stack;
+uint32_t stack_used;
+#endif
+
+#ifdef PAN_T_FLIGHT_REC
+// Flight recorder of the detector state (build with -DPAN_T_FLIGHT_REC, see
+// flight_rec.h). Freezes FLIGHT_REC_LEN / 2 samples after a noise state
+// transition; dump it with the debugger, decode with host/flight_decode and
+// re-arm with flight_rec_arm().
+flight_rec flight;
+#endif
+
+// Bytes received from the sender, queued by RXfxn() on the receive interrupt
+// so the main loop never waits in sender.getc().
+spsc_queue<uint8_t, RX_QUEUE_LEN> rx_bytes;
+
+#ifdef PAN_T_FRAMED_LINK
+// Framed link (build with -DPAN_T_FRAMED_LINK, see link_frame.h). The sender
+// transmits samples in frames, so decoded samples wait in the playout queue
+// and ISRfxn() takes one per tick. Playout starts, and restarts after the
+// queue ran dry, once PLAYOUT_PREFILL samples are buffered.
+link_decoder link;
+spsc_queue<int16_t, PLAYOUT_QUEUE_LEN> playout;
+bool playing = false;
+#endif
+
 // Prototypes
 void ISRfxn();
+void RXfxn();
 
 //**************************************************************************
 /* GLOBAL VARIABLES */
 //************************************************************************** 76 cols
 /* State Variables */ 
-bool FILTERING_FLAG = false;
+// Samples taken by ISRfxn() and not processed yet. The queue absorbs the time
+// the main loop spends decoding received bytes; a full queue is an overrun.
+spsc_queue<timed_sample, SAMPLE_QUEUE_LEN> samples;
 
-/* DSP Relevant Variables */ 
-float input = 0.0;
+/* Number format of the detector: float, or the saturating fixed-point
+ * pipeline of pan_T_pipeline.h when built with -DPAN_T_FIXED_POINT.
+ */
+#ifdef PAN_T_FIXED_POINT
+typedef pan_T_fixed pan_T_ops;
+#else
+typedef pan_T_float pan_T_ops;
+#endif
+
+/* Rate the detector runs at. By default every sample goes to the detector,
+ * whose filter delays are designed for PAN_T_FS (200 sps). Building with
+ * -DPAN_T_DECIMATE=M decimates the input by M first and runs the detector
+ * with the delays for SAMP_RATE / M, so a faster front end does not cost
+ * proportionally more detector time.
+ */
+#ifdef PAN_T_DECIMATE
+typedef pan_T_rate<SAMP_RATE / PAN_T_DECIMATE> pan_T_detector_rate;
+#else
+typedef pan_T_default_rate pan_T_detector_rate;
+#endif
 
 //**************************************************************************
 /* Main Application */
@@ -74,73 +138,101 @@ float input = 0.0;
 int main() {
 //**************************************************************************
     /* Main App, Local Variables */ 
-    float output[3] = {0.0, 0.0, 0.0};
-    float NSR = 0.0;
-    float npki = 0.0;
-    float spki = 0.0;
-    float npki_clean = 0.0;
-    float spki_clean = 0.0;
-    float npki_array[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
-    float spki_array[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
-    float spki_array_clean[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
-    float npki_array_clean[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
-    float thresholdi1 = 0.0;
+    // The per-channel state is static so it is counted in .bss, where the
+    // linker checks it against the RAM of the part, instead of on the stack.
+    static pan_T_Detector_T<pan_T_ops, pan_T_detector_rate> det;  // Filter, threshold and spki/npki state of the channel
+    static pan_T_Noise_T<pan_T_ops> noise;    // NSR classification and "last known clean" windows
     bool QRS_detected = false;
     bool cur_noise_state = false;
-    bool prev_noise_state = false;
-    float filter_splice = 0.0;
+    pan_T_ops::sample filter_splice = 0;
+    timed_sample batch[SAMPLE_BATCH];
+#ifdef PAN_T_DECIMATE
+    decimator<PAN_T_DECIMATE> front_end;  // Low-pass and downsample to the detector rate
+#endif
+    uint8_t rx_batch[RX_BATCH];
+#ifdef PAN_T_RT_STATS
+    uint32_t stack_check = 0;
+
+    __disable_irq();
+    stack_paint(&stack, STACK_PAINT_BYTES);
+    __enable_irq();
+#endif
 
 //**************************************************************************
+    pan_T_Detector_Init(&det);
+    pan_T_Noise_Init(&noise);
+#ifdef PAN_T_DECIMATE
+    front_end.init();
+#endif
+
     // Set up serial communication
     sender.baud(115200);
+    rx_bytes.clear();
+#ifdef PAN_T_FRAMED_LINK
+    link_decoder_init(&link);
+    playout.clear();
+#endif
+    sender.attach(&RXfxn, Serial::RxIrq);
     //pc.baud(115200); // Optional debugging.
+
+#ifdef PAN_T_RT_STATS
+    rt_stats_init(&rt, us_ticker_read, (uint32_t) (1000000.0f / samp_rate));
+#endif
+#ifdef PAN_T_FLIGHT_REC
+    flight_rec_init(&flight, flight_format(pan_T_ops::sample()), (float) pan_T_detector_rate::fs,
+                    FLIGHT_TRIG_NOISY | FLIGHT_TRIG_CLEAN, FLIGHT_REC_LEN / 2);
+#endif
     
     // Sample num at a fixed rate
+    samples.clear();
     sampTick.attach(&ISRfxn, 1.0f/samp_rate);
     // Get data from sender
 //**************************************************************************
     while (1) { // MAIN LOOP //
 //**************************************************************************
-        /* Sender Code SPI Processing. DO NOT TOUCH */ 
-        // Get the current character from Sender
-        d = sender.getc();
-        
-        // If the byte we got was a '\0', it is possibly the terminator
-        if (d == '\0' && i >= sizeof(short)){
-            i = 0;                          // Reset index counter.
-            num = (int) data.s;             // Convert the short to an int.
-        } else if (i < sizeof(short)) {     // If 2 bytes haven't been received, 
-            data.h[i++] = d;                // then the byte is added to data
+        // Decode every byte the receive interrupt queued meanwhile
+        int nbytes = rx_bytes.pop(rx_batch, RX_BATCH);
+        for(int b = 0; b < nbytes; b++){
+#ifdef PAN_T_FRAMED_LINK
+            if (link_decode_byte(&link, rx_batch[b])){
+                for(int s = 0; s < link.frame.count; s++){
+                    playout.push(link.frame.samples[s]);
+                }
+            }
+#else
+            /* Sender Code SPI Processing. DO NOT TOUCH */ 
+            // Get the current character from Sender
+            d = (char) rx_batch[b];
+            
+            // If the byte we got was a '\0', it is possibly the terminator
+            if (d == '\0' && i >= sizeof(short)){
+                i = 0;                          // Reset index counter.
+                num = (int) data.s;             // Convert the short to an int.
+                RT_STATS_FRAME(&rt);
+            } else if (i < sizeof(short)) {     // If 2 bytes haven't been received, 
+                data.h[i++] = d;                // then the byte is added to data
+            }
+#endif
         }
         //******************************************************************
 
-        if(FILTERING_FLAG){
-            filter_splice = pan_T_Filter(input, output);
-            QRS_detected = pan_T_Threshold(output, &thresholdi1, &spki, &npki, spki_array, npki_array);
-
-            NSR = npki/sqrt(npki*npki + spki*spki);
-            cur_noise_state = NSR > SNR_THRESHOLD;
-            
-            if(!cur_noise_state){
-                // Acceptable amount of noise, save copy to clean array
-                save_array(npki_array, npki_array_clean, 8);
-                save_array(spki_array, spki_array_clean, 8);
-                spki_clean = spki;
-                npki_clean = npki;
-            }          
-            
-            if(!cur_noise_state && prev_noise_state){    
-                // If state transitions from noisy to clean, restore spki and npki arrays to clean state 
-                save_array(npki_array_clean, npki_array, 8);
-                save_array(spki_array_clean, spki_array, 8);
-                spki = array_average(spki_array, 8);
-                npki = array_average(npki_array, 8);
+        // Process every sample the ISR queued meanwhile, oldest first
+        int count = samples.pop(batch, SAMPLE_BATCH);
+        for(int k = 0; k < count; k++){
+            float input = batch[k].value;
+#ifdef PAN_T_DECIMATE
+            if (!front_end.push(input, &input)) {
+                continue;                   // Not a detector sample
             }
-            
-            prev_noise_state = cur_noise_state;
+#endif
+            RT_STATS_BEGIN_AT(&rt, batch[k].time);
+            QRS_detected = pan_T_Detector_Process(&det, pan_T_ops::from_input(input), &filter_splice);
+
+            cur_noise_state = pan_T_Noise_Update(&noise, &det);
+            FLIGHT_REC(&flight, &det, &noise, filter_splice, QRS_detected);
             
             ADC3 = input; 
-            ADC4 = spki;
+            ADC4 = pan_T_ops::to_float(det.spki);
 
             D12_Out = cur_noise_state;
             D11_Out = QRS_detected;
@@ -148,15 +240,46 @@ int main() {
                 D13_LED = 1;
             }
             
-            FILTERING_FLAG = false;
+            RT_STATS_END(&rt);
+#ifdef PAN_T_RT_STATS
+            ADC5 = rt_stats_load(&rt);  // Worst-case fraction of the sample period used
+            if (++stack_check == STACK_CHECK_PERIOD) {
+                stack_check = 0;
+                stack_used = stack_high_water(&stack);
+            }
+#endif
         }
     }
 }
 
 
-/* Interrupt function. Computes the ADC value of num and outputs the voltage. */
+/* Interrupt function. Computes the ADC value of num and queues it, with the
+ * time of the tick, for the main loop. With the framed link, num is first
+ * advanced to the next received sample. */
 void ISRfxn() {
-    float fnum = (float) num/2048.0f;
-    input = fnum;
-    FILTERING_FLAG = true;
+#ifdef PAN_T_FRAMED_LINK
+    if (!playing && playout.size() >= PLAYOUT_PREFILL) {
+        playing = true;
+    }
+    int16_t raw;
+    if (playing && playout.pop(&raw)) {
+        num = raw;
+        RT_STATS_FRAME(&rt);
+    } else {
+        playing = false;                // Ran dry: hold num and refill
+    }
+#endif
+    timed_sample sample;
+    sample.time = us_ticker_read();
+    sample.value = (float) num/2048.0f;
+    bool queued = samples.push(sample);
+    RT_STATS_TICK(&rt, !queued);
+}
+
+/* Receive interrupt. Moves every byte the UART holds into rx_bytes; a full
+ * queue drops the byte and counts it in rx_bytes.overflows. */
+void RXfxn() {
+    while (sender.readable()) {
+        rx_bytes.push((uint8_t) sender.getc());
+    }
 }
@@ -0,0 +1,273 @@
+#include "pan_T_multi.h"
+#include <string.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+/* Row of PAN_T_MULTI_LANES floats held in registers, and a lane mask.
+ *
+ * Only the handful of operations the detector needs are provided. Each
+ * backend does exactly one IEEE single precision operation per lane per call
+ * (no fused multiply-add), so every lane rounds like the scalar code.
+ */
+#if defined(__AVX__)
+
+typedef struct { __m256 v; } vrow;
+typedef struct { __m256 m; } vmask;
+
+static inline vrow v_load(const float *p) { vrow r; r.v = _mm256_loadu_ps(p); return r; }
+static inline void v_store(float *p, vrow a) { _mm256_storeu_ps(p, a.v); }
+static inline vrow v_set(float x) { vrow r; r.v = _mm256_set1_ps(x); return r; }
+static inline vrow v_add(vrow a, vrow b) { vrow r; r.v = _mm256_add_ps(a.v, b.v); return r; }
+static inline vrow v_sub(vrow a, vrow b) { vrow r; r.v = _mm256_sub_ps(a.v, b.v); return r; }
+static inline vrow v_mul(vrow a, vrow b) { vrow r; r.v = _mm256_mul_ps(a.v, b.v); return r; }
+static inline vmask v_gt(vrow a, vrow b) { vmask r; r.m = _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); return r; }
+static inline vmask v_le(vrow a, vrow b) { vmask r; r.m = _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); return r; }
+static inline vmask v_lt(vrow a, vrow b) { vmask r; r.m = _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); return r; }
+static inline vmask m_and(vmask a, vmask b) { vmask r; r.m = _mm256_and_ps(a.m, b.m); return r; }
+static inline vmask m_andnot(vmask a, vmask b) { vmask r; r.m = _mm256_andnot_ps(a.m, b.m); return r; } // ~a & b
+static inline int m_bits(vmask a) { return _mm256_movemask_ps(a.m); }
+static inline vrow v_select(vmask m, vrow a, vrow b) { vrow r; r.v = _mm256_blendv_ps(b.v, a.v, m.m); return r; }
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+typedef struct { __m128 lo, hi; } vrow;
+typedef struct { __m128 lo, hi; } vmask;
+
+static inline vrow v_load(const float *p) { vrow r; r.lo = _mm_loadu_ps(p); r.hi = _mm_loadu_ps(p + 4); return r; }
+static inline void v_store(float *p, vrow a) { _mm_storeu_ps(p, a.lo); _mm_storeu_ps(p + 4, a.hi); }
+static inline vrow v_set(float x) { vrow r; r.lo = r.hi = _mm_set1_ps(x); return r; }
+static inline vrow v_add(vrow a, vrow b) { vrow r; r.lo = _mm_add_ps(a.lo, b.lo); r.hi = _mm_add_ps(a.hi, b.hi); return r; }
+static inline vrow v_sub(vrow a, vrow b) { vrow r; r.lo = _mm_sub_ps(a.lo, b.lo); r.hi = _mm_sub_ps(a.hi, b.hi); return r; }
+static inline vrow v_mul(vrow a, vrow b) { vrow r; r.lo = _mm_mul_ps(a.lo, b.lo); r.hi = _mm_mul_ps(a.hi, b.hi); return r; }
+static inline vmask v_gt(vrow a, vrow b) { vmask r; r.lo = _mm_cmpgt_ps(a.lo, b.lo); r.hi = _mm_cmpgt_ps(a.hi, b.hi); return r; }
+static inline vmask v_le(vrow a, vrow b) { vmask r; r.lo = _mm_cmple_ps(a.lo, b.lo); r.hi = _mm_cmple_ps(a.hi, b.hi); return r; }
+static inline vmask v_lt(vrow a, vrow b) { vmask r; r.lo = _mm_cmplt_ps(a.lo, b.lo); r.hi = _mm_cmplt_ps(a.hi, b.hi); return r; }
+static inline vmask m_and(vmask a, vmask b) { vmask r; r.lo = _mm_and_ps(a.lo, b.lo); r.hi = _mm_and_ps(a.hi, b.hi); return r; }
+static inline vmask m_andnot(vmask a, vmask b) { vmask r; r.lo = _mm_andnot_ps(a.lo, b.lo); r.hi = _mm_andnot_ps(a.hi, b.hi); return r; }
+static inline int m_bits(vmask a) { return _mm_movemask_ps(a.lo) | (_mm_movemask_ps(a.hi) << 4); }
+static inline vrow v_select(vmask m, vrow a, vrow b) {
+    vrow r;
+    r.lo = _mm_or_ps(_mm_and_ps(m.lo, a.lo), _mm_andnot_ps(m.lo, b.lo));
+    r.hi = _mm_or_ps(_mm_and_ps(m.hi, a.hi), _mm_andnot_ps(m.hi, b.hi));
+    return r;
+}
+
+#else
+
+typedef struct { float v[PAN_T_MULTI_LANES]; } vrow;
+typedef struct { bool m[PAN_T_MULTI_LANES]; } vmask;
+
+#define LANES for (int l = 0; l < PAN_T_MULTI_LANES; l++)
+
+static inline vrow v_load(const float *p) { vrow r; LANES r.v[l] = p[l]; return r; }
+static inline void v_store(float *p, vrow a) { LANES p[l] = a.v[l]; }
+static inline vrow v_set(float x) { vrow r; LANES r.v[l] = x; return r; }
+static inline vrow v_add(vrow a, vrow b) { vrow r; LANES r.v[l] = a.v[l] + b.v[l]; return r; }
+static inline vrow v_sub(vrow a, vrow b) { vrow r; LANES r.v[l] = a.v[l] - b.v[l]; return r; }
+static inline vrow v_mul(vrow a, vrow b) { vrow r; LANES r.v[l] = a.v[l] * b.v[l]; return r; }
+static inline vmask v_gt(vrow a, vrow b) { vmask r; LANES r.m[l] = a.v[l] > b.v[l]; return r; }
+static inline vmask v_le(vrow a, vrow b) { vmask r; LANES r.m[l] = a.v[l] <= b.v[l]; return r; }
+static inline vmask v_lt(vrow a, vrow b) { vmask r; LANES r.m[l] = a.v[l] < b.v[l]; return r; }
+static inline vmask m_and(vmask a, vmask b) { vmask r; LANES r.m[l] = a.m[l] && b.m[l]; return r; }
+static inline vmask m_andnot(vmask a, vmask b) { vmask r; LANES r.m[l] = !a.m[l] && b.m[l]; return r; }
+static inline int m_bits(vmask a) { int bits = 0; LANES bits |= (int) a.m[l] << l; return bits; }
+static inline vrow v_select(vmask m, vrow a, vrow b) { vrow r; LANES r.v[l] = m.m[l] ? a.v[l] : b.v[l]; return r; }
+
+#undef LANES
+
+#endif
+
+/* Writes the newest row of a lane_delay_line after advance(). */
+template <int N>
+static inline void push_row(lane_delay_line<N> *line, vrow x) {
+    line->advance();
+    v_store(line->row(0), x);
+    v_store(line->mirror(), x);
+}
+
+template <int N>
+static inline vrow row(lane_delay_line<N> *line, int k) {
+    return v_load(line->row(k));
+}
+
+// The filters below are written out for the delays of pan_T_multi_rate; a
+// change of those delays must be made here as well.
+typedef char pan_T_multi_taps_are_200_sps[(pan_T_multi_rate::lp_delay == 6 && pan_T_multi_rate::hp_delay == 16 &&
+                                           pan_T_multi_rate::deriv_step == 1 && pan_T_multi_rate::mwi_len == 30 &&
+                                           pan_T_multi_rate::mwi_shift == 5 && pan_T_multi_rate::peak_lag == 2)
+                                          ? 1 : -1];
+
+static int const mwi_len = pan_T_multi_rate::mwi_len;
+
+/**
+ * @brief Resets all lanes of a group.
+ *
+ * @param group Group to reset.
+ */
+void pan_T_Multi_Init(pan_T_Multi *group){
+    memset(group, 0, sizeof(*group));
+}
+
+/**
+ * @brief Runs one sample of every lane through the filter and threshold stages.
+ *
+ * The tap lists are the ones of pan_T_Filter(), spelled out as vector
+ * multiply-adds in the same order.
+ *
+ * @param group Group of channels.
+ * @param Ain One ADC sample per lane.
+ * @param filtered Optional output for the filtered value of every lane, may be NULL.
+ * @return int Bit i is set if a QRS complex is detected on lane i.
+ */
+int pan_T_Multi_Process(pan_T_Multi *group, const float *Ain, float *filtered){
+    vrow zero = v_set(0.0f);
+    vrow acc, fb, value, y3;
+
+    /* LP filter: y = 2y(nT-T) - y(nT-2T) + x - 2x(nT-6T) + x(nT-12T) */
+    push_row(&group->x1, v_load(Ain));
+    acc = v_add(zero, row(&group->x1, 0));
+    acc = v_add(acc, v_mul(v_set(-2.0f), row(&group->x1, 6)));
+    acc = v_add(acc, row(&group->x1, 12));
+    fb = v_add(zero, v_mul(v_set(2.0f), row(&group->y1, 0)));
+    fb = v_add(fb, v_mul(v_set(-1.0f), row(&group->y1, 1)));
+    push_row(&group->y1, v_add(fb, v_mul(v_set(1.0f), acc)));
+
+    /* HP Filter: y = y(nT-T) + (-x + 32x(nT-16T) - 32x(nT-17T) + x(nT-33T))/32
+     * The scalar pipeline applies the 1/32 after the recursion instead; both
+     * give the same floats since the gain is a power of two.
+     */
+    push_row(&group->x2, row(&group->y1, 0));
+    acc = v_add(zero, v_mul(v_set(-1.0f), row(&group->x2, 0)));
+    acc = v_add(acc, v_mul(v_set(32.0f), row(&group->x2, 16)));
+    acc = v_add(acc, v_mul(v_set(-32.0f), row(&group->x2, 17)));
+    acc = v_add(acc, row(&group->x2, 33));
+    fb = v_add(zero, row(&group->y2, 0));
+    value = v_add(fb, v_mul(v_set(1.0f/32.0f), acc));
+    push_row(&group->y2, value);
+    if (filtered != NULL) {
+        v_store(filtered, value);
+    }
+
+    /* Deriv 2 Filter */
+    push_row(&group->x3, value);
+    acc = v_add(zero, v_mul(v_set(2.0f), row(&group->x3, 0)));
+    acc = v_add(acc, row(&group->x3, 1));
+    acc = v_add(acc, v_mul(v_set(-1.0f), row(&group->x3, 3)));
+    acc = v_add(acc, v_mul(v_set(-2.0f), row(&group->x3, 4)));
+    y3 = v_mul(v_set(1.0f/8.0f), acc);
+
+    /* Squaring Filter */
+    y3 = v_mul(y3, y3);
+
+    /* Moving Integral Filter, running sum renormalized when the ring wraps */
+    push_row(&group->x4, y3);
+    vrow sum;
+    if (group->x4.head == 0) {
+        sum = zero;
+        for (int i = 0; i < mwi_len; i++) {
+            sum = v_add(sum, row(&group->x4, i));
+        }
+    } else {
+        sum = v_add(v_load(group->x4_sum), v_sub(y3, row(&group->x4, mwi_len)));
+    }
+    v_store(group->x4_sum, sum);
+    push_row(&group->mwi, v_mul(v_set(0.03125f), sum));
+
+    /* Moving threshold, see pan_T_Threshold(). Every branch of the scalar
+     * version becomes a lane mask and the updates are blended in.
+     */
+    vrow y0 = row(&group->mwi, 0);
+    vrow y2 = row(&group->mwi, 2);
+    vrow peakt = v_load(group->peakt);
+    vrow thr = v_load(group->thresholdi1);
+    vrow qrs = v_load(group->QRS_detected);
+
+    peakt = v_select(m_and(v_gt(y0, y2), v_gt(y0, peakt)), y0, peakt);
+    qrs = v_select(v_gt(peakt, thr), v_set(1.0f), qrs);
+
+    vmask fall = m_and(v_le(y0, y2), v_lt(y0, v_mul(v_set(0.5f), peakt)));
+    if (m_bits(fall) != 0) {
+        vmask is_signal = v_gt(peakt, thr);
+        vmask sig = m_and(fall, is_signal);
+        vmask noise = m_andnot(is_signal, fall);
+        vrow spki = v_load(group->spki);
+        vrow npki = v_load(group->npki);
+        vrow s_oldest = v_load(group->spki_window[7]);
+        vrow n_oldest = v_load(group->npki_window[7]);
+
+        // Shift the peak into the windows of the lanes it belongs to.
+        for (int k = 7; k > 0; k--) {
+            v_store(group->spki_window[k], v_select(sig, v_load(group->spki_window[k - 1]), v_load(group->spki_window[k])));
+            v_store(group->npki_window[k], v_select(noise, v_load(group->npki_window[k - 1]), v_load(group->npki_window[k])));
+        }
+        v_store(group->spki_window[0], v_select(sig, peakt, v_load(group->spki_window[0])));
+        v_store(group->npki_window[0], v_select(noise, peakt, v_load(group->npki_window[0])));
+
+        // Running window sums, recomputed on every 8th peak of a lane exactly
+        // as running_window::push() does.
+        vrow s_pushes = v_select(sig, v_add(v_load(group->spki_pushes), v_set(1.0f)), v_load(group->spki_pushes));
+        vrow n_pushes = v_select(noise, v_add(v_load(group->npki_pushes), v_set(1.0f)), v_load(group->npki_pushes));
+        vmask s_wrap = m_and(sig, v_gt(s_pushes, v_set(7.5f)));
+        vmask n_wrap = m_and(noise, v_gt(n_pushes, v_set(7.5f)));
+        vrow ssum = v_select(sig, v_add(v_load(group->spki_sum), v_sub(peakt, s_oldest)), v_load(group->spki_sum));
+        vrow nsum = v_select(noise, v_add(v_load(group->npki_sum), v_sub(peakt, n_oldest)), v_load(group->npki_sum));
+        if (m_bits(s_wrap) != 0 || m_bits(n_wrap) != 0) {
+            vrow sfull = zero;
+            vrow nfull = zero;
+            for (int k = 0; k < 8; k++) {
+                sfull = v_add(sfull, v_load(group->spki_window[k]));
+                nfull = v_add(nfull, v_load(group->npki_window[k]));
+            }
+            ssum = v_select(s_wrap, sfull, ssum);
+            nsum = v_select(n_wrap, nfull, nsum);
+            s_pushes = v_select(s_wrap, zero, s_pushes);
+            n_pushes = v_select(n_wrap, zero, n_pushes);
+        }
+        v_store(group->spki_sum, ssum);
+        v_store(group->npki_sum, nsum);
+        v_store(group->spki_pushes, s_pushes);
+        v_store(group->npki_pushes, n_pushes);
+        spki = v_select(sig, v_mul(ssum, v_set(0.125f)), spki);
+        npki = v_select(noise, v_mul(nsum, v_set(0.125f)), npki);
+
+        thr = v_select(fall, v_add(npki, v_mul(v_set(0.25f), v_sub(spki, npki))), thr);
+        qrs = v_select(fall, zero, qrs);
+        peakt = v_select(fall, zero, peakt);
+        v_store(group->spki, spki);
+        v_store(group->npki, npki);
+        v_store(group->thresholdi1, thr);
+    }
+
+    v_store(group->peakt, peakt);
+    v_store(group->QRS_detected, qrs);
+    return m_bits(v_gt(qrs, zero));
+}
+
+/**
+ * @brief Runs one sample of n channels through a contiguous array of groups.
+ *
+ * @param groups Array of (n + PAN_T_MULTI_LANES - 1) / PAN_T_MULTI_LANES groups.
+ * @param n Number of channels.
+ * @param Ain One ADC sample per channel.
+ * @param QRS_detected One flag per channel, set if a QRS complex is detected.
+ */
+void pan_T_Multi_Process_Channels(pan_T_Multi *groups, int n, const float *Ain, bool *QRS_detected){
+    for (int c = 0; c < n; c += PAN_T_MULTI_LANES) {
+        float lanes[PAN_T_MULTI_LANES];
+        const float *in = Ain + c;
+        int used = n - c < PAN_T_MULTI_LANES ? n - c : PAN_T_MULTI_LANES;
+        if (used < PAN_T_MULTI_LANES) {
+            memset(lanes, 0, sizeof(lanes));
+            memcpy(lanes, in, used * sizeof(float));
+            in = lanes;
+        }
+        int bits = pan_T_Multi_Process(&groups[c / PAN_T_MULTI_LANES], in, NULL);
+        for (int l = 0; l < used; l++) {
+            QRS_detected[c + l] = (bits >> l) & 1;
+        }
+    }
+}
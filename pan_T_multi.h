@@ -0,0 +1,120 @@
+/* Multi-channel Pan-Tompkins QRS detector.
+ *
+ * Runs PAN_T_MULTI_LANES ECG channels in lock-step. Every stage keeps its
+ * history as a structure-of-arrays ring (one row per delay, one column per
+ * channel) with a single head shared by all channels, so one sample of all
+ * channels is filtered with a handful of SIMD instructions per stage. The
+ * threshold stage is done branch-free with compare masks.
+ *
+ * The filter and threshold math is the same as pan_T_Filter() and
+ * pan_T_Threshold() on a pan_T_Detector, in the same order, so each lane
+ * produces exactly the same outputs as a scalar detector fed the same
+ * samples. The engine only implements the 200 sps filters
+ * (pan_T_multi_rate): its taps are written out for those delays, so it
+ * matches pan_T_Detector only while PAN_T_FS is 200, and matches
+ * pan_T_Detector_T<pan_T_float, pan_T_multi_rate> at any PAN_T_FS.
+ *
+ * The vector code is picked at compile time: AVX (one 8-wide vector per
+ * row), SSE2 (two 4-wide vectors), or a plain scalar loop for everything
+ * else, including the Cortex-M4 build.
+ */
+
+#ifndef _pan_T_multi
+#define _pan_T_multi
+
+#include "pan_T_pipeline.h"
+
+#define PAN_T_MULTI_LANES 8
+
+/* Rate of the filters of pan_T_Multi; no other rate is supported. */
+typedef pan_T_rate<200> pan_T_multi_rate;
+
+/* Delay line of PAN_T_MULTI_LANES channels, see delay_line.h. Rows are
+ * mirrored like delay_line, so row(k) for k < N is always valid.
+ */
+template <int N>
+struct lane_delay_line {
+    float buf[2 * N][PAN_T_MULTI_LANES];
+    int head;
+
+    /* Row of samples k steps in the past, one per channel. */
+    float *row(int k) {
+        return buf[head + k];
+    }
+
+    /* Drops the oldest row. The caller must then write the new samples to
+     * both row(0) and mirror().
+     */
+    void advance() {
+        head = (head == 0) ? N - 1 : head - 1;
+    }
+
+    /* Mirror of the newest row, which must be written along with row(0). */
+    float *mirror() {
+        return buf[head + N];
+    }
+};
+
+/**
+ * @brief State of PAN_T_MULTI_LANES QRS detectors advanced in lock-step.
+ *
+ * The filter rings match pan_T_Filter_State, the per-lane arrays match the
+ * scalar fields of pan_T_Detector. spki_window/npki_window hold the last 8
+ * peaks of every lane, newest in row 0, with their running sums and the
+ * number of peaks since the sums were last recomputed, as in
+ * running_window. A zero filled group is a valid, freshly reset detector.
+ */
+typedef struct _pan_T_Multi {
+    lane_delay_line<pan_T_multi_rate::lp_ring> x1;
+    lane_delay_line<3> y1;
+    lane_delay_line<pan_T_multi_rate::hp_ring> x2;
+    lane_delay_line<2> y2;
+    lane_delay_line<pan_T_multi_rate::deriv_ring> x3;
+    lane_delay_line<pan_T_multi_rate::mwi_ring> x4;
+    float x4_sum[PAN_T_MULTI_LANES];
+    lane_delay_line<pan_T_multi_rate::peak_ring> mwi;
+
+    float peakt[PAN_T_MULTI_LANES];
+    float QRS_detected[PAN_T_MULTI_LANES];  // 1.0 or 0.0
+    float thresholdi1[PAN_T_MULTI_LANES];
+    float spki[PAN_T_MULTI_LANES];
+    float npki[PAN_T_MULTI_LANES];
+    float spki_window[8][PAN_T_MULTI_LANES];
+    float npki_window[8][PAN_T_MULTI_LANES];
+    float spki_sum[PAN_T_MULTI_LANES];
+    float npki_sum[PAN_T_MULTI_LANES];
+    float spki_pushes[PAN_T_MULTI_LANES];   // 0..7
+    float npki_pushes[PAN_T_MULTI_LANES];
+} pan_T_Multi;
+
+/**
+ * @brief Resets all lanes of a group.
+ *
+ * @param group Group to reset.
+ */
+void pan_T_Multi_Init(pan_T_Multi *group);
+
+/**
+ * @brief Runs one sample of every lane through the filter and threshold stages.
+ *
+ * @param group Group of channels.
+ * @param Ain One ADC sample per lane.
+ * @param filtered Optional output for the filtered value of every lane, may be NULL.
+ * @return int Bit i is set if a QRS complex is detected on lane i.
+ */
+int pan_T_Multi_Process(pan_T_Multi *group, const float *Ain, float *filtered);
+
+/**
+ * @brief Runs one sample of n channels through a contiguous array of groups.
+ *
+ * Channel c is lane c % PAN_T_MULTI_LANES of groups[c / PAN_T_MULTI_LANES].
+ * Unused lanes of the last group are fed zeros.
+ *
+ * @param groups Array of (n + PAN_T_MULTI_LANES - 1) / PAN_T_MULTI_LANES groups.
+ * @param n Number of channels.
+ * @param Ain One ADC sample per channel.
+ * @param QRS_detected One flag per channel, set if a QRS complex is detected.
+ */
+void pan_T_Multi_Process_Channels(pan_T_Multi *groups, int n, const float *Ain, bool *QRS_detected);
+
+#endif
@@ -0,0 +1,608 @@
+/* Pan-Tompkins pipeline templated on its number format and sample rate.
+ *
+ * The filter, threshold and noise classification stages are written once,
+ * against a number format Ops and a sample rate Rate (pan_T_rate<Fs>, see
+ * below; PAN_T_FS = 200 sps unless defined otherwise), and instantiated for
+ *
+ *  - pan_T_float: the original float arithmetic. pan_T_Filter_State,
+ *    pan_T_Detector, ... in BME463_lib.h are these instantiations. The
+ *    filter outputs are bit-identical to the float code they replace; spki
+ *    and npki come from the running sums of their windows (running_window.h)
+ *    and can differ from the re-added averages in the last bits.
+ *
+ *  - pan_T_fixed: int32_t samples. All Pan-Tompkins coefficients are small
+ *    integers and at 200 sps every gain is a power of two, so the filters
+ *    run on exact integer adds and the gains only move the binary point:
+ *
+ *        stage           format   float value = integer * 2^-q
+ *        input, LP       Q11      (the ADC count, num)
+ *        HP output       Q16      (LP / 32 without dropping bits)
+ *        derivative      Q19      (HP / 8 without dropping bits)
+ *        square, MWI,    Q16      (Q38 product >> 22, MWI sum >> 5)
+ *        thresholds
+ *
+ *    Nothing is rounded before the square, so the recursive LP and HP
+ *    filters cannot drift. The input is saturated to 13 bits (+-4096 ADC
+ *    counts, twice the sender's range); with that bound no intermediate,
+ *    including the 30 sample MWI sum (int64_t), can overflow at 200 sps.
+ *    At other rates the HP gain 1/hp_len is a Q16 reciprocal multiply, and
+ *    the square saturates, since the LP gain grows with the square of the
+ *    rate. The HP recursion runs on the moving sum before the gain, which
+ *    stays exact at every rate, so the rounding of the gain never enters
+ *    its feedback.
+ *    The NSR test npki / sqrt(npki^2 + spki^2) > SNR_THRESHOLD is evaluated
+ *    as npki > k * spki with k = T / sqrt(1 - T^2) precomputed, so there is
+ *    no square root or division per sample.
+ *
+ * The stage functions have the same names as the float API in BME463_lib.h;
+ * the non-template float overloads are picked for float states, these
+ * templates for everything else. main.cpp selects the format at compile time
+ * with PAN_T_FIXED_POINT.
+ */
+
+#ifndef _pan_T_pipeline
+#define _pan_T_pipeline
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "delay_line.h"
+#include "filter_kernels.h"
+#include "running_window.h"
+
+// NSR above which the signal is classified as noisy (undiagnosable).
+#ifndef SNR_THRESHOLD
+#define SNR_THRESHOLD 0.09
+#endif
+
+// The same limit for the fixed-point NSR test, k = T / sqrt(1 - T^2) in Q16:
+// 0.09 / sqrt(1 - 0.09 * 0.09) * 65536 + 0.5 = 5922. A build that overrides
+// SNR_THRESHOLD must define it to match; BME463_lib.cpp checks that it does.
+#ifndef PAN_T_NSR_LIMIT_Q16
+#define PAN_T_NSR_LIMIT_Q16 5922
+#endif
+
+// Sample rate the detector runs at unless a pan_T_rate is given explicitly.
+#ifndef PAN_T_FS
+#define PAN_T_FS 200
+#endif
+
+/* ceil(log2(N)), N >= 1. */
+template <int N>
+struct pan_T_ceil_log2 {
+    enum { value = 1 + pan_T_ceil_log2<(N + 1) / 2>::value };
+};
+
+template <>
+struct pan_T_ceil_log2<1> {
+    enum { value = 0 };
+};
+
+/**
+ * @brief Filter delays of the Pan-Tompkins pipeline at Fs samples per second.
+ *
+ * The delays are the times of the original design rounded to samples: LP
+ * notch delay 30 ms, HP delay 80 ms (its moving average spans twice that),
+ * a 5 point derivative with a spacing of one 200 sps sample, and a 150 ms
+ * moving window integrator. The MWI gain is the power of two at or above
+ * its length. The threshold stage looks for MWI peaks by comparing outputs
+ * 10 ms (peak_lag samples) apart. At 200 sps this is exactly the original
+ * filter set: the non zero coefficients of a1/b1, a2/b2 and a3 in
+ * BME463_lib.cpp and the 30 entries of a4 with gain 1/32.
+ *
+ * The filters are compile-time tap lists, see filter_kernels.h; the feedback
+ * taps are the negated b coefficients without the leading 1. The rings are
+ * one sample longer than the longest tap; the MWI ring is two samples longer
+ * than the window, which sets how often its running sum is renormalized,
+ * and the MWI output ring keeps the peak_lag + 1 outputs the threshold reads.
+ *
+ * Both the LP and the HP filter are linear phase: the band-passed value lags
+ * the input by bp_delay samples (lp_delay - 1 for the LP, hp_delay for the
+ * HP). pan_T_Beat_Update() subtracts it from the largest band-passed value
+ * in the beat_window samples up to beat_lookahead (40 ms) after a detection
+ * to time the R peak.
+ */
+template <int Fs>
+struct pan_T_rate {
+    enum {
+        fs = Fs,
+        lp_delay = (Fs * 3 + 50) / 100,
+        hp_delay = (Fs * 8 + 50) / 100,
+        hp_len = 2 * hp_delay,
+        deriv_step = Fs < 300 ? 1 : (Fs + 100) / 200,
+        mwi_len = (Fs * 15 + 50) / 100,
+        mwi_shift = pan_T_ceil_log2<mwi_len>::value,
+        peak_lag = (Fs + 50) / 100,
+        bp_delay = lp_delay - 1 + hp_delay,
+        beat_lookahead = (Fs * 4 + 50) / 100,
+        beat_window = mwi_len + 2 * deriv_step + beat_lookahead,
+
+        lp_ring = 2 * lp_delay + 1,
+        hp_ring = hp_len + 2,
+        deriv_ring = 4 * deriv_step + 1,
+        mwi_ring = mwi_len + 2,
+        peak_ring = peak_lag + 1,
+        beat_ring = beat_window + 1
+    };
+
+    typedef tap<0, 1, tap<lp_delay, -2, tap<2 * lp_delay, 1> > > lp_taps;
+    typedef tap<0, 2, tap<1, -1> > lp_feedback;
+    typedef tap<0, -1, tap<hp_delay, hp_len, tap<hp_delay + 1, -hp_len, tap<hp_len + 1, 1> > > > hp_taps;
+    typedef tap<0, 1> hp_feedback;
+    typedef tap<0, 2, tap<deriv_step, 1, tap<3 * deriv_step, -1, tap<4 * deriv_step, -2> > > > deriv_taps;
+};
+
+typedef pan_T_rate<PAN_T_FS> pan_T_default_rate;
+
+/**
+ * @brief Float number format: the arithmetic of the original pipeline.
+ */
+struct pan_T_float {
+    typedef float sample;   // Every signal and level
+    typedef float wide;     // MWI running sum
+
+    static sample from_input(float Ain) { return Ain; }
+    static float to_float(sample x) { return x; }
+
+    template <int HpLen>
+    static sample hp_gain(sample acc) { return (1.0f / HpLen) * acc; }
+    static sample deriv_gain(sample acc) { return 0.125f * acc; }
+    static sample square(sample x) { return x * x; }
+    template <int MwiShift>
+    static sample mwi_gain(wide sum) { return (1.0f / (1 << MwiShift)) * sum; }
+    static sample half(sample x) { return 0.5f * x; }
+    static sample quarter(sample x) { return 0.25f * x; }
+
+    /* Average of an 8 entry window as window_running_avg() computes it. */
+    static sample running_avg8(const sample *w) {
+        float average = 0.0;
+        for (int i = 0; i < 8; i++) {
+            average += w[i] * 0.125;
+        }
+        return average;
+    }
+
+    /* Average of an 8 entry window from its running sum. */
+    static sample average8(wide sum) { return sum * 0.125f; }
+
+    static bool noisy(sample npki, sample spki, float *NSR) {
+        *NSR = npki / sqrt(npki * npki + spki * spki);
+        return *NSR > SNR_THRESHOLD;
+    }
+};
+
+/**
+ * @brief Saturating int32_t fixed-point number format, see the table above.
+ */
+struct pan_T_fixed {
+    typedef int32_t sample;
+    typedef int64_t wide;
+
+    enum {
+        input_q = 11,       // Input and LP output
+        level_q = 16,       // HP output, MWI and thresholds
+        input_max = 4095    // Saturation limit of the input, ADC counts
+    };
+
+    static sample from_input(float Ain) {
+        float x = Ain * (float) (1 << input_q);
+        if (x >= input_max) return input_max;
+        if (x <= -input_max - 1) return -input_max - 1;
+        return (sample) (x >= 0.0f ? x + 0.5f : x - 0.5f);
+    }
+
+    static float to_float(sample x) { return x * (1.0f / (1 << level_q)); }
+
+    template <int HpLen>                                    // Q11 / HpLen -> Q16
+    static sample hp_gain(sample acc) {                     // (identity for HpLen = 32)
+        return (sample) (((int64_t) acc * (((32 << 16) + HpLen / 2) / HpLen)) >> 16);
+    }
+    static sample deriv_gain(sample acc) { return acc; }    // Q16 / 8 = Q19
+    static sample square(sample x) {                        // Q19^2 = Q38 -> Q16
+        int64_t y = ((int64_t) x * x) >> (2 * 19 - level_q);
+        return y > 0x7FFFFFFF ? (sample) 0x7FFFFFFF : (sample) y;
+    }
+    template <int MwiShift>
+    static sample mwi_gain(wide sum) { return (sample) (sum >> MwiShift); }
+    static sample half(sample x) { return x >> 1; }
+    static sample quarter(sample x) { return x >> 2; }
+
+    static sample running_avg8(const sample *w) {
+        wide sum = 0;
+        for (int i = 0; i < 8; i++) {
+            sum += w[i];
+        }
+        return average8(sum);
+    }
+
+    static sample average8(wide sum) { return (sample) (sum >> 3); }
+
+    /* npki, spki >= 0, so npki / sqrt(npki^2 + spki^2) > T is the same as
+     * npki > k * spki. NSR itself is not computed and stays 0.
+     */
+    static bool noisy(sample npki, sample spki, float *) {
+        return ((int64_t) npki << level_q) > (int64_t) PAN_T_NSR_LIMIT_Q16 * spki;
+    }
+};
+
+/**
+ * @brief Delay lines of the Pan-Tompkins filter cascade for one ECG channel.
+ *
+ * x1/y1 hold the LP filter input/output history, x2/y2 the HP filter (y2
+ * before the 1/hp_len gain), x3 the derivative input, x4 the moving window
+ * integrator input (x4_sum is its running sum) and mwi the last
+ * peak_lag + 1 integrated outputs used for edge detection. All of them are
+ * delay_lines, so taps()[0] is the most recent sample; their lengths come
+ * from Rate. The structure holds no pointers, so channels can be packed
+ * into a plain array and zeroed with pan_T_Filter_Init().
+ */
+template <typename Ops, typename Rate = pan_T_default_rate>
+struct pan_T_Filter_T {
+    delay_line<Rate::lp_ring, typename Ops::sample> x1;
+    delay_line<3, typename Ops::sample> y1;
+    delay_line<Rate::hp_ring, typename Ops::sample> x2;
+    delay_line<2, typename Ops::sample> y2;
+    delay_line<Rate::deriv_ring, typename Ops::sample> x3;
+    delay_line<Rate::mwi_ring, typename Ops::sample> x4;
+    typename Ops::wide x4_sum;
+    delay_line<Rate::peak_ring, typename Ops::sample> mwi;
+};
+
+/**
+ * @brief Peak tracking state of the Pan-Tompkins moving threshold stage.
+ *
+ * peakt is the running local maximum of the integrated signal, peaki the last
+ * completed peak and QRS_detected the current detection flag. peaks counts
+ * completed peaks; spki, npki and their windows only change when it does.
+ */
+template <typename Ops>
+struct pan_T_Threshold_T {
+    typename Ops::sample peakt;
+    typename Ops::sample peaki;
+    bool QRS_detected;
+    uint32_t peaks;
+};
+
+/**
+ * @brief Complete QRS detector for one ECG channel.
+ *
+ * Bundles the filter and threshold state together with the values that used
+ * to live as locals in main(): the moving threshold and the signal/noise peak
+ * levels with their 8 entry averaging windows, which keep running sums so
+ * spki/npki are updated in constant time. The last three integrated
+ * outputs are in filter.mwi. Instances are independent, so any number of
+ * channels can be kept in an array and driven one sample at a time with
+ * pan_T_Detector_Process().
+ */
+template <typename Ops, typename Rate = pan_T_default_rate>
+struct pan_T_Detector_T {
+    pan_T_Filter_T<Ops, Rate> filter;
+    pan_T_Threshold_T<Ops> threshold;
+    typename Ops::sample thresholdi1;
+    typename Ops::sample spki;
+    typename Ops::sample npki;
+    running_window<8, typename Ops::sample, typename Ops::wide> spki_window;
+    running_window<8, typename Ops::sample, typename Ops::wide> npki_window;
+};
+
+/**
+ * @brief Noise classification state of one ECG channel.
+ *
+ * The signal is classified noisy when the noise to signal ratio
+ * NSR = npki / sqrt(npki^2 + spki^2) exceeds SNR_THRESHOLD. While the signal
+ * is clean, the spki/npki windows of the detector are saved; when it goes
+ * from noisy back to clean, the saved windows are restored. spki and npki
+ * only change when the threshold stage completes a peak, so the
+ * classification is only redone when the detector's peak count differs from
+ * seen_peaks.
+ */
+template <typename Ops>
+struct pan_T_Noise_T {
+    float NSR;
+    bool cur_noise_state;
+    bool prev_noise_state;
+    uint32_t seen_peaks;        // det->threshold.peaks at the last classification
+    running_window<8, typename Ops::sample, typename Ops::wide> spki_window_clean;
+    running_window<8, typename Ops::sample, typename Ops::wide> npki_window_clean;
+};
+
+/**
+ * @brief A heartbeat located by pan_T_Beat_Update().
+ *
+ * Sample indices count detector samples from the last pan_T_Beat_Init().
+ */
+typedef struct _pan_T_beat {
+    uint32_t r_sample;          // Estimated R peak, input sample index
+    uint32_t detect_sample;     // Sample on which QRS_detected rose
+} pan_T_beat;
+
+/**
+ * @brief Beat timing state of one ECG channel.
+ *
+ * QRS_detected rises while the integrated signal climbs past the threshold,
+ * some 80 ms after the R peak it belongs to and at a time that depends on
+ * the QRS shape. The R peak is timed from the band-passed value instead:
+ * its largest magnitude in the window around the detection, less the filter
+ * delay Rate::bp_delay. value keeps the last beat_window + 1 band-passed
+ * values; a detection is located beat_lookahead samples after its rising
+ * edge, once the window covers the whole QRS.
+ */
+template <typename Ops, typename Rate = pan_T_default_rate>
+struct pan_T_Beat_T {
+    delay_line<Rate::beat_ring, typename Ops::sample> value;
+    uint32_t sample;            // Index of the next sample
+    uint32_t detect_sample;     // Rising edge of the beat being located
+    int pending;                // Samples until it is located, 0 if none
+    bool prev_qrs;
+};
+
+/**
+ * @brief Clears all delay lines of a filter state.
+ */
+template <typename Ops, typename Rate>
+inline void pan_T_Filter_Init(pan_T_Filter_T<Ops, Rate> *state) {
+    memset(state, 0, sizeof(*state));
+}
+
+/**
+ * @brief One sample of the filter cascade.
+ *
+ * Every stage keeps its history in a delay_line, so adding a sample is a
+ * constant time index update. The LP, HP and derivative filters use the
+ * compile-time tap lists, which leaves a few adds per stage, and the MWI
+ * keeps a running sum of its window. The running sum is recomputed from the
+ * window every time x4 wraps around so float rounding errors cannot
+ * accumulate. For the same reason the HP feedback runs on the unscaled sum
+ * of its moving average and the 1/hp_len gain is applied to the output
+ * only: the sum of LP outputs needs no rounding, the gain generally does,
+ * and rounding inside the feedback (a pole at z = 1) would never decay.
+ *
+ * @param state Filter state of the channel.
+ * @param Ain Input sample, see Ops::from_input().
+ * @return The filtered (band-passed) value of the input signal.
+ */
+template <typename Ops, typename Rate>
+inline typename Ops::sample pan_T_Filter(pan_T_Filter_T<Ops, Rate> *state, typename Ops::sample Ain) {
+    typedef typename Ops::sample sample;
+
+    /* LP filter */
+    state->x1.push(Ain);
+    state->y1.push(Rate::lp_feedback::dot(state->y1.taps()) + Rate::lp_taps::dot(state->x1.taps()));
+
+    /* HP Filter */
+    state->x2.push(state->y1[0]);
+    state->y2.push(Rate::hp_feedback::dot(state->y2.taps()) + Rate::hp_taps::dot(state->x2.taps()));
+    sample value = Ops::template hp_gain<Rate::hp_len>(state->y2[0]);
+
+    /* Deriv 2 Filter */
+    state->x3.push(value);
+    sample y3 = Ops::deriv_gain(Rate::deriv_taps::dot(state->x3.taps()));
+
+    /* Squaring Filter */
+    y3 = Ops::square(y3);
+
+    /* Moving Integral Filter */
+    state->x4.push(y3);
+    if (state->x4.head == 0) {
+        const sample *x4 = state->x4.taps();
+        state->x4_sum = 0;
+        for (int i = 0; i < Rate::mwi_len; i++) {
+            state->x4_sum += x4[i];
+        }
+    } else {
+        state->x4_sum += y3 - state->x4[Rate::mwi_len];
+    }
+    state->mwi.push(Ops::template mwi_gain<Rate::mwi_shift>(state->x4_sum));
+    return value;
+}
+
+/* Adds a peak to a spki/npki window and returns the window average, for the
+ * window representations used by pan_T_Threshold(). Only the running_window
+ * of pan_T_Detector_T is constant time. Other window types provide their own
+ * overload next to their definition, found when pan_T_Threshold() is
+ * instantiated.
+ */
+template <typename Ops>
+inline typename Ops::sample pan_T_Window_Avg(running_window<8, typename Ops::sample, typename Ops::wide> *window,
+                                             typename Ops::sample input) {
+    window->push(input);
+    return Ops::average8(window->sum);
+}
+
+template <typename Ops>
+inline typename Ops::sample pan_T_Window_Avg(delay_line<8, typename Ops::sample> *window, typename Ops::sample input) {
+    window->push(input);
+    return Ops::running_avg8(window->taps());
+}
+
+/**
+ * @brief Clears the peak tracking state of the threshold stage.
+ */
+template <typename Ops>
+inline void pan_T_Threshold_Init(pan_T_Threshold_T<Ops> *state) {
+    state->peakt = 0;
+    state->peaki = 0;
+    state->QRS_detected = false;
+    state->peaks = 0;
+}
+
+/**
+ * @brief Moving threshold stage of the Pan-Tompkins algorithm.
+ *
+ * @param state Threshold state of the channel.
+ * @param yOut The last lag + 1 integrated outputs, newest first.
+ * @param thresholdi1 Pointer to the threshold detection value.
+ * @param spki Pointer to the peak value of the signal (QRS complex).
+ * @param npki Pointer to the peak value of the noise.
+ * @param spki_window Recent peak values of the signal.
+ * @param npki_window Recent peak values of the noise.
+ * @param lag Samples between the outputs compared to find rising and falling
+ *            slopes, pan_T_rate::peak_lag (2 at 200 sps).
+ * @return bool True if a QRS complex is detected, false otherwise.
+ */
+template <typename Ops, typename Window>
+inline bool pan_T_Threshold(pan_T_Threshold_T<Ops> *state, const typename Ops::sample *yOut,
+                            typename Ops::sample *thresholdi1, typename Ops::sample *spki, typename Ops::sample *npki,
+                            Window spki_window, Window npki_window, int lag = 2) {
+    if (yOut[0] > yOut[lag] && yOut[0] > state->peakt) {
+        state->peakt = yOut[0];
+    }
+    if (state->peakt > *thresholdi1) {
+        state->QRS_detected = true;
+    }
+    if (yOut[0] <= yOut[lag] && yOut[0] < Ops::half(state->peakt)) {
+        state->peaki = state->peakt; // Peakt is a local max
+        state->QRS_detected = false;
+        if (state->peaki > *thresholdi1) {
+            *spki = pan_T_Window_Avg<Ops>(spki_window, state->peaki);
+        } else {    // Local max is a noise peak.
+            *npki = pan_T_Window_Avg<Ops>(npki_window, state->peaki);
+        }
+        *thresholdi1 = *npki + Ops::quarter(*spki - *npki);
+        state->peakt = 0; // Reset peakt for polling local max
+        state->peaks++;
+    }
+    return state->QRS_detected;
+}
+
+/**
+ * @brief Resets a detector to the power-on state.
+ */
+template <typename Ops, typename Rate>
+inline void pan_T_Detector_Init(pan_T_Detector_T<Ops, Rate> *det) {
+    memset(det, 0, sizeof(*det));
+    pan_T_Filter_Init(&det->filter);
+    pan_T_Threshold_Init(&det->threshold);
+}
+
+/**
+ * @brief Runs one sample through the filter and threshold stages of a detector.
+ *
+ * @param det Detector of the channel.
+ * @param Ain Input sample, see Ops::from_input().
+ * @param filtered Optional output for the filtered (band-passed) value, may be NULL.
+ * @return bool True if a QRS complex is detected, false otherwise.
+ */
+template <typename Ops, typename Rate>
+inline bool pan_T_Detector_Process(pan_T_Detector_T<Ops, Rate> *det, typename Ops::sample Ain, typename Ops::sample *filtered) {
+    typename Ops::sample value = pan_T_Filter(&det->filter, Ain);
+    if (filtered != NULL) {
+        *filtered = value;
+    }
+    return pan_T_Threshold(&det->threshold, det->filter.mwi.taps(), &det->thresholdi1, &det->spki, &det->npki,
+                           &det->spki_window, &det->npki_window, Rate::peak_lag);
+}
+
+/**
+ * @brief Resets the noise classification of a channel to clean.
+ *
+ * The next pan_T_Noise_Update() classifies the detector whatever its peak
+ * count; reset the noise state whenever the detector is reset.
+ */
+template <typename Ops>
+inline void pan_T_Noise_Init(pan_T_Noise_T<Ops> *state) {
+    memset(state, 0, sizeof(*state));
+    state->seen_peaks = 0xFFFFFFFFu;
+}
+
+/**
+ * @brief Classifies the current sample of a channel as clean or noisy.
+ *
+ * Call once per sample after pan_T_Detector_Process(). Saves the spki/npki
+ * windows while the signal is clean and restores them into the detector on a
+ * noisy to clean transition.
+ *
+ * Between peaks spki and npki are constant, so the result of the previous
+ * sample still holds (and the saved windows are already up to date): only the
+ * peak count is compared. The NSR, the save and the restore run once per
+ * completed peak.
+ *
+ * @param state Noise state of the channel.
+ * @param det Detector of the channel.
+ * @return bool True if the signal is noisy (cur_noise_state), false otherwise.
+ */
+template <typename Ops, typename Rate>
+inline bool pan_T_Noise_Update(pan_T_Noise_T<Ops> *state, pan_T_Detector_T<Ops, Rate> *det) {
+    if (det->threshold.peaks == state->seen_peaks) {
+        return state->cur_noise_state;
+    }
+    state->seen_peaks = det->threshold.peaks;
+    state->cur_noise_state = Ops::noisy(det->npki, det->spki, &state->NSR);
+
+    if (!state->cur_noise_state) {
+        // Acceptable amount of noise, save copy to clean array
+        state->npki_window_clean = det->npki_window;
+        state->spki_window_clean = det->spki_window;
+    }
+
+    if (!state->cur_noise_state && state->prev_noise_state) {
+        // If state transitions from noisy to clean, restore spki and npki arrays to clean state
+        det->npki_window = state->npki_window_clean;
+        det->spki_window = state->spki_window_clean;
+        det->spki = Ops::average8(det->spki_window.sum);
+        det->npki = Ops::average8(det->npki_window.sum);
+    }
+
+    state->prev_noise_state = state->cur_noise_state;
+    return state->cur_noise_state;
+}
+
+/**
+ * @brief Resets the beat timing of a channel; sample indices restart at 0.
+ */
+template <typename Ops, typename Rate>
+inline void pan_T_Beat_Init(pan_T_Beat_T<Ops, Rate> *state) {
+    memset(state, 0, sizeof(*state));
+}
+
+/**
+ * @brief Times the R peak of every QRS detection.
+ *
+ * Call once per sample with the filtered value and the QRS flag returned by
+ * pan_T_Detector_Process(). Rate::beat_lookahead samples after QRS_detected
+ * rises, the largest magnitude of the band-passed value from
+ * Rate::beat_window samples before that up to now is taken as the R peak
+ * and moved back by the filter delay Rate::bp_delay. A rising edge while a
+ * beat is still being located is part of the same beat.
+ *
+ * Most samples cost a delay_line push and a compare; the search runs once
+ * per beat.
+ *
+ * @param state Beat timing state of the channel.
+ * @param value Filtered (band-passed) value of the sample.
+ * @param qrs QRS_detected of the sample.
+ * @param beat Receives the beat when one is located.
+ * @return bool True if a beat was located on this sample.
+ */
+template <typename Ops, typename Rate>
+inline bool pan_T_Beat_Update(pan_T_Beat_T<Ops, Rate> *state, typename Ops::sample value, bool qrs,
+                              pan_T_beat *beat) {
+    typedef typename Ops::sample sample;
+    uint32_t n = state->sample++;
+    state->value.push(value);
+    if (qrs && !state->prev_qrs && state->pending == 0) {
+        state->detect_sample = n;
+        state->pending = Rate::beat_lookahead + 1;
+    }
+    state->prev_qrs = qrs;
+    if (state->pending == 0 || --state->pending > 0) {
+        return false;
+    }
+
+    const sample *v = state->value.taps();
+    int best = 0;
+    sample best_mag = v[0] < 0 ? -v[0] : v[0];
+    for (int k = 1; k < Rate::beat_ring; k++) {
+        sample mag = v[k] < 0 ? -v[k] : v[k];
+        if (mag > best_mag) {
+            best_mag = mag;
+            best = k;
+        }
+    }
+    uint32_t peak = n - (uint32_t) best;
+    beat->r_sample = peak > (uint32_t) Rate::bp_delay ? peak - Rate::bp_delay : 0;
+    beat->detect_sample = state->detect_sample;
+    return true;
+}
+
+#endif
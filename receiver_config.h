@@ -0,0 +1,25 @@
+/* Sample rate and buffer sizes of the receiver (main.cpp).
+ *
+ * Kept apart from main.cpp so host tools that budget the receiver's RAM
+ * (host/mem_report) size the same queues the board build does.
+ */
+
+#ifndef _receiver_config
+#define _receiver_config
+
+// Rate of the sampling ISR, Hz
+#define SAMP_RATE 360
+
+// Bytes received from the sender: queue length and bytes decoded per pass
+#define RX_QUEUE_LEN 256
+#define RX_BATCH 16
+
+// Framed link playout queue, and the samples buffered before playout starts
+#define PLAYOUT_QUEUE_LEN 128
+#define PLAYOUT_PREFILL 16
+
+// Samples taken by ISRfxn(): queue length and samples processed per pass
+#define SAMPLE_QUEUE_LEN 32
+#define SAMPLE_BATCH 8
+
+#endif
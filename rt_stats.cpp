@@ -0,0 +1,125 @@
+#include "rt_stats.h"
+#include <string.h>
+
+/**
+ * @brief Clears the statistics.
+ *
+ * @param s Statistics to reset.
+ * @param clock Free running clock, e.g. us_ticker_read.
+ * @param period Tick period in clock ticks, used by rt_stats_load().
+ */
+void rt_stats_init(rt_stats *s, rt_clock_fn clock, uint32_t period){
+    memset(s, 0, sizeof(*s));
+    s->clock = clock;
+    s->period = period;
+    s->latency_min = 0xFFFFFFFFu;
+}
+
+/**
+ * @brief Records a sampling tick. Call first thing in the ISR.
+ *
+ * @param s Statistics.
+ * @param pending True if the previous sample has not been processed yet.
+ */
+void rt_stats_tick(rt_stats *s, bool pending){
+    s->tick_time = s->clock();
+    s->ticks++;
+    if (pending) {
+        s->overruns++;
+    }
+    uint32_t frames = s->frames;
+    if (frames == s->seen_frames && s->ticks > 1) {
+        s->stale++;
+    }
+    s->seen_frames = frames;
+}
+
+/**
+ * @brief Records that a complete frame (a new num) arrived from the sender.
+ */
+void rt_stats_frame(rt_stats *s){
+    s->frames++;
+}
+
+/**
+ * @brief Marks the start of processing of the current sample.
+ */
+void rt_stats_begin(rt_stats *s){
+    s->begin_tick = s->tick_time;
+    s->begin_time = s->clock();
+}
+
+/**
+ * @brief Marks the start of processing of a queued sample.
+ *
+ * @param s Statistics.
+ * @param tick_time Clock value the ISR stored with the sample.
+ */
+void rt_stats_begin_at(rt_stats *s, uint32_t tick_time){
+    s->begin_tick = tick_time;
+    s->begin_time = s->clock();
+}
+
+/* Histogram bin of a latency: floor(log2(t)), clamped to the last bin. */
+static int latency_bin(uint32_t t){
+    int bin = 0;
+    while (t > 1 && bin < RT_STATS_BINS - 1) {
+        t >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+/**
+ * @brief Marks the end of processing of the current sample.
+ */
+void rt_stats_end(rt_stats *s){
+    uint32_t now = s->clock();
+    uint32_t latency = now - s->begin_tick;
+    uint32_t exec = now - s->begin_time;
+
+    s->processed++;
+    if (latency < s->latency_min) {
+        s->latency_min = latency;
+    }
+    if (latency > s->latency_max) {
+        s->latency_max = latency;
+    }
+    s->latency_sum += latency;
+    s->hist[latency_bin(latency)]++;
+    s->exec_last = exec;
+    if (exec > s->exec_max) {
+        s->exec_max = exec;
+    }
+}
+
+/**
+ * @brief Copies the statistics consistently while the ISR keeps running.
+ *
+ * The ISR only increments counters, so the copy is retried until no tick
+ * happened while it was taken.
+ *
+ * @param s Live statistics.
+ * @param out Copy.
+ */
+void rt_stats_snapshot(const rt_stats *s, rt_stats *out){
+    uint32_t ticks;
+    do {
+        ticks = s->ticks;
+        memcpy(out, (const void *) s, sizeof(*out));
+    } while (ticks != s->ticks);
+}
+
+/**
+ * @brief Mean tick-to-done latency in clock ticks, 0 before the first sample.
+ */
+float rt_stats_mean_latency(const rt_stats *s){
+    return s->processed ? (float) s->latency_sum / s->processed : 0.0f;
+}
+
+/**
+ * @brief Worst-case execution time as a fraction of the tick period.
+ */
+float rt_stats_load(const rt_stats *s){
+    return s->period ? (float) s->exec_max / s->period : 0.0f;
+}
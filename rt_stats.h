@@ -0,0 +1,153 @@
+/* Real-time instrumentation of the sampling ISR and the processing loop.
+ *
+ * main.cpp samples num in ISRfxn() and queues it for the main loop, which
+ * never blocks: RXfxn() queues the sender's bytes on the receive interrupt,
+ * and the loop alternates between decoding the queued bytes and processing
+ * the queued samples. Two things can go wrong without anybody noticing:
+ *
+ *  - overrun: a tick finds the sample queue full because the loop, busy
+ *    decoding received bytes or processing earlier samples, has fallen
+ *    behind. That sample is lost.
+ *  - stale: a tick arrives but no new frame came from the sender since the
+ *    previous tick, so the same num is processed twice.
+ *
+ * An rt_stats counts both and records the latency from the tick to the end
+ * of processing (min/mean/max and a log2 histogram) and the execution time
+ * of the filter + threshold + noise block (worst case and last). All times
+ * are in ticks of the clock function, microseconds with us_ticker_read() on
+ * the board; every difference is taken modulo 2^32, so the clock may wrap.
+ *
+ * The RT_STATS_* macros compile to nothing unless PAN_T_RT_STATS is defined,
+ * so the instrumented main.cpp costs nothing in a normal build:
+ *
+ *      void ISRfxn() {
+ *          bool queued = samples.push(sample);
+ *          RT_STATS_TICK(&rt, !queued);
+ *      }
+ *      while (samples.pop(&sample)) {
+ *          RT_STATS_BEGIN_AT(&rt, sample.time);
+ *          ...
+ *          RT_STATS_END(&rt);
+ *      }
+ */
+
+#ifndef _rt_stats
+#define _rt_stats
+
+#include <stdint.h>
+
+// Latency histogram bins: bin 0 counts < 2 clock ticks, bin k [2^k, 2^(k+1)),
+// the last bin everything longer.
+#define RT_STATS_BINS 16
+
+typedef uint32_t (*rt_clock_fn)(void);
+
+/**
+ * @brief Deadline statistics of one sampling ISR and its processing loop.
+ *
+ * The fields written by rt_stats_tick() are volatile since it runs in the
+ * ISR. Read the statistics with rt_stats_snapshot().
+ */
+typedef struct _rt_stats {
+    rt_clock_fn clock;
+    uint32_t period;                // Tick period, clock ticks
+
+    // Written by the ISR
+    volatile uint32_t ticks;        // Sampling ticks
+    volatile uint32_t overruns;     // Ticks that found the previous sample unprocessed
+    volatile uint32_t stale;        // Ticks without a new frame since the previous tick
+    volatile uint32_t tick_time;    // Clock at the last tick
+    uint32_t seen_frames;           // frames at the previous tick
+
+    // Written by the main loop
+    volatile uint32_t frames;       // Frames received, see rt_stats_frame()
+    uint32_t processed;             // Samples processed
+    uint32_t begin_time;            // Clock at RT_STATS_BEGIN
+    uint32_t begin_tick;            // tick_time of the sample being processed
+    uint32_t latency_min;
+    uint32_t latency_max;
+    uint64_t latency_sum;
+    uint32_t hist[RT_STATS_BINS];
+    uint32_t exec_last;             // Execution time of the last sample
+    uint32_t exec_max;              // Worst-case execution time
+} rt_stats;
+
+/**
+ * @brief Clears the statistics.
+ *
+ * @param s Statistics to reset.
+ * @param clock Free running clock, e.g. us_ticker_read.
+ * @param period Tick period in clock ticks, used by rt_stats_load().
+ */
+void rt_stats_init(rt_stats *s, rt_clock_fn clock, uint32_t period);
+
+/**
+ * @brief Records a sampling tick. Call first thing in the ISR.
+ *
+ * @param s Statistics.
+ * @param pending True if the sample could not be handed over because the
+ *                previous one(s) have not been processed yet.
+ */
+void rt_stats_tick(rt_stats *s, bool pending);
+
+/**
+ * @brief Records that a complete frame (a new num) arrived from the sender.
+ */
+void rt_stats_frame(rt_stats *s);
+
+/**
+ * @brief Marks the start of processing of the current sample.
+ */
+void rt_stats_begin(rt_stats *s);
+
+/**
+ * @brief Marks the start of processing of a queued sample.
+ *
+ * Same as rt_stats_begin(), but the latency is measured from tick_time, the
+ * clock value the ISR stored with the sample, instead of from the last tick.
+ */
+void rt_stats_begin_at(rt_stats *s, uint32_t tick_time);
+
+/**
+ * @brief Marks the end of processing of the current sample.
+ *
+ * Updates the tick-to-done latency and the execution time since
+ * rt_stats_begin().
+ */
+void rt_stats_end(rt_stats *s);
+
+/**
+ * @brief Copies the statistics consistently while the ISR keeps running.
+ *
+ * @param s Live statistics.
+ * @param out Copy.
+ */
+void rt_stats_snapshot(const rt_stats *s, rt_stats *out);
+
+/**
+ * @brief Mean tick-to-done latency in clock ticks, 0 before the first sample.
+ */
+float rt_stats_mean_latency(const rt_stats *s);
+
+/**
+ * @brief Worst-case execution time as a fraction of the tick period.
+ *
+ * Above 1 the processing cannot keep up even when the sender is on time.
+ */
+float rt_stats_load(const rt_stats *s);
+
+#ifdef PAN_T_RT_STATS
+#define RT_STATS_TICK(s, pending)   rt_stats_tick((s), (pending))
+#define RT_STATS_FRAME(s)           rt_stats_frame(s)
+#define RT_STATS_BEGIN(s)           rt_stats_begin(s)
+#define RT_STATS_BEGIN_AT(s, t)     rt_stats_begin_at((s), (t))
+#define RT_STATS_END(s)             rt_stats_end(s)
+#else
+#define RT_STATS_TICK(s, pending)   ((void) (pending))
+#define RT_STATS_FRAME(s)           ((void) 0)
+#define RT_STATS_BEGIN(s)           ((void) 0)
+#define RT_STATS_BEGIN_AT(s, t)     ((void) 0)
+#define RT_STATS_END(s)             ((void) 0)
+#endif
+
+#endif
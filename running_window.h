@@ -0,0 +1,112 @@
+/* Fixed length window with running mean and variance.
+ *
+ * array_running_avg() shifts its array and re-adds every element for each new
+ * value, and std_dev() makes two passes over its input. A running_window
+ * keeps the last N values in a delay_line together with their sum and their
+ * sum of squared deviations from the mean (M2), and updates both when a value
+ * is pushed:
+ *
+ *      sum' = sum + x - x_old
+ *      M2'  = M2 + (x - x_old) * (x - mean' + x_old - mean)
+ *
+ * which is Welford's update for a window that drops x_old as it adds x. Both
+ * are recomputed from the window every N pushes (when the delay_line wraps
+ * around, as pan_T_Filter() does for the MWI sum), so float rounding errors
+ * cannot accumulate. A push is constant time; the recomputation adds
+ * O(N) once every N pushes.
+ *
+ * Acc is the type of the sum. Use a wider integer type for integer samples
+ * (running_window<8, int32_t, int64_t> in the fixed-point pipeline) to keep
+ * the sum exact; M2 is always kept as a float. mean(), variance() and
+ * stddev() return float; variance() is the sample variance, like std_dev().
+ *
+ * A zero filled running_window (memset or = {}) is a valid window holding N
+ * zeros.
+ */
+
+#ifndef _running_window
+#define _running_window
+
+#include <math.h>
+#include "delay_line.h"
+
+template <int N, typename T = float, typename Acc = T>
+struct running_window {
+    delay_line<N, T> window;    // The last N values, newest first
+    Acc sum;                    // Sum of the window
+    float m2;                   // Sum of squared deviations from the mean
+
+    /* Fills the window with zeros. */
+    void clear() {
+        window.clear();
+        sum = 0;
+        m2 = 0.0f;
+    }
+
+    /* Adds a value, dropping the oldest one. */
+    void push(T x) {
+        T oldest = window[N - 1];
+        float mean_old = mean();
+        window.push(x);
+        if (window.head == 0) {
+            renormalize();
+            return;
+        }
+        sum += (Acc) (x - oldest);
+        float xf = (float) x;
+        float of = (float) oldest;
+        m2 += (xf - of) * (xf - mean() + of - mean_old);
+        if (m2 < 0.0f) {
+            m2 = 0.0f;  // Rounding only; a sum of squares is never negative
+        }
+    }
+
+    /* Recomputes sum and M2 from the window, newest value first. */
+    void renormalize() {
+        const T *x = window.taps();
+        sum = 0;
+        for (int i = 0; i < N; i++) {
+            sum += x[i];
+        }
+        float m = mean();
+        m2 = 0.0f;
+        for (int i = 0; i < N; i++) {
+            float d = (float) x[i] - m;
+            m2 += d * d;
+        }
+    }
+
+    /* Contiguous view of the window, newest first. */
+    const T *taps() const {
+        return window.taps();
+    }
+
+    /* The value k pushes ago, 0 <= k < N. */
+    T operator[](int k) const {
+        return window[k];
+    }
+
+    float mean() const {
+        return (float) sum / N;
+    }
+
+    float variance() const {
+        return N > 1 ? m2 / (N - 1) : 0.0f;
+    }
+
+    float stddev() const {
+        return sqrtf(variance());
+    }
+
+    /* Number of values held. */
+    static int length() {
+        return N;
+    }
+
+    /* Bytes of RAM one window takes. */
+    static int footprint() {
+        return (int) sizeof(running_window);
+    }
+};
+
+#endif
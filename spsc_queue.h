@@ -0,0 +1,131 @@
+/* Wait-free single-producer / single-consumer ring buffer.
+ *
+ * Hands samples from ISRfxn() to the processing loop in main.cpp, or from a
+ * producer thread to a detector thread on the host. The producer only
+ * writes tail and the consumer only writes head, so neither side ever waits
+ * for the other: push() fails when the ring is full and pop() returns
+ * nothing when it is empty.
+ *
+ * head and tail are free running 32 bit counters; the slot of a counter is
+ * counter % N, with N a power of two. The fill level tail - head is correct
+ * across counter wrap-around.
+ *
+ * Ordering: the producer writes the slot before it publishes the new tail,
+ * and the consumer reads the slot before it publishes the new head. With
+ * C++11 that is std::atomic with release/acquire; the mbed build is C++98,
+ * where the counters are volatile and a memory barrier separates slot and
+ * counter accesses (enough between an ISR and the main loop on a single
+ * core, and correct on multiple cores too).
+ *
+ * Call clear() before first use.
+ */
+
+#ifndef _spsc_queue
+#define _spsc_queue
+
+#include <stdint.h>
+
+#if __cplusplus >= 201103L
+#include <atomic>
+
+/* Producer or consumer counter. */
+struct spsc_counter {
+    std::atomic<uint32_t> v;
+    uint32_t load_acquire() const { return v.load(std::memory_order_acquire); }
+    uint32_t load_relaxed() const { return v.load(std::memory_order_relaxed); }
+    void store_release(uint32_t x) { v.store(x, std::memory_order_release); }
+};
+#else
+/* Producer or consumer counter. */
+struct spsc_counter {
+    volatile uint32_t v;
+    uint32_t load_acquire() const {
+        uint32_t x = v;
+        __sync_synchronize();
+        return x;
+    }
+    uint32_t load_relaxed() const { return v; }
+    void store_release(uint32_t x) {
+        __sync_synchronize();
+        v = x;
+    }
+};
+#endif
+
+/* A sample and the clock value of the tick that took it. */
+typedef struct _timed_sample {
+    uint32_t time;
+    float value;
+} timed_sample;
+
+template <typename T, int N>
+struct spsc_queue {
+    T buf[N];
+    spsc_counter head;          // Next slot to read, written by the consumer
+    spsc_counter tail;          // Next slot to write, written by the producer
+    volatile uint32_t overflows;    // Pushes rejected because the ring was full
+    volatile uint32_t high_water;   // Highest fill level seen by push()
+
+    /* Empties the queue and clears the statistics. Not thread safe. */
+    void clear() {
+        head.store_release(0);
+        tail.store_release(0);
+        overflows = 0;
+        high_water = 0;
+    }
+
+    /* Producer: appends x. Returns false, and counts an overflow, if the
+     * queue is full.
+     */
+    bool push(const T &x) {
+        uint32_t t = tail.load_relaxed();
+        uint32_t fill = t - head.load_acquire();
+        if (fill >= (uint32_t) N) {
+            overflows = overflows + 1;
+            return false;
+        }
+        buf[t & (N - 1)] = x;
+        tail.store_release(t + 1);
+        if (fill + 1 > high_water) {
+            high_water = fill + 1;
+        }
+        return true;
+    }
+
+    /* Consumer: removes up to max elements into out, oldest first. Returns
+     * the number removed.
+     */
+    int pop(T *out, int max) {
+        uint32_t h = head.load_relaxed();
+        uint32_t avail = tail.load_acquire() - h;
+        int n = avail < (uint32_t) max ? (int) avail : max;
+        for (int k = 0; k < n; k++) {
+            out[k] = buf[(h + k) & (N - 1)];
+        }
+        head.store_release(h + n);
+        return n;
+    }
+
+    /* Consumer: removes the oldest element. Returns false if empty. */
+    bool pop(T *out) {
+        return pop(out, 1) == 1;
+    }
+
+    /* Number of queued elements. Exact only on the consumer or producer
+     * side; a snapshot anywhere else.
+     */
+    int size() const {
+        return (int) (tail.load_acquire() - head.load_acquire());
+    }
+
+    /* Number of slots. */
+    static int capacity() {
+        return N;
+    }
+
+private:
+    // N must be a power of two so the counters can wrap around.
+    typedef char n_is_power_of_two[(N > 0 && (N & (N - 1)) == 0) ? 1 : -1];
+};
+
+#endif
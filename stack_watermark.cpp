@@ -0,0 +1,32 @@
+#include "stack_watermark.h"
+
+/**
+ * @brief Fills bytes of stack below the caller's frame with STACK_PAINT_PATTERN.
+ *
+ * @param w Receives the painted region.
+ * @param bytes Bytes to paint, a multiple of 4.
+ */
+void stack_paint(stack_watermark *w, uint32_t bytes){
+    volatile uint32_t here = 0;
+    uintptr_t top = ((uintptr_t) &here & ~(uintptr_t) 3) - STACK_PAINT_GUARD;
+    w->frame = (uintptr_t) &here;
+    w->top = (uint32_t *) top;
+    w->bottom = (uint32_t *) (top - (bytes & ~3u));
+    for (volatile uint32_t *p = w->bottom; p < w->top; p++) {
+        *p = STACK_PAINT_PATTERN;
+    }
+}
+
+/**
+ * @brief Deepest stack use below the caller of stack_paint() since the paint, in bytes.
+ *
+ * @param w Region painted by stack_paint().
+ * @return uint32_t Bytes between the caller's frame and the lowest overwritten word.
+ */
+uint32_t stack_high_water(const stack_watermark *w){
+    const volatile uint32_t *p = w->bottom;
+    while (p < w->top && *p == STACK_PAINT_PATTERN) {
+        p++;
+    }
+    return (uint32_t) (w->frame - (uintptr_t) p);
+}
@@ -0,0 +1,57 @@
+/* Stack high-water mark.
+ *
+ * main() and everything it calls, and every interrupt handler (ISRfxn(),
+ * RXfxn(), the mbed ticker), share one stack, whose size is fixed by the
+ * linker. How much of it the deepest call chain plus a nested interrupt
+ * needs is not visible in the map file. stack_paint() fills a region below
+ * the caller's frame with a pattern; stack_high_water() later finds the
+ * lowest word that no longer holds it, which is the deepest the stack has
+ * grown into the painted region since.
+ *
+ * Paint early in main() with interrupts disabled (an interrupt frame pushed
+ * while painting would be overwritten), and paint no more than the stack
+ * the linker reserves below main()'s frame: on the F303K8 the stack and the
+ * heap share the RAM above the static data, so painting beyond the stack
+ * can overwrite heap blocks. The scan is O(painted bytes); call it rarely.
+ *
+ *      __disable_irq();
+ *      stack_paint(&stack, 1024);
+ *      __enable_irq();
+ *      ...
+ *      used = stack_high_water(&stack);    // Bytes below main()'s frame
+ */
+
+#ifndef _stack_watermark
+#define _stack_watermark
+
+#include <stdint.h>
+
+#define STACK_PAINT_PATTERN 0xA5C3A5C3u
+#define STACK_PAINT_GUARD 64        // Bytes left unpainted below stack_paint()'s own frame
+
+/**
+ * @brief Painted stack region.
+ */
+typedef struct _stack_watermark {
+    uint32_t *bottom;       // Lowest painted word
+    uint32_t *top;          // One past the highest painted word
+    uintptr_t frame;        // Stack pointer of the caller of stack_paint(), roughly
+} stack_watermark;
+
+/**
+ * @brief Fills bytes of stack below the caller's frame with STACK_PAINT_PATTERN.
+ *
+ * @param w Receives the painted region.
+ * @param bytes Bytes to paint, a multiple of 4.
+ */
+void stack_paint(stack_watermark *w, uint32_t bytes);
+
+/**
+ * @brief Deepest stack use below the caller of stack_paint() since the paint, in bytes.
+ *
+ * Equal to the painted size (plus the guard) if the stack grew past the
+ * painted region: paint more.
+ */
+uint32_t stack_high_water(const stack_watermark *w);
+
+#endif